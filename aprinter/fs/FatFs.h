@@ -472,6 +472,48 @@ public:
             m_block_in_cluster = o->blocks_per_cluster;
         }
         
+        struct Position {
+            uint32_t file_pos;
+            ClusterIndexType cluster;
+            ClusterBlockIndexType block_in_cluster;
+        };
+        
+        // Returns the position of the next block to be read, or if a read has
+        // completed in FS_BUFFER mode, of the block which was read.
+        Position getPosition (Context c)
+        {
+            TheDebugObject::access(c);
+            AMBRO_ASSERT(m_state == State::IDLE || m_state == State::READ_READY)
+            
+            Position pos;
+            pos.file_pos = m_file_pos;
+            pos.cluster = (m_file_pos == 0) ? 0 : m_chain.getCurrentCluster(c);
+            pos.block_in_cluster = m_block_in_cluster;
+            return pos;
+        }
+        
+        // Continues reading at a position obtained from getPosition of this
+        // or another File of the same file entry.
+        void setPosition (Context c, Position pos)
+        {
+            TheDebugObject::access(c);
+            AMBRO_ASSERT(m_state == State::IDLE)
+            
+            if (pos.file_pos == 0) {
+                return rewind(c);
+            }
+            m_chain.seekCluster(c, pos.cluster);
+            m_file_pos = pos.file_pos;
+            m_block_in_cluster = pos.block_in_cluster;
+        }
+        
+        uint32_t getFileSize (Context c)
+        {
+            TheDebugObject::access(c);
+            
+            return m_file_size;
+        }
+        
         void startReadUserBuf (Context c, DataWordType *buf)
         {
             TheDebugObject::access(c);
@@ -1513,6 +1555,18 @@ private:
             return m_current_cluster;
         }
         
+        // Continues iteration from a cluster of this chain previously
+        // obtained from getCurrentCluster. Only meant for reading.
+        void seekCluster (Context c, ClusterIndexType cluster)
+        {
+            AMBRO_ASSERT(m_state == State::IDLE)
+            AMBRO_ASSERT(is_cluster_idx_normal(cluster))
+            
+            m_iter_state = IterState::CLUSTER;
+            m_current_cluster = cluster;
+            extra_set_prev_cluster(c, 0);
+        }
+        
         APRINTER_FUNCTION_IF(Writable, void, requestNew (Context c))
         {
             auto *o = Object::self(c);
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AMBROLIB_FIXED_FP_TYPE_H
+#define AMBROLIB_FIXED_FP_TYPE_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/FixedPoint.h>
+#include <aprinter/base/Hints.h>
+
+namespace APrinter {
+    
+/*
+ * A signed fixed-point number with NumBits magnitude bits of which FracBits
+ * are fractional, usable in place of float or double in the planning code
+ * (LinearPlanner), for processors without an FPU.
+ * 
+ * Results of all operations saturate to the representable range, including
+ * division by zero. Conversion from double is implicit so that floating-point
+ * constants in generic code work, but it is meant for constants only; runtime
+ * values should be converted with importFp().
+ */
+template <int NumBits, int FracBits>
+class FixedFpType {
+    static_assert(FracBits > 0 && FracBits < NumBits, "");
+    
+public:
+    using FixedType = FixedPoint<NumBits, true, -FracBits>;
+    using IntType = typename FixedType::IntType;
+    
+    FixedFpType () = default;
+    
+    constexpr FixedFpType (double value)
+    : m_fixed(FixedType::importBitsConstexpr(const_bits(__builtin_ldexp(value, FracBits))))
+    {
+    }
+    
+    static FixedFpType importFixed (FixedType op)
+    {
+        FixedFpType res;
+        res.m_fixed = op;
+        return res;
+    }
+    
+    template <typename FpType>
+    static FixedFpType importFp (FpType op)
+    {
+        return importFixed(FixedType::importFpSaturatedRound(op));
+    }
+    
+    FixedType fixedValue () const
+    {
+        return m_fixed;
+    }
+    
+    IntType bitsValue () const
+    {
+        return m_fixed.bitsValue();
+    }
+    
+    template <typename FpType>
+    FpType fpValue () const
+    {
+        return m_fixed.template fpValue<FpType>();
+    }
+    
+    static FixedFpType maxValue ()
+    {
+        return importFixed(FixedType::maxValue());
+    }
+    
+    friend FixedFpType operator- (FixedFpType op)
+    {
+        return importFixed(-op.m_fixed);
+    }
+    
+    friend FixedFpType operator+ (FixedFpType op1, FixedFpType op2)
+    {
+        return importFixed((op1.m_fixed + op2.m_fixed).template dropBitsSaturated<NumBits>());
+    }
+    
+    friend FixedFpType operator- (FixedFpType op1, FixedFpType op2)
+    {
+        return importFixed((op1.m_fixed - op2.m_fixed).template dropBitsSaturated<NumBits>());
+    }
+    
+    friend FixedFpType operator* (FixedFpType op1, FixedFpType op2)
+    {
+        return importFixed(FixedResMultiply<-FracBits>(op1.m_fixed, op2.m_fixed).template dropBitsSaturated<NumBits>());
+    }
+    
+    friend FixedFpType operator/ (FixedFpType op1, FixedFpType op2)
+    {
+        return importFixed(FixedResDivide<-FracBits, NumBits, true>(op1.m_fixed, op2.m_fixed));
+    }
+    
+    friend bool operator== (FixedFpType op1, FixedFpType op2) { return op1.bitsValue() == op2.bitsValue(); }
+    friend bool operator!= (FixedFpType op1, FixedFpType op2) { return op1.bitsValue() != op2.bitsValue(); }
+    friend bool operator< (FixedFpType op1, FixedFpType op2) { return op1.bitsValue() < op2.bitsValue(); }
+    friend bool operator> (FixedFpType op1, FixedFpType op2) { return op1.bitsValue() > op2.bitsValue(); }
+    friend bool operator<= (FixedFpType op1, FixedFpType op2) { return op1.bitsValue() <= op2.bitsValue(); }
+    friend bool operator>= (FixedFpType op1, FixedFpType op2) { return op1.bitsValue() >= op2.bitsValue(); }
+    
+    FixedFpType & operator+= (FixedFpType op) { return *this = *this + op; }
+    FixedFpType & operator-= (FixedFpType op) { return *this = *this - op; }
+    FixedFpType & operator*= (FixedFpType op) { return *this = *this * op; }
+    FixedFpType & operator/= (FixedFpType op) { return *this = *this / op; }
+    
+private:
+    static constexpr IntType const_bits (double x)
+    {
+        return (x >= FixedType::maxValue().bitsValue()) ? FixedType::maxValue().bitsValue() :
+               (x <= FixedType::minValue().bitsValue()) ? FixedType::minValue().bitsValue() :
+               (IntType)(x + ((x < 0.0) ? -0.5 : 0.5));
+    }
+    
+    FixedType m_fixed;
+};
+
+// Overloads of the FloatTools functions used by the planning code.
+
+template <int NumBits, int FracBits>
+bool FloatIsPosOrPosZero (FixedFpType<NumBits, FracBits> x)
+{
+    return x.bitsValue() >= 0;
+}
+
+template <int NumBits, int FracBits>
+bool FloatIsNan (FixedFpType<NumBits, FracBits> x)
+{
+    return false;
+}
+
+template <int NumBits, int FracBits>
+FixedFpType<NumBits, FracBits> FloatMin (FixedFpType<NumBits, FracBits> x, FixedFpType<NumBits, FracBits> y)
+{
+    return (y < x) ? y : x;
+}
+
+template <int NumBits, int FracBits>
+FixedFpType<NumBits, FracBits> FloatMax (FixedFpType<NumBits, FracBits> x, FixedFpType<NumBits, FracBits> y)
+{
+    return (y > x) ? y : x;
+}
+
+template <int NumBits, int FracBits>
+FixedFpType<NumBits, FracBits> FloatAbs (FixedFpType<NumBits, FracBits> x)
+{
+    return (x.bitsValue() < 0) ? -x : x;
+}
+
+template <int NumBits, int FracBits>
+FixedFpType<NumBits, FracBits> FloatLdexp (FixedFpType<NumBits, FracBits> x, int exp)
+{
+    using TheFixedFpType = FixedFpType<NumBits, FracBits>;
+    
+    if (exp < 0) {
+        return TheFixedFpType::importFixed(TheFixedFpType::FixedType::importBits(x.bitsValue() / ((typename TheFixedFpType::IntType)1 << -exp)));
+    }
+    while (exp-- > 0) {
+        x = x + x;
+    }
+    return x;
+}
+
+template <int NumBits, int FracBits>
+FixedFpType<NumBits, FracBits> FloatSqrt (FixedFpType<NumBits, FracBits> x)
+{
+    using TheFixedFpType = FixedFpType<NumBits, FracBits>;
+    
+    if (AMBRO_UNLIKELY(x.bitsValue() <= 0)) {
+        return 0.0;
+    }
+    typename TheFixedFpType::FixedType res = FixedSquareRoot<false>(x.fixedValue().toUnsignedUnsafe());
+    return TheFixedFpType::importFixed(res);
+}
+
+}
+
+#endif
@@ -43,7 +43,7 @@
 /**
  * Define a template struct which exposes its own template parameters.
  * The argument extra specifies any additional definitions inside
- * the struct. From 1 up to 22 template parameters are supported.
+ * the struct. From 1 up to 32 template parameters are supported.
  * 
  * \code
  * APRINTER_ALIAS_STRUCT(MyStruct, (
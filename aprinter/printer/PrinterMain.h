@@ -89,14 +89,19 @@ APRINTER_ALIAS_STRUCT(PrinterMainParams, (
     APRINTER_AS_VALUE(int, StepperSegmentBufferSize),
     APRINTER_AS_VALUE(int, LookaheadBufferSize),
     APRINTER_AS_VALUE(int, LookaheadCommitCount),
+    APRINTER_AS_VALUE(int, MinLookaheadCommitCount),
+    APRINTER_AS_VALUE(bool, JerkLimitEnabled),
     APRINTER_AS_TYPE(ForceTimeout),
     APRINTER_AS_TYPE(FpType),
+    APRINTER_AS_TYPE(PlannerFpType),
     APRINTER_AS_TYPE(WatchdogService),
     APRINTER_AS_VALUE(bool, WatchdogDebugMode),
     APRINTER_AS_TYPE(ConfigManagerService),
     APRINTER_AS_TYPE(ConfigList),
     APRINTER_AS_TYPE(AxesList),
     APRINTER_AS_TYPE(TransformParams),
+    APRINTER_AS_TYPE(ArcParams),
+    APRINTER_AS_TYPE(JunctionDeviationParams),
     APRINTER_AS_TYPE(LasersList),
     APRINTER_AS_TYPE(ModulesList)
 ))
@@ -108,8 +113,11 @@ APRINTER_ALIAS_STRUCT(PrinterMainAxisParams, (
     APRINTER_AS_TYPE(DefaultMax),
     APRINTER_AS_TYPE(DefaultMaxSpeed),
     APRINTER_AS_TYPE(DefaultMaxAccel),
+    APRINTER_AS_TYPE(DefaultMaxJerk),
     APRINTER_AS_TYPE(DefaultDistanceFactor),
     APRINTER_AS_TYPE(DefaultCorneringDistance),
+    APRINTER_AS_TYPE(InputShaper),
+    APRINTER_AS_TYPE(PressureAdvance),
     APRINTER_AS_TYPE(Homing),
     APRINTER_AS_VALUE(bool, IsCartesian),
     APRINTER_AS_VALUE(bool, IsExtruder),
@@ -118,6 +126,29 @@ APRINTER_ALIAS_STRUCT(PrinterMainAxisParams, (
     APRINTER_AS_TYPE(SlaveSteppersList)
 ))
 
+struct PrinterMainNoInputShaperParams {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(PrinterMainInputShaperParams, (
+    APRINTER_AS_TYPE(DefaultType),
+    APRINTER_AS_TYPE(DefaultFrequency),
+    APRINTER_AS_TYPE(DefaultDamping)
+), (
+    static bool const Enabled = true;
+))
+
+struct PrinterMainNoPressureAdvanceParams {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(PrinterMainPressureAdvanceParams, (
+    APRINTER_AS_TYPE(DefaultK),
+    APRINTER_AS_TYPE(DefaultSmoothTime)
+), (
+    static bool const Enabled = true;
+))
+
 APRINTER_ALIAS_STRUCT(PrinterMainSlaveStepperParams, (
     APRINTER_AS_TYPE(TheStepperDef)
 ))
@@ -147,6 +178,26 @@ APRINTER_ALIAS_STRUCT_EXT(PrinterMainTransformParams, (
     static bool const Enabled = true;
 ))
 
+struct PrinterMainNoArcParams {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(PrinterMainArcParams, (
+    APRINTER_AS_TYPE(ChordTolerance)
+), (
+    static bool const Enabled = true;
+))
+
+struct PrinterMainNoJunctionDeviationParams {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(PrinterMainJunctionDeviationParams, (
+    APRINTER_AS_TYPE(DefaultDeviation)
+), (
+    static bool const Enabled = true;
+))
+
 APRINTER_ALIAS_STRUCT(PrinterMainVirtualAxisParams, (
     APRINTER_AS_VALUE(char, Name),
     APRINTER_AS_TYPE(MinPos),
@@ -223,6 +274,8 @@ private:
     using ParamsAxesList = typename Params::AxesList;
     using ParamsLasersList = typename Params::LasersList;
     using TransformParams = typename Params::TransformParams;
+    using ArcParams = typename Params::ArcParams;
+    using JunctionDeviationParams = typename Params::JunctionDeviationParams;
     using ParamsModulesList = typename Params::ModulesList;
     
     using TheDebugObject = DebugObject<Context, Object>;
@@ -315,7 +368,7 @@ public:
     class CommandStreamCallback {
     public:
         virtual bool start_command_impl (Context c) { return true; }
-        virtual void finish_command_impl (Context c) = 0;
+        virtual void finish_command_impl (Context c, bool no_ok) = 0;
         virtual void reply_poke_impl (Context c, bool push) = 0;
         virtual void reply_append_buffer_impl (Context c, char const *str, size_t length) = 0;
 #if AMBRO_HAS_NONTRANSPARENT_PROGMEM
@@ -541,7 +594,7 @@ public:
             }
             m_callback->reply_poke_impl(c, true);
             
-            m_callback->finish_command_impl(c);
+            m_callback->finish_command_impl(c, no_ok);
             m_cmd = nullptr;
             if (m_state == COMMAND_LOCKED) {
                 AMBRO_ASSERT(mo->locked)
@@ -1064,6 +1117,7 @@ private:
         using DistConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()));
         using SpeedConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()) / TimeConversion());
         using AccelConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()) / (TimeConversion() * TimeConversion()));
+        using JerkConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()) / (TimeConversion() * TimeConversion() * TimeConversion()));
         
         using AbsStepFixedTypeMin = APRINTER_FP_CONST_EXPR(AbsStepFixedType::minValue().fpValueConstexpr());
         using AbsStepFixedTypeMax = APRINTER_FP_CONST_EXPR(AbsStepFixedType::maxValue().fpValueConstexpr());
@@ -1077,6 +1131,33 @@ private:
         template <typename ThePrinterMain=PrinterMain>
         static constexpr typename ThePrinterMain::PhysVirtAxisMaskType AxisMask () { return (PhysVirtAxisMaskType)1 << AxisIndex; }
         
+        AMBRO_STRUCT_IF(InputShaperHelper, AxisSpec::InputShaper::Enabled) {
+            using ShaperSpec = typename AxisSpec::InputShaper;
+            using PlannerInputShaper = MotionPlannerInputShaper<
+                decltype(Config::e(ShaperSpec::DefaultType::i())),
+                decltype(Config::e(ShaperSpec::DefaultFrequency::i())),
+                decltype(Config::e(ShaperSpec::DefaultDamping::i()))
+            >;
+        } AMBRO_STRUCT_ELSE(InputShaperHelper) {
+            using PlannerInputShaper = MotionPlannerNoInputShaper;
+        };
+        
+        AMBRO_STRUCT_IF(PressureAdvanceHelper, AxisSpec::PressureAdvance::Enabled) {
+            using AdvanceSpec = typename AxisSpec::PressureAdvance;
+            using PlannerPressureAdvance = MotionPlannerPressureAdvance<
+                decltype(Config::e(AdvanceSpec::DefaultK::i())),
+                decltype(Config::e(AdvanceSpec::DefaultSmoothTime::i()))
+            >;
+        } AMBRO_STRUCT_ELSE(PressureAdvanceHelper) {
+            using PlannerPressureAdvance = MotionPlannerNoPressureAdvance;
+        };
+        
+        AMBRO_STRUCT_IF(JerkHelper, Params::JerkLimitEnabled) {
+            using PlannerMaxJerkRec = decltype(ExprRec(Config::e(AxisSpec::DefaultMaxJerk::i()) * JerkConversion()));
+        } AMBRO_STRUCT_ELSE(JerkHelper) {
+            using PlannerMaxJerkRec = APRINTER_FP_CONST_EXPR(0.0); // jerk limiting is not enabled
+        };
+        
         struct PlannerPrestepCallback;
         struct PlannerAxisSpec : public MotionPlannerAxisSpec<
             TheAxisDriver,
@@ -1085,6 +1166,10 @@ private:
             decltype(Config::e(AxisSpec::DefaultCorneringDistance::i())),
             PlannerMaxSpeedRec,
             PlannerMaxAccelRec,
+            typename JerkHelper::PlannerMaxJerkRec,
+            DistConversion,
+            typename InputShaperHelper::PlannerInputShaper,
+            typename PressureAdvanceHelper::PlannerPressureAdvance,
             PlannerPrestepCallback
         > {};
         
@@ -1556,6 +1641,23 @@ public:
             template <int Index> void set (FpType x) { m_arr[Index] = x; }
         };
         
+        // Split positions are transformed in batches of this size, see
+        // TransformBatch.h.
+        static int const SplitBatchSize = 4;
+        
+        struct SplitBatch {
+            FpType (*m_virt)[SplitBatchSize];
+            FpType (*m_phys)[SplitBatchSize];
+            template <int Index> FpType const * virt () { return m_virt[Index]; }
+            template <int Index> FpType * phys () { return m_phys[Index]; }
+        };
+        
+        struct SplitBatchPointDst {
+            FpType (*m_virt)[SplitBatchSize];
+            int m_index;
+            template <int Index> void set (FpType x) { m_virt[Index][m_index] = x; }
+        };
+        
         static void init (Context c)
         {
             auto *o = Object::self(c);
@@ -1576,16 +1678,21 @@ public:
             }
         }
         
-        static bool update_phys_from_virt (Context c, bool ignore_phys_limits=false)
+        template <typename Src, typename Dst>
+        static bool transform_virt_to_phys (Context c, Src src, Dst dst)
         {
-            bool success;
             if (TheCorrectionService::CorrectionEnabled) {
                 FpType temp_virt_pos[NumVirtAxes];
-                TheCorrectionService::do_correction(c, VirtReqPosSrc{c}, ArrayDst{temp_virt_pos}, WrapBool<false>());
-                success = TheTransformAlg::virtToPhys(c, ArraySrc{temp_virt_pos}, PhysReqPosDst{c});
+                TheCorrectionService::do_correction(c, src, ArrayDst{temp_virt_pos}, WrapBool<false>());
+                return TheTransformAlg::virtToPhys(c, ArraySrc{temp_virt_pos}, dst);
             } else {
-                success = TheTransformAlg::virtToPhys(c, VirtReqPosSrc{c}, PhysReqPosDst{c});
+                return TheTransformAlg::virtToPhys(c, src, dst);
             }
+        }
+        
+        static bool update_phys_from_virt (Context c, bool ignore_phys_limits=false)
+        {
+            bool success = transform_virt_to_phys(c, VirtReqPosSrc{c}, PhysReqPosDst{c});
             if (success && !ignore_phys_limits) {
                 success = ListForBreak<VirtAxesList>([&] APRINTER_TL(axis, return axis::check_phys_limits(c)));
             }
@@ -1631,6 +1738,9 @@ public:
             
             o->splitter.start(c, distance, base_max_v_rec, time_freq_by_max_speed);
             o->frac = 0.0f;
+            o->batch_pos = 0;
+            o->batch_count = 0;
+            ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::init_split_start_phys(c)));
             
             return do_split(c);
         }
@@ -1685,6 +1795,70 @@ public:
             return o->splitting;
         }
         
+        // Transforms the split positions at the first count fractions of the
+        // batch in one call, returning for how many of them this succeeded.
+        static int transform_split_batch (Context c, int count)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(count <= SplitBatchSize)
+            
+            FpType virt[NumVirtAxes][SplitBatchSize];
+            for (int i = 0; i < count; i++) {
+                if (TheCorrectionService::CorrectionEnabled) {
+                    FpType pos[NumVirtAxes];
+                    ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::compute_split_pos(c, o->batch_frac[i], ArrayDst{pos})));
+                    TheCorrectionService::do_correction(c, ArraySrc{pos}, SplitBatchPointDst{virt, i}, WrapBool<false>());
+                } else {
+                    ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::compute_split_pos(c, o->batch_frac[i], SplitBatchPointDst{virt, i})));
+                }
+            }
+            
+            o->batch_pos = 0;
+            o->batch_count = TheTransformAlg::virtToPhysBatch(c, SplitBatch{virt, o->batch_phys}, count);
+            return o->batch_count;
+        }
+        
+        // Returns the batch index of the transformed split position at
+        // o->frac, or -1 if it cannot be transformed. A new batch is started
+        // with the fractions of the following pieces as far as the splitter
+        // knows them.
+        static int get_split_batch_index (Context c)
+        {
+            auto *o = Object::self(c);
+            
+            if (!(o->batch_pos < o->batch_count && o->batch_frac[o->batch_pos] == o->frac)) {
+                o->batch_frac[0] = o->frac;
+                int count = 1 + o->splitter.peek(c, o->batch_frac + 1, SplitBatchSize - 1);
+                if (transform_split_batch(c, count) == 0) {
+                    return -1;
+                }
+            }
+            return o->batch_pos++;
+        }
+        
+        // Deviation of the piece from frac0 to frac1 from the true path, for
+        // splitters which choose piece lengths adaptively. The end position is
+        // left in the batch so that do_split need not transform it again.
+        // Transform errors are left to do_split to report.
+        static FpType split_deviation (Context c, FpType frac0, FpType frac1)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(frac0 == o->frac)
+            
+            o->batch_frac[0] = frac1;
+            o->batch_frac[1] = 0.5f * (frac0 + frac1);
+            if (transform_split_batch(c, 2) < 2) {
+                return 0.0f;
+            }
+            
+            FpType deviation_squared = 0.0f;
+            for (int i = 0; i < NumVirtAxes; i++) {
+                FpType d = o->batch_phys[i][1] - 0.5f * (o->split_start_phys[i] + o->batch_phys[i][0]);
+                deviation_squared += d * d;
+            }
+            return FloatSqrt(deviation_squared);
+        }
+        
         static void do_split (Context c)
         {
             auto *o = Object::self(c);
@@ -1697,14 +1871,19 @@ public:
             FpType rel_max_v_rec;
             FpType saved_phys_req_pos[NumAxes];
             
-            if (o->splitter.pull(c, &rel_max_v_rec, &o->frac)) {
+            auto deviation = [&](FpType frac0, FpType frac1) { return split_deviation(c, frac0, frac1); };
+            
+            if (o->splitter.pull(c, &rel_max_v_rec, &o->frac, deviation)) {
                 ListFor<AxesList>([&] APRINTER_TL(axis, axis::save_req_pos(c, saved_phys_req_pos)));
                 
-                FpType saved_virt_req_pos[NumVirtAxes];
-                ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::save_req_pos(c, saved_virt_req_pos)));
-                ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::compute_split(c, o->frac)));
-                bool transform_success = update_phys_from_virt(c, o->ignore_phys_limits);
-                ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::restore_req_pos(c, saved_virt_req_pos)));
+                int batch_index = get_split_batch_index(c);
+                bool transform_success = (batch_index >= 0);
+                if (transform_success) {
+                    ListFor<VirtAxesList>([&] APRINTER_TL(axis, axis::set_split_phys(c, batch_index)));
+                    if (!o->ignore_phys_limits) {
+                        transform_success = ListForBreak<VirtAxesList>([&] APRINTER_TL(axis, return axis::check_phys_limits(c)));
+                    }
+                }
                 
                 if (!transform_success) {
                     // Compute actual positions based on prev_frac.
@@ -1836,22 +2015,32 @@ public:
                 *distance_squared += o->m_delta * o->m_delta;
             }
             
-            static void save_req_pos (Context c, FpType *data)
+            static void compute_split (Context c, FpType frac)
             {
                 auto *o = Object::self(c);
-                data[VirtAxisIndex] = o->m_req_pos;
+                o->m_req_pos = o->m_old_pos + (frac * o->m_delta);
             }
             
-            static void restore_req_pos (Context c, FpType const *data)
+            template <typename Dst>
+            static void compute_split_pos (Context c, FpType frac, Dst dst)
             {
                 auto *o = Object::self(c);
-                o->m_req_pos = data[VirtAxisIndex];
+                dst.template set<VirtAxisIndex>(o->m_old_pos + (frac * o->m_delta));
             }
             
-            static void compute_split (Context c, FpType frac)
+            static void init_split_start_phys (Context c)
             {
-                auto *o = Object::self(c);
-                o->m_req_pos = o->m_old_pos + (frac * o->m_delta);
+                auto *t = TransformFeature::Object::self(c);
+                auto *axis = ThePhysAxis::Object::self(c);
+                t->split_start_phys[VirtAxisIndex] = axis->m_old_pos;
+            }
+            
+            static void set_split_phys (Context c, int batch_index)
+            {
+                auto *t = TransformFeature::Object::self(c);
+                auto *axis = ThePhysAxis::Object::self(c);
+                axis->m_req_pos = t->batch_phys[VirtAxisIndex][batch_index];
+                t->split_start_phys[VirtAxisIndex] = axis->m_req_pos;
             }
             
             static FpType limit_virt_axis_speed (FpType accum, Context c)
@@ -1937,6 +2126,11 @@ public:
             bool splitting;
             bool ignore_phys_limits;
             FpType frac;
+            uint8_t batch_pos;
+            uint8_t batch_count;
+            FpType batch_frac[SplitBatchSize];
+            FpType batch_phys[NumVirtAxes][SplitBatchSize];
+            FpType split_start_phys[NumVirtAxes];
             TheSplitter splitter;
             TheCommand *move_err_output;
             MoveEndCallback move_end_callback;
@@ -2046,6 +2240,36 @@ public:
             return true;
         }
         
+        static void init_arc_pos (Context c, FpType *start_pos, FpType *end_pos)
+        {
+            auto *axis = TheAxis::Object::self(c);
+            start_pos[PhysVirtAxisIndex] = axis->m_req_pos;
+            end_pos[PhysVirtAxisIndex] = axis->m_req_pos;
+        }
+        
+        static bool collect_arc_end_pos (Context c, TheCommand *cmd, CommandPartRef part, PhysVirtAxisMaskType axis_relative, FpType *end_pos, PhysVirtAxisMaskType *axes)
+        {
+            auto *axis = TheAxis::Object::self(c);
+            
+            if (AMBRO_UNLIKELY(cmd->getPartCode(c, part) == TheAxis::AxisName)) {
+                FpType req = cmd->getPartFpValue(c, part);
+                if ((axis_relative & AxisMask)) {
+                    req += axis->m_req_pos;
+                }
+                end_pos[PhysVirtAxisIndex] = req;
+                *axes |= AxisMask;
+                return false;
+            }
+            return true;
+        }
+        
+        static void add_arc_axis (Context c, FpType const *pos, PhysVirtAxisMaskType axes)
+        {
+            if ((axes & AxisMask)) {
+                move_add_axis<PhysVirtAxisIndex>(c, pos[PhysVirtAxisIndex]);
+            }
+        }
+        
         static void set_relative_positioning (Context c, bool relative, bool extruders_only)
         {
             auto *mo = PrinterMain::Object::self(c);
@@ -2108,6 +2332,201 @@ public:
     template <char AxisName>
     using GetPhysVirtAxisByName = PhysVirtAxisHelper<FindPhysVirtAxis<AxisName>::Value>;
     
+private:
+    AMBRO_STRUCT_IF(ArcFeature, ArcParams::Enabled) {
+        friend PrinterMain;
+        
+    public:
+        struct Object;
+        
+    private:
+        template <char AxisName>
+        using HasPhysVirtAxis = WrapBool<TypeListFindMapped<PhysVirtAxisHelperList, GetMemberType_WrappedAxisName, WrapInt<AxisName>>::Found>;
+        static_assert(HasPhysVirtAxis<'X'>::Value && HasPhysVirtAxis<'Y'>::Value, "Arc moves require X and Y axes.");
+        
+        static int const ArcAxisX = FindPhysVirtAxis<'X'>::Value;
+        static int const ArcAxisY = FindPhysVirtAxis<'Y'>::Value;
+        static uint16_t const MaxChords = UINT16_MAX;
+        
+        static void init (Context c)
+        {
+            auto *o = Object::self(c);
+            o->active = false;
+        }
+        
+        static bool is_active (Context c)
+        {
+            auto *o = Object::self(c);
+            return o->active;
+        }
+        
+        static void start_arc (Context c, TheCommand *cmd, bool clockwise)
+        {
+            auto *o = Object::self(c);
+            auto *mob = PrinterMain::Object::self(c);
+            AMBRO_ASSERT(!o->active)
+            
+            ListFor<PhysVirtAxisHelperList>([&] APRINTER_TL(axis, axis::init_arc_pos(c, o->start_pos, o->end_pos)));
+            o->axes = PhysVirtAxisHelper<ArcAxisX>::AxisMask | PhysVirtAxisHelper<ArcAxisY>::AxisMask;
+            
+            FpType offset_i = 0.0f;
+            FpType offset_j = 0.0f;
+            FpType radius = 0.0f;
+            bool have_offset = false;
+            bool have_radius = false;
+            
+            for (auto i : LoopRangeAuto(cmd->getNumParts(c))) {
+                CommandPartRef part = cmd->getPart(c, i);
+                
+                if (!ListForBreak<PhysVirtAxisHelperList>([&] APRINTER_TL(axis, return axis::collect_arc_end_pos(c, cmd, part, mob->axis_relative, o->end_pos, &o->axes)))) {
+                    continue;
+                }
+                
+                char code = cmd->getPartCode(c, part);
+                if (code == 'F') {
+                    mob->time_freq_by_max_speed = (FpType)(TimeConversion::value() / Params::SpeedLimitMultiply::value()) / FloatMakePosOrPosZero(cmd->getPartFpValue(c, part));
+                }
+                else if (code == 'I') {
+                    offset_i = cmd->getPartFpValue(c, part);
+                    have_offset = true;
+                }
+                else if (code == 'J') {
+                    offset_j = cmd->getPartFpValue(c, part);
+                    have_offset = true;
+                }
+                else if (code == 'R') {
+                    radius = cmd->getPartFpValue(c, part);
+                    have_radius = true;
+                }
+            }
+            
+            FpType start_x = o->start_pos[ArcAxisX];
+            FpType start_y = o->start_pos[ArcAxisY];
+            FpType dx = o->end_pos[ArcAxisX] - start_x;
+            FpType dy = o->end_pos[ArcAxisY] - start_y;
+            
+            if (!have_offset) {
+                // Radius form, the center lies on the perpendicular bisector of the
+                // chord, on the side determined by the direction and the sign of R.
+                FpType chord_squared = dx * dx + dy * dy;
+                if (!have_radius || chord_squared == 0.0f) {
+                    return arc_error(c, cmd);
+                }
+                FpType h = FloatSqrt(FloatMakePosOrPosZero((4.0f * radius * radius) / chord_squared - 1.0f));
+                if (clockwise != (radius < 0.0f)) {
+                    h = -h;
+                }
+                offset_i = 0.5f * (dx - dy * h);
+                offset_j = 0.5f * (dy + dx * h);
+            }
+            
+            o->radius = FloatSqrt(offset_i * offset_i + offset_j * offset_j);
+            if (!(o->radius > 0.0f)) {
+                return arc_error(c, cmd);
+            }
+            o->center_x = start_x + offset_i;
+            o->center_y = start_y + offset_j;
+            o->start_angle = FloatAtan2(-offset_j, -offset_i);
+            
+            FpType end_angle = FloatAtan2(o->end_pos[ArcAxisY] - o->center_y, o->end_pos[ArcAxisX] - o->center_x);
+            FpType sweep = end_angle - o->start_angle;
+            if (clockwise) {
+                if (sweep >= 0.0f) {
+                    sweep -= (FpType)(2.0 * M_PI);
+                }
+            } else {
+                if (sweep <= 0.0f) {
+                    sweep += (FpType)(2.0 * M_PI);
+                }
+            }
+            o->sweep = sweep;
+            
+            // Choose the number of chords so that no chord deviates from the
+            // arc by more than the chord tolerance.
+            FpType cos_half_angle = FloatMakePosOrPosZero(1.0f - APRINTER_CFG(Config, CChordTolerance, c) / o->radius);
+            FpType max_chord_angle = 2.0f * FloatAcos(cos_half_angle);
+            FpType num_chords = FloatCeil(FloatAbs(sweep) / max_chord_angle);
+            o->num_chords = !(num_chords < (FpType)MaxChords) ? MaxChords : MaxValue((uint16_t)1, (uint16_t)num_chords);
+            o->chord_pos = 0;
+            o->active = true;
+            
+            return do_chord(c);
+        }
+        
+        static void do_chord (Context c)
+        {
+            auto *o = Object::self(c);
+            auto *mob = PrinterMain::Object::self(c);
+            AMBRO_ASSERT(o->active)
+            AMBRO_ASSERT(o->chord_pos < o->num_chords)
+            
+            o->chord_pos++;
+            
+            FpType pos[NumPhysVirtAxes];
+            if (o->chord_pos == o->num_chords) {
+                for (int i = 0; i < NumPhysVirtAxes; i++) {
+                    pos[i] = o->end_pos[i];
+                }
+            } else {
+                FpType frac = (FpType)o->chord_pos / o->num_chords;
+                for (int i = 0; i < NumPhysVirtAxes; i++) {
+                    pos[i] = o->start_pos[i] + frac * (o->end_pos[i] - o->start_pos[i]);
+                }
+                FpType angle = o->start_angle + frac * o->sweep;
+                pos[ArcAxisX] = o->center_x + o->radius * FloatCos(angle);
+                pos[ArcAxisY] = o->center_y + o->radius * FloatSin(angle);
+            }
+            
+            move_begin(c);
+            ListFor<PhysVirtAxisHelperList>([&] APRINTER_TL(axis, axis::add_arc_axis(c, pos, o->axes)));
+            move_set_max_speed_opt(c, mob->time_freq_by_max_speed);
+            return move_end(c, get_locked(c), ArcFeature::chord_end_callback, false);
+        }
+        
+        static void chord_end_callback (Context c, bool error)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(o->active)
+            
+            // Further chords are submitted from the planner pull handler.
+            if (error || o->chord_pos == o->num_chords) {
+                o->active = false;
+                return normal_move_end_callback(c, error);
+            }
+        }
+        
+        static void arc_error (Context c, TheCommand *cmd)
+        {
+            cmd->reportError(c, AMBRO_PSTR("BadArc"));
+            return cmd->finishCommand(c);
+        }
+        
+    public:
+        using CChordTolerance = decltype(ExprCast<FpType>(Config::e(ArcParams::ChordTolerance::i())));
+        
+        using ConfigExprs = MakeTypeList<CChordTolerance>;
+        
+        struct Object : public ObjBase<ArcFeature, typename PrinterMain::Object, EmptyTypeList> {
+            FpType start_pos[NumPhysVirtAxes];
+            FpType end_pos[NumPhysVirtAxes];
+            FpType center_x;
+            FpType center_y;
+            FpType radius;
+            FpType start_angle;
+            FpType sweep;
+            uint16_t num_chords;
+            uint16_t chord_pos;
+            PhysVirtAxisMaskType axes;
+            bool active;
+        };
+    } AMBRO_STRUCT_ELSE(ArcFeature) {
+        static void init (Context c) {}
+        static bool is_active (Context c) { return false; }
+        static void start_arc (Context c, TheCommand *cmd, bool clockwise) {}
+        static void do_chord (Context c) {}
+        struct Object {};
+    };
+    
 private:
     using MotionPlannerChannelsDict = ListCollect<ModuleClassesList, MemberType_MotionPlannerChannels>;
     
@@ -2115,12 +2534,27 @@ private:
     using MotionPlannerAxes = MapTypeList<AxesList, GetMemberType_PlannerAxisSpec>;
     using MotionPlannerLasers = MapTypeList<LasersList, GetMemberType_PlannerLaserSpec>;
     
+    AMBRO_STRUCT_IF(JunctionDeviationHelper, JunctionDeviationParams::Enabled) {
+        // Junctions are computed in the space of the non-extruder axes.
+        template <typename TheAxis, typename AccumMask>
+        using CartesianAxesMaskFoldFunc = WrapValue<uint32_t, (AccumMask::Value | (TheAxis::IsExtruder ? 0 : ((uint32_t)1 << TheAxis::AxisIndex)))>;
+        using CartesianAxesMask = TypeListFold<AxesList, WrapValue<uint32_t, 0>, CartesianAxesMaskFoldFunc>;
+        
+        using PlannerJunctionDeviation = MotionPlannerJunctionDeviation<
+            decltype(Config::e(JunctionDeviationParams::DefaultDeviation::i())),
+            CartesianAxesMask::Value
+        >;
+    } AMBRO_STRUCT_ELSE(JunctionDeviationHelper) {
+        using PlannerJunctionDeviation = MotionPlannerNoJunctionDeviation;
+    };
+    
 public:
     APRINTER_MAKE_INSTANCE(ThePlanner, (MotionPlannerArg<
         Context, typename PlannerUnionPlanner::Object, Config, MotionPlannerAxes, Params::StepperSegmentBufferSize,
-        Params::LookaheadBufferSize, Params::LookaheadCommitCount, FpType, MaxStepsPerCycle,
+        Params::LookaheadBufferSize, Params::LookaheadCommitCount, Params::MinLookaheadCommitCount, FpType, typename Params::PlannerFpType, MaxStepsPerCycle,
         PlannerPullHandler, PlannerFinishedHandler, PlannerAbortedHandler, PlannerUnderrunCallback,
-        MotionPlannerChannels, MotionPlannerLasers
+        MotionPlannerChannels, MotionPlannerLasers, Params::JerkLimitEnabled,
+        typename JunctionDeviationHelper::PlannerJunctionDeviation
     >))
     using PlannerSplitBuffer = typename ThePlanner::SplitBuffer;
     
@@ -2242,11 +2676,15 @@ public:
         ListFor<AxesList>([&] APRINTER_TL(axis, axis::init(c)));
         ListFor<LasersList>([&] APRINTER_TL(laser, laser::init(c)));
         TransformFeature::init(c);
+        ArcFeature::init(c);
         ob->time_freq_by_max_speed = 0.0f;
         ob->speed_ratio_rec = 1.0f;
         ob->locked = false;
         ob->active = false;
         ob->planner_state = PLANNER_NONE;
+#ifdef MOTIONPLANNER_METRICS
+        ThePlanner::resetMetrics(c);
+#endif
         TheHookExecutor::init(c);
         ListFor<ModulesList>([&] APRINTER_TL(module, module::init(c)));
         
@@ -2287,6 +2725,9 @@ public:
     template <int AxisIndex>
     using GetAxisTimer = typename Axis<AxisIndex>::TheAxisDriver::GetTimer;
     
+    template <int AxisIndex>
+    using GetAxisDriver = typename Axis<AxisIndex>::TheAxisDriver;
+    
     template <int LaserIndex>
     using GetLaserDriver = typename ThePlanner::template Laser<LaserIndex>::TheLaserDriver;
     
@@ -2325,6 +2766,18 @@ public:
         output->reply_poke(c);
     }
     
+    // Returns the duration of the motion which has been committed to the
+    // steppers but not executed yet, zero when the planner is not active.
+    static TimeType get_committed_time_ahead (Context c)
+    {
+        auto *ob = Object::self(c);
+        
+        if (ob->planner_state == PLANNER_NONE) {
+            return 0;
+        }
+        return ThePlanner::getCommittedTimeAhead(c);
+    }
+    
 private:
     static void blinker_handler (Context c)
     {
@@ -2417,6 +2870,10 @@ private:
                     if (cmd->find_command_param(c, 'S', &part)) {
                         FpType ratio_rec = FloatMakePosOrPosZero(100.0f / cmd->getPartFpValue(c, part));
                         ratio_rec = FloatMin((FpType)(1.0f/SpeedRatioMin()), FloatMax((FpType)(1.0f/SpeedRatioMax()), ratio_rec));
+                        if (ob->planner_state != PLANNER_NONE && ob->planner_state != PLANNER_CUSTOM) {
+                            // Apply the new ratio to the moves which are already queued.
+                            ThePlanner::scaleFeedTime(c, ratio_rec / ob->speed_ratio_rec);
+                        }
                         ob->speed_ratio_rec = ratio_rec;
                     } else {
                         cmd->reply_append_pstr(c, AMBRO_PSTR("Speed factor override: "));
@@ -2531,6 +2988,17 @@ private:
                     return move_end(c, get_locked(c), PrinterMain::normal_move_end_callback, is_rapid_move);
                 } break;
                 
+                case 2:   // clockwise arc
+                case 3: { // counter-clockwise arc
+                    if (!ArcParams::Enabled) {
+                        goto unknown_command;
+                    }
+                    if (!cmd->tryPlannedCommand(c)) {
+                        return;
+                    }
+                    return ArcFeature::start_arc(c, cmd, (cmd_number == 2));
+                } break;
+                
                 case 28: { // home axes
                     if (!cmd->tryUnplannedCommand(c)) {
                         return;
@@ -2716,6 +3184,9 @@ private:
         if (TransformFeature::is_splitting(c)) {
             return TransformFeature::do_split(c);
         }
+        if (ArcFeature::is_active(c)) {
+            return ArcFeature::do_chord(c);
+        }
         if (ob->planner_state == PLANNER_STOPPING) {
             ThePlanner::waitFinished(c);
         } else if (ob->planner_state == PLANNER_WAITING) {
@@ -2980,6 +3451,12 @@ public:
     }
     
 public:
+    static bool planner_is_active (Context c)
+    {
+        auto *ob = Object::self(c);
+        return ob->planner_state != PLANNER_NONE;
+    }
+    
     template <typename TheJsonBuilder>
     static void get_json_status (Context c, TheJsonBuilder *json)
     {
@@ -2994,6 +3471,27 @@ public:
         ListFor<PhysVirtAxisHelperList>([&] APRINTER_TL(axis, axis::get_json_status(c, json)));
         json->endObject();
         
+#ifdef MOTIONPLANNER_METRICS
+        auto const *metrics = ThePlanner::getMetrics(c);
+        uint32_t plan_count = metrics->plan_count;
+        bool planner_active = planner_is_active(c);
+        json->addKeyObject(JsonSafeString{"planner"});
+        json->addSafeKeyVal("bufferSize", JsonUint32{Params::LookaheadBufferSize});
+        json->addSafeKeyVal("fill", JsonUint32{planner_active ? ThePlanner::getBufferFill(c) : (uint32_t)0});
+        json->addSafeKeyVal("minFill", JsonUint32{metrics->min_fill});
+        json->addSafeKeyVal("commitCount", JsonUint32{planner_active ? ThePlanner::getCommitCount(c) : (uint32_t)0});
+        json->addSafeKeyVal("plans", JsonUint32{plan_count});
+        json->addSafeKeyVal("tickFreq", JsonDouble{Clock::time_freq});
+        json->addSafeKeyVal("planTicksMin", JsonUint32{(plan_count == 0) ? 0 : (uint32_t)metrics->plan_time_min});
+        json->addSafeKeyVal("planTicksAvg", JsonUint32{(plan_count == 0) ? 0 : (uint32_t)(metrics->plan_time_sum / plan_count)});
+        json->addSafeKeyVal("planTicksMax", JsonUint32{(uint32_t)metrics->plan_time_max});
+        json->addSafeKeyVal("commits", JsonUint32{metrics->commit_count});
+        json->addSafeKeyVal("commitFails", JsonUint32{metrics->commit_fail_count});
+        json->addSafeKeyVal("underruns", JsonUint32{metrics->underrun_count});
+        json->addSafeKeyVal("splits", JsonUint32{metrics->split_count});
+        json->endObject();
+#endif
+        
         ListFor<ModulesList>([&] APRINTER_TL(module, module::get_json_status(c, json)));
     }
     
@@ -3071,6 +3569,7 @@ private:
                     MakeTypeList<
                         TheSteppers,
                         TransformFeature,
+                        ArcFeature,
                         PlannerUnion
                     >
                 >,
@@ -3092,6 +3591,7 @@ public:
             TheBlinker,
             TheSteppers,
             TransformFeature,
+            ArcFeature,
             PlannerUnion,
             TheHookExecutor
         >
@@ -26,6 +26,7 @@
 #define AMBROLIB_AXIS_DRIVER_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include <aprinter/meta/FixedPoint.h>
 #include <aprinter/meta/WrapFunction.h>
@@ -35,14 +36,23 @@
 #include <aprinter/meta/StructIf.h>
 #include <aprinter/meta/ConstexprMath.h>
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/ChooseInt.h>
+#include <aprinter/meta/BitsInInt.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/math/StoredNumber.h>
 #include <aprinter/base/DebugObject.h>
 #include <aprinter/base/Assert.h>
 #include <aprinter/base/Hints.h>
 #include <aprinter/misc/ClockUtils.h>
+#include <aprinter/system/InterruptLock.h>
 #include <aprinter/printer/actuators/AxisDriverConsumer.h>
 
+#ifdef AXISDRIVER_STEP_TRACE
+#ifndef AXISDRIVER_STEP_TRACE_SIZE
+#define AXISDRIVER_STEP_TRACE_SIZE 128
+#endif
+#endif
+
 namespace APrinter {
 
 #define AXIS_STEPPER_AMUL_EXPR(x, t, a) ((a).template shiftBits<(-amul_shift)>())
@@ -106,6 +116,7 @@ public:
     using AMulType = decltype(AXIS_STEPPER_AMUL_EXPR_HELPER(AXIS_STEPPER_DUMMY_VARS));
     using ADiscShiftedType = decltype(AccelFixedType().template shiftBits<(-discriminant_prec)>());
     using DelayParams = typename Params::DelayParams;
+    using BurstParams = typename Params::BurstParams;
     using StepContext = typename TimerInstance::HandlerContext;
     
 private:
@@ -203,6 +214,12 @@ public:
 #ifdef AXISDRIVER_DETECT_OVERLOAD
         o->m_overload = false;
 #endif
+#ifdef AXISDRIVER_STEP_TRACE
+        o->m_trace_start = 0;
+        o->m_trace_end = 0;
+        o->m_trace_dropped = 0;
+        o->m_trace_dir = false;
+#endif
         
         TheDebugObject::init(c);
     }
@@ -295,6 +312,58 @@ public:
     }
 #endif
     
+#ifdef AXISDRIVER_STEP_TRACE
+    // Step trace entries record the time of each step and direction change.
+    // The flags hold StepTraceFlagStep for steps (zero for direction changes)
+    // and StepTraceFlagDir for the direction in effect after the event.
+    static int const StepTraceSize = AXISDRIVER_STEP_TRACE_SIZE;
+    static uint8_t const StepTraceFlagStep = 1 << 0;
+    static uint8_t const StepTraceFlagDir = 1 << 1;
+    
+    struct StepTraceEntry {
+        TimeType time;
+        uint8_t flags;
+    };
+    
+    static size_t readStepTrace (Context c, StepTraceEntry *out_entries, size_t max_entries)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        StepTraceIndexType start = o->m_trace_start;
+        StepTraceIndexType end;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            end = o->m_trace_end;
+        }
+        
+        size_t count = 0;
+        while (start != end && count < max_entries) {
+            out_entries[count++] = o->m_trace_buffer[start];
+            start = step_trace_next(start);
+        }
+        
+        // Only now release the entries to the interrupt.
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            o->m_trace_start = start;
+        }
+        
+        return count;
+    }
+    
+    static uint32_t takeStepTraceDropped (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        uint32_t dropped;
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            dropped = o->m_trace_dropped;
+            o->m_trace_dropped = 0;
+        }
+        return dropped;
+    }
+#endif
+    
     using GetTimer = TimerInstance;
     
 private:
@@ -320,6 +389,52 @@ private:
     template <typename This=AxisDriver>
     using CallbackHelperList = IndexElemList<typename This::ConsumersList::List, CallbackHelper>;
     
+#ifdef AXISDRIVER_STEP_TRACE
+    using StepTraceIndexType = ChooseInt<BitsInInt<StepTraceSize>::Value, false>;
+    
+    static StepTraceIndexType step_trace_next (StepTraceIndexType index)
+    {
+        return (index == StepTraceSize - 1) ? 0 : (index + 1);
+    }
+    
+    // Single producer: called from the timer interrupt, or from start() when
+    // the interrupt is not active. When the buffer is full the event is dropped.
+    template <typename ThisContext>
+    static void step_trace_record (ThisContext c, uint8_t flags)
+    {
+        auto *o = Object::self(c);
+        
+        StepTraceIndexType end = o->m_trace_end;
+        StepTraceIndexType next = step_trace_next(end);
+        if (AMBRO_UNLIKELY(next == o->m_trace_start)) {
+            o->m_trace_dropped++;
+            return;
+        }
+        o->m_trace_buffer[end].time = Clock::getTime(c);
+        o->m_trace_buffer[end].flags = flags;
+        o->m_trace_end = next;
+    }
+    
+    template <typename ThisContext>
+    static void step_trace_dir (ThisContext c, bool dir)
+    {
+        auto *o = Object::self(c);
+        
+        if (dir != o->m_trace_dir) {
+            o->m_trace_dir = dir;
+            step_trace_record(c, dir ? StepTraceFlagDir : 0);
+        }
+    }
+    
+    template <typename ThisContext>
+    static void step_trace_step (ThisContext c)
+    {
+        auto *o = Object::self(c);
+        
+        step_trace_record(c, StepTraceFlagStep | (o->m_trace_dir ? StepTraceFlagDir : 0));
+    }
+#endif
+    
     template <typename T>
     inline static T volatile_read (T &x)
     {
@@ -340,6 +455,9 @@ private:
         
         Stepper::setDir(c, command->dir_x.bitsValue()  & ((DirStepIntType)1 << step_bits));
         DelayFeature::set_dir_timer_for_step(c);
+#ifdef AXISDRIVER_STEP_TRACE
+        step_trace_dir(c, command->dir_x.bitsValue() & ((DirStepIntType)1 << step_bits));
+#endif
         
         // Below we do some volatile memory accesses, to guarantee that at least some
         // calculations are done after the setDir(). We want the new direction signal
@@ -401,6 +519,25 @@ private:
         }
 #endif
         
+        TimeType next_time;
+        uint8_t burst_steps = 0;
+        
+        do {
+            if (!handle_step(c, &next_time)) {
+                return false;
+            }
+        } while (BurstFeature::continue_burst(c, next_time, &burst_steps));
+        
+        TimerInstance::setNext(c, next_time);
+        return true;
+    }
+    struct TimerHandler : public AMBRO_WFUNC_TD(&AxisDriver::timer_handler) {};
+    
+    AMBRO_ALWAYS_INLINE
+    static bool handle_step (StepContext c, TimeType *out_next_time)
+    {
+        auto *o = Object::self(c);
+        
         Command *current_command = o->m_current_command;
         
         if (!PreloadCommands && AMBRO_LIKELY(!o->m_notend)) {
@@ -411,7 +548,7 @@ private:
             bool command_completed = load_command(c, current_command);
             if (command_completed) {
                 DelayFeature::wait_for_step_low(c);
-                TimerInstance::setNext(c, o->m_time);
+                *out_next_time = o->m_time;
                 return true;
             }
             
@@ -442,6 +579,9 @@ private:
             DelayFeature::wait_for_step_low(c);
             Stepper::stepOn(c);
             DelayFeature::set_step_timer_for_high(c);
+#ifdef AXISDRIVER_STEP_TRACE
+            step_trace_step(c);
+#endif
             
             // We need to ensure that the step signal is sufficiently long for the stepper driver
             // to register. To this end, we do the timely calculations in between stepOn and stepOff().
@@ -496,10 +636,51 @@ private:
             load_command(c, current_command);
         }
         
-        TimerInstance::setNext(c, next_time);
+        *out_next_time = next_time;
         return true;
     }
-    struct TimerHandler : public AMBRO_WFUNC_TD(&AxisDriver::timer_handler) {};
+    
+    // With burst mode, when the next step is due within Threshold, it is
+    // done from the same interrupt after busy-waiting for its time, instead
+    // of returning and taking another interrupt. This avoids the interrupt
+    // overhead at step rates where it would dominate. At most MaxSteps steps
+    // are done in one interrupt so that other interrupts are not held off.
+    // An already due step follows the previous one right away, so the step
+    // low time must be ensured by DelayParams.
+    AMBRO_STRUCT_IF(BurstFeature, BurstParams::Enabled) {
+        using TheClockUtils = ClockUtils<Context>;
+        
+        static_assert(BurstParams::MaxSteps >= 1, "");
+        static_assert(DelayParams::Enabled, "Burst mode requires DelayParams (minimum step low time).");
+        
+        static TimeType const ThresholdTicks = 1e-6 * BurstParams::Threshold::value() * Clock::time_freq;
+        
+        AMBRO_ALWAYS_INLINE
+        static bool continue_burst (StepContext c, TimeType next_time, uint8_t *burst_steps)
+        {
+            if (*burst_steps >= BurstParams::MaxSteps - 1) {
+                return false;
+            }
+            
+            TimeType diff = TheClockUtils::timeDifference(next_time, Clock::getTime(c));
+            if (!TheClockUtils::differenceIsNegative(diff)) {
+                if (diff > ThresholdTicks) {
+                    return false;
+                }
+                while (!TheClockUtils::timeGreaterOrEqual(Clock::getTime(c), next_time));
+            }
+            
+            (*burst_steps)++;
+            return true;
+        }
+    }
+    AMBRO_STRUCT_ELSE(BurstFeature) {
+        AMBRO_ALWAYS_INLINE
+        static bool continue_burst (StepContext c, TimeType next_time, uint8_t *burst_steps)
+        {
+            return false;
+        }
+    };
     
     AMBRO_STRUCT_IF(DelayFeature, DelayParams::Enabled) {
         using DelayClockUtils = FastClockUtils<Context>;
@@ -613,6 +794,13 @@ public:
 #endif
 #ifdef AXISDRIVER_DETECT_OVERLOAD
         bool m_overload;
+#endif
+#ifdef AXISDRIVER_STEP_TRACE
+        bool m_trace_dir;
+        StepTraceIndexType m_trace_start;
+        StepTraceIndexType m_trace_end;
+        uint32_t m_trace_dropped;
+        StepTraceEntry m_trace_buffer[StepTraceSize];
 #endif
         bool m_prestep_callback_enabled;
         bool m_notend;
@@ -640,11 +828,23 @@ APRINTER_ALIAS_STRUCT_EXT(AxisDriverDelayParams, (
     static bool const Enabled = true;
 ))
 
+struct AxisDriverNoBurstParams {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(AxisDriverBurstParams, (
+    APRINTER_AS_VALUE(uint8_t, MaxSteps),
+    APRINTER_AS_TYPE(Threshold)
+), (
+    static bool const Enabled = true;
+))
+
 APRINTER_ALIAS_STRUCT_EXT(AxisDriverService, (
     APRINTER_AS_TYPE(TimerService),
     APRINTER_AS_TYPE(PrecisionParams),
     APRINTER_AS_VALUE(bool, PreloadCommands),
-    APRINTER_AS_TYPE(DelayParams)
+    APRINTER_AS_TYPE(DelayParams),
+    APRINTER_AS_TYPE(BurstParams)
 ), (
     APRINTER_ALIAS_STRUCT_EXT(Driver, (
         APRINTER_AS_TYPE(Context),
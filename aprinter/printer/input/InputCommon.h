@@ -33,7 +33,8 @@ APRINTER_ALIAS_STRUCT(InputClientParams, (
     APRINTER_AS_TYPE(ThePrinterMain),
     APRINTER_AS_TYPE(ReadHandler),
     APRINTER_AS_TYPE(ClearBufferHandler),
-    APRINTER_AS_TYPE(StartHandler)
+    APRINTER_AS_TYPE(StartHandler),
+    APRINTER_AS_TYPE(PrescanHandler)
 ))
 
 }
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef AMBROLIB_LZ_DECOMPRESS_INPUT_H
+#define AMBROLIB_LZ_DECOMPRESS_INPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <aprinter/meta/WrapFunction.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/Callback.h>
+#include <aprinter/base/ProgramMemory.h>
+#include <aprinter/printer/input/InputCommon.h>
+#include <aprinter/printer/utils/JsonBuilder.h>
+#include <aprinter/printer/utils/LzStreamDecoder.h>
+
+namespace APrinter {
+
+/*
+ * Input which wraps another input (SdFatInput or SdRawInput) and decompresses
+ * files produced by aprinter_compress.py on the fly, so that the client (the
+ * SD card module) gets the decompressed data. Other files are passed through
+ * unchanged; the format is detected from the header at the start of the data.
+ * 
+ * Compressed data is read into a separate block buffer and decoded into the
+ * buffer given by the client, filling whole blocks (except at the end) as the
+ * client expects. The prescan is not done for compressed files.
+ */
+template <typename Arg>
+class LzDecompressInput {
+    using Context      = typename Arg::Context;
+    using ParentObject = typename Arg::ParentObject;
+    using ClientParams = typename Arg::ClientParams;
+    using Params       = typename Arg::Params;
+    
+public:
+    struct Object;
+    
+private:
+    using ThePrinterMain = typename ClientParams::ThePrinterMain;
+    using TheDebugObject = DebugObject<Context, Object>;
+    struct InnerReadHandler;
+    struct InnerClearBufferHandler;
+    struct InnerPrescanHandler;
+    APRINTER_MAKE_INSTANCE(TheInnerInput, (Params::InputService::template Input<Context, Object, InputClientParams<ThePrinterMain, InnerReadHandler, InnerClearBufferHandler, typename ClientParams::StartHandler, InnerPrescanHandler>>))
+    using TheDecoder = LzStreamDecoder<Params::WindowBits>;
+    static size_t const BlockSize = TheInnerInput::ReadBlockSize;
+    static_assert(BlockSize >= TheDecoder::HeaderSize, "");
+    enum {FORMAT_UNKNOWN, FORMAT_RAW, FORMAT_LZ, FORMAT_LZ_END};
+    
+public:
+    static size_t const ReadBlockSize = BlockSize;
+    using DataWordType = typename TheInnerInput::DataWordType;
+    static bool const HasPrescan = TheInnerInput::HasPrescan;
+    static bool const HasSeek = false;
+    
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        o->decode_event.init(c, APRINTER_CB_STATFUNC_T(&LzDecompressInput::decode_event_handler));
+        TheInnerInput::init(c);
+        reset_format(c);
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::deinit(c);
+        
+        TheInnerInput::deinit(c);
+        o->decode_event.deinit(c);
+    }
+    
+    static bool startingIo (Context c, typename ThePrinterMain::TheCommand *err_output)
+    {
+        TheDebugObject::access(c);
+        
+        return TheInnerInput::startingIo(c, err_output);
+    }
+    
+    static void pausingIo (Context c)
+    {
+        TheDebugObject::access(c);
+        
+        TheInnerInput::pausingIo(c);
+    }
+    
+    static bool rewind (Context c, typename ThePrinterMain::TheCommand *err_output)
+    {
+        TheDebugObject::access(c);
+        
+        return TheInnerInput::rewind(c, err_output);
+    }
+    
+    // For compressed files, this is the decompressed size once the
+    // header has been read.
+    template <typename This=LzDecompressInput>
+    static uint32_t getFileSize (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        if (o->format >= FORMAT_LZ) {
+            return o->decompressed_size;
+        }
+        return This::TheInnerInput::getFileSize(c);
+    }
+    
+    static bool eofReached (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        if (o->format >= FORMAT_LZ) {
+            return (o->format == FORMAT_LZ_END);
+        }
+        return TheInnerInput::eofReached(c);
+    }
+    
+    static bool canRead (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        if (o->format >= FORMAT_LZ) {
+            return (o->format == FORMAT_LZ);
+        }
+        return TheInnerInput::canRead(c);
+    }
+    
+    static void startRead (Context c, DataWordType *buf)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->format != FORMAT_LZ_END)
+        
+        // Data decoded before a read error is kept for the retry.
+        if (o->out_length > 0 && (uint8_t *)buf != o->out_buf) {
+            memmove(buf, o->out_buf, o->out_length);
+        }
+        o->out_buf = (uint8_t *)buf;
+        
+        if (o->format == FORMAT_LZ) {
+            // Decode from the event loop, to not call the read handler from here.
+            o->decode_event.prependNowNotAlready(c);
+            return;
+        }
+        TheInnerInput::startRead(c, buf);
+    }
+    
+    static bool checkCommand (Context c, typename ThePrinterMain::TheCommand *cmd)
+    {
+        TheDebugObject::access(c);
+        
+        return TheInnerInput::checkCommand(c, cmd);
+    }
+    
+    template <typename TheJsonBuilder>
+    static void get_json_status (Context c, TheJsonBuilder *json)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        
+        TheInnerInput::get_json_status(c, json);
+        json->addSafeKeyVal("compressed", JsonBool{o->format >= FORMAT_LZ});
+    }
+    
+    using GetSdCard = typename TheInnerInput::GetSdCard;
+    
+    template <typename This=LzDecompressInput>
+    using GetFsAccess = typename This::TheInnerInput::template GetFsAccess<>;
+    
+private:
+    static void reset_format (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        o->format = FORMAT_UNKNOWN;
+        o->prescan_format = FORMAT_UNKNOWN;
+        o->out_length = 0;
+    }
+    
+    static void inner_read_handler (Context c, bool error, size_t bytes_read)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->format != FORMAT_LZ_END)
+        
+        if (o->format == FORMAT_UNKNOWN && !error) {
+            // This is the first block of the file, which was read into the client buffer.
+            o->format = FORMAT_RAW;
+            uint8_t window_bits;
+            if (TheDecoder::parseHeader(o->out_buf, bytes_read, &window_bits, &o->decompressed_size)) {
+                if (!TheDecoder::headerSupported(window_bits)) {
+                    ThePrinterMain::print_pgm_string(c, AMBRO_PSTR("//Error:LzWindowTooLarge\n"));
+                    o->format = FORMAT_LZ_END;
+                    return complete_read(c);
+                }
+                o->format = FORMAT_LZ;
+                o->decoder.init(o->decompressed_size);
+                o->in_pos = 0;
+                o->in_length = bytes_read - TheDecoder::HeaderSize;
+                memcpy(o->in_buffer, o->out_buf + TheDecoder::HeaderSize, o->in_length);
+                return decode_event_handler(c);
+            }
+        }
+        
+        if (o->format != FORMAT_LZ || error) {
+            return ClientParams::ReadHandler::call(c, error, bytes_read);
+        }
+        
+        o->in_pos = 0;
+        o->in_length = bytes_read;
+        return decode_event_handler(c);
+    }
+    struct InnerReadHandler : public AMBRO_WFUNC_TD(&LzDecompressInput::inner_read_handler) {};
+    
+    static void decode_event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->format == FORMAT_LZ)
+        AMBRO_ASSERT(o->out_length < BlockSize)
+        
+        size_t in_used;
+        size_t out_used;
+        bool ok = o->decoder.decode((uint8_t *)o->in_buffer + o->in_pos, o->in_length - o->in_pos, &in_used, o->out_buf + o->out_length, BlockSize - o->out_length, &out_used);
+        o->in_pos += in_used;
+        o->out_length += out_used;
+        
+        if (!ok) {
+            ThePrinterMain::print_pgm_string(c, AMBRO_PSTR("//Error:LzCorrupt\n"));
+            o->format = FORMAT_LZ_END;
+        }
+        else if (o->decoder.isDone()) {
+            o->format = FORMAT_LZ_END;
+        }
+        else if (o->out_length < BlockSize) {
+            // All input was used, read the next block of compressed data.
+            AMBRO_ASSERT(o->in_pos == o->in_length)
+            if (TheInnerInput::eofReached(c)) {
+                ThePrinterMain::print_pgm_string(c, AMBRO_PSTR("//Error:LzTruncated\n"));
+                o->format = FORMAT_LZ_END;
+            } else {
+                return TheInnerInput::startRead(c, o->in_buffer);
+            }
+        }
+        
+        return complete_read(c);
+    }
+    
+    static void complete_read (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        size_t length = o->out_length;
+        o->out_length = 0;
+        return ClientParams::ReadHandler::call(c, false, length);
+    }
+    
+    static void inner_clear_buffer_handler (Context c)
+    {
+        reset_format(c);
+        return ClientParams::ClearBufferHandler::call(c);
+    }
+    struct InnerClearBufferHandler : public AMBRO_WFUNC_TD(&LzDecompressInput::inner_clear_buffer_handler) {};
+    
+    static void inner_prescan_handler (Context c, char const *data, size_t length)
+    {
+        auto *o = Object::self(c);
+        
+        if (o->prescan_format == FORMAT_UNKNOWN) {
+            uint8_t window_bits;
+            uint32_t size;
+            bool is_lz = TheDecoder::parseHeader((uint8_t const *)data, length, &window_bits, &size);
+            o->prescan_format = is_lz ? FORMAT_LZ : FORMAT_RAW;
+        }
+        if (o->prescan_format == FORMAT_RAW) {
+            return ClientParams::PrescanHandler::call(c, data, length);
+        }
+    }
+    struct InnerPrescanHandler : public AMBRO_WFUNC_TD(&LzDecompressInput::inner_prescan_handler) {};
+    
+public:
+    struct Object : public ObjBase<LzDecompressInput, ParentObject, MakeTypeList<
+        TheDebugObject,
+        TheInnerInput
+    >> {
+        typename Context::EventLoop::QueuedEvent decode_event;
+        uint8_t format;
+        uint8_t prescan_format;
+        uint8_t *out_buf;
+        size_t out_length;
+        size_t in_pos;
+        size_t in_length;
+        uint32_t decompressed_size;
+        TheDecoder decoder;
+        DataWordType in_buffer[BlockSize / sizeof(DataWordType)];
+    };
+};
+
+APRINTER_ALIAS_STRUCT_EXT(LzDecompressInputService, (
+    APRINTER_AS_TYPE(InputService),
+    APRINTER_AS_VALUE(int, WindowBits)
+), (
+    static bool const ProvidesFsAccess = InputService::ProvidesFsAccess;
+    
+    APRINTER_ALIAS_STRUCT_EXT(Input, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(ClientParams)
+    ), (
+        using Params = LzDecompressInputService;
+        APRINTER_DEF_INSTANCE(Input, LzDecompressInput)
+    ))
+))
+
+}
+
+#endif
@@ -74,6 +74,7 @@ private:
     
     static size_t const BlockSize = TheBlockAccess::BlockSize;
     static size_t const DirListReplyRequestExtra = 24;
+    static uint32_t const PrescanMaxBlocksAhead = 16;
     static_assert(BlockSize == 512, "BlockSize must be 512");
     
     // NOTE: Check bit field widths at the bottom before adding new state values.
@@ -103,6 +104,12 @@ private:
         WRITEMOUNT_STATE_MOUNTED,
         WRITEMOUNT_STATE_UNMOUNTING
     };
+    enum PrescanState {
+        PRESCAN_STATE_INACTIVE,
+        PRESCAN_STATE_READING,
+        PRESCAN_STATE_WAITING,
+        PRESCAN_STATE_FINISHED
+    };
     
     // Note regarding calling the ClearBufferHandler. A non-obvious precondition for clearing the buffer
     // is that it does not contain a command currently possessing the printer lock. We guarantee this by
@@ -111,6 +118,9 @@ private:
 public:
     static size_t const ReadBlockSize = BlockSize;
     using DataWordType = typename TheBlockAccess::DataWordType;
+    static bool const HasPrescan = true;
+    static bool const HasSeek = true;
+    using SeekPosition = typename TheFs::template File<false>::Position;
     
     static void init (Context c)
     {
@@ -151,6 +161,10 @@ public:
         AMBRO_ASSERT(o->file_state == FILE_STATE_RUNNING) // not FILE_STATE_READING!
         
         o->file_state = FILE_STATE_PAUSED;
+        
+        if (o->prescan_state == PRESCAN_STATE_WAITING) {
+            continue_prescan(c);
+        }
     }
     
     static bool rewind (Context c, typename ThePrinterMain::TheCommand *err_output)
@@ -166,9 +180,59 @@ public:
         fs_o->file.rewind(c);
         o->file_eof = false;
         ClientParams::ClearBufferHandler::call(c);
+        start_prescan(c);
         return true;
     }
     
+    // Position of the next block to be read.
+    static SeekPosition getPosition (Context c)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->file_state == FILE_STATE_RUNNING || o->file_state == FILE_STATE_PAUSED)
+        
+        return fs_o->file.getPosition(c);
+    }
+    
+    // Position of the block being passed to the PrescanHandler,
+    // only to be called from the handler.
+    static SeekPosition getPrescanPosition (Context c)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->prescan_state == PRESCAN_STATE_READING)
+        
+        return fs_o->prescan_file.getPosition(c);
+    }
+    
+    // Continues reading at a block position obtained from getPosition or
+    // getPrescanPosition. Unlike rewind, this does not clear the buffer of
+    // the client or restart the prescan.
+    static void seek (Context c, SeekPosition pos)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->file_state == FILE_STATE_RUNNING || o->file_state == FILE_STATE_PAUSED)
+        
+        fs_o->file.setPosition(c, pos);
+        o->file_eof = false;
+    }
+    
+    static uint32_t getFileSize (Context c)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        TheDebugObject::access(c);
+        
+        if (o->file_state == FILE_STATE_INACTIVE) {
+            return 0;
+        }
+        return fs_o->file.getFileSize(c);
+    }
+    
     static bool eofReached (Context c)
     {
         auto *o = Object::self(c);
@@ -261,6 +325,7 @@ private:
         o->listing_state = LISTING_STATE_INACTIVE;
         o->file_state = FILE_STATE_INACTIVE;
         o->write_mount_state = WRITEMOUNT_STATE_NOT_MOUNTED;
+        o->prescan_state = PRESCAN_STATE_INACTIVE;
     }
     
     static void cleanup (Context c)
@@ -278,6 +343,9 @@ private:
         if (o->file_state != FILE_STATE_INACTIVE) {
             fs_o->file.deinit(c);
         }
+        if (o->prescan_state != PRESCAN_STATE_INACTIVE) {
+            fs_o->prescan_file.deinit(c);
+        }
         if (o->init_state >= INIT_STATE_INIT_FS) {
             TheFs::deinit(c);
         }
@@ -718,7 +786,9 @@ private:
                 fs_o->file.init(c, entry, APRINTER_CB_STATFUNC_T(&SdFatInput::file_handler));
                 o->file_state = FILE_STATE_PAUSED;
                 o->file_eof = false;
+                fs_o->prescan_entry = entry;
                 ClientParams::ClearBufferHandler::call(c);
+                start_prescan(c);
                 
                 if (o->open_start_stream) {
                     auto *cmd = ThePrinterMain::get_locked(c);
@@ -782,9 +852,86 @@ private:
             o->file_eof = true;
         }
         o->file_state = FILE_STATE_RUNNING;
+        
+        if (o->prescan_state == PRESCAN_STATE_WAITING) {
+            continue_prescan(c);
+        }
+        
         return ClientParams::ReadHandler::call(c, is_error, length);
     }
     
+    // The prescan reads the opened file from the start independently of the
+    // printing, passing the data to the client. If the file is reopened or
+    // rewound during a read, the restart is done when the read completes.
+    // While the file is being printed, the prescan reads at most one block
+    // per block read for the printing and stays at most PrescanMaxBlocksAhead
+    // blocks ahead of it, so that it does not compete with the printing.
+    static void start_prescan (Context c)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        AMBRO_ASSERT(o->init_state == INIT_STATE_DONE)
+        
+        if (o->prescan_state == PRESCAN_STATE_READING) {
+            o->prescan_restart = true;
+            return;
+        }
+        
+        if (o->prescan_state != PRESCAN_STATE_INACTIVE) {
+            fs_o->prescan_file.deinit(c);
+        }
+        fs_o->prescan_file.init(c, fs_o->prescan_entry, APRINTER_CB_STATFUNC_T(&SdFatInput::prescan_file_handler), TheFs::template File<false>::IoMode::FS_BUFFER);
+        fs_o->prescan_file.startRead(c);
+        o->prescan_state = PRESCAN_STATE_READING;
+        o->prescan_restart = false;
+    }
+    
+    static void prescan_file_handler (Context c, bool is_error, size_t length)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(o->init_state == INIT_STATE_DONE)
+        AMBRO_ASSERT(o->prescan_state == PRESCAN_STATE_READING)
+        
+        if (!is_error && length > 0) {
+            if (!o->prescan_restart) {
+                ClientParams::PrescanHandler::call(c, fs_o->prescan_file.getReadPointer(c), length);
+            }
+            fs_o->prescan_file.finishRead(c);
+        }
+        
+        o->prescan_state = PRESCAN_STATE_FINISHED;
+        
+        if (o->prescan_restart) {
+            return start_prescan(c);
+        }
+        if (!is_error && length == BlockSize) {
+            continue_prescan(c);
+        }
+    }
+    
+    static void continue_prescan (Context c)
+    {
+        auto *o = Object::self(c);
+        auto *fs_o = UnionFsPart::Object::self(c);
+        AMBRO_ASSERT(o->prescan_state == PRESCAN_STATE_FINISHED || o->prescan_state == PRESCAN_STATE_WAITING)
+        
+        if (o->file_state >= FILE_STATE_RUNNING) {
+            // Wait for the next block read for the printing, then only read
+            // if not too far ahead of it.
+            if (o->file_state == FILE_STATE_READING || o->prescan_state == PRESCAN_STATE_FINISHED ||
+                fs_o->prescan_file.getPosition(c).file_pos >= fs_o->file.getPosition(c).file_pos + PrescanMaxBlocksAhead * BlockSize
+            ) {
+                o->prescan_state = PRESCAN_STATE_WAITING;
+                return;
+            }
+        }
+        
+        fs_o->prescan_file.startRead(c);
+        o->prescan_state = PRESCAN_STATE_READING;
+    }
+    
     APRINTER_FUNCTION_IF_OR_EMPTY_EXT(TheFs::FsWritable, static, void, start_write_mount (Context c, bool is_mount))
     {
         auto *o = Object::self(c);
@@ -1011,6 +1158,8 @@ private:
         >> {
             typename TheFs::FsEntry current_directory;
             typename TheFs::template File<false> file;
+            typename TheFs::FsEntry prescan_entry;
+            typename TheFs::template File<false> prescan_file;
         };
     };
     
@@ -1031,6 +1180,8 @@ public:
         uint8_t unmount_readonly : 1;
         uint8_t unmount_force : 1;
         uint8_t open_start_stream : 1;
+        uint8_t prescan_state : 2;
+        uint8_t prescan_restart : 1;
         union {
             struct {
                 typename TheFs::DirLister dir_lister;
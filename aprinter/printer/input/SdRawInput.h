@@ -60,6 +60,8 @@ private:
 public:
     static size_t const ReadBlockSize = BlockSize;
     using DataWordType = typename TheSdCard::DataWordType;
+    static bool const HasPrescan = false;
+    static bool const HasSeek = false;
     
     static void init (Context c)
     {
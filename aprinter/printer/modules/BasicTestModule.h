@@ -90,6 +90,16 @@ public:
                 cmd->finishCommand(c);
             } break;
             
+#ifdef MOTIONPLANNER_METRICS
+            case 923: { // print planner metrics, reset them with R1
+                print_planner_metrics(c, cmd);
+                if (cmd->get_command_param_uint32(c, 'R', 0)) {
+                    ThePrinterMain::ThePlanner::resetMetrics(c);
+                }
+                cmd->finishCommand(c);
+            } break;
+#endif
+            
             default:
                 return true;
         }
@@ -97,6 +107,39 @@ public:
         return false;
     }
     
+#ifdef MOTIONPLANNER_METRICS
+    static void print_planner_metrics (Context c, typename ThePrinterMain::TheCommand *cmd)
+    {
+        auto const *metrics = ThePrinterMain::ThePlanner::getMetrics(c);
+        uint32_t plan_count = metrics->plan_count;
+        bool planner_active = ThePrinterMain::planner_is_active(c);
+        
+        cmd->reply_append_pstr(c, AMBRO_PSTR("Plans:"));
+        cmd->reply_append_uint32(c, plan_count);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" Ticks:"));
+        cmd->reply_append_uint32(c, (plan_count == 0) ? 0 : (uint32_t)metrics->plan_time_min);
+        cmd->reply_append_ch(c, '/');
+        cmd->reply_append_uint32(c, (plan_count == 0) ? 0 : (uint32_t)(metrics->plan_time_sum / plan_count));
+        cmd->reply_append_ch(c, '/');
+        cmd->reply_append_uint32(c, metrics->plan_time_max);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" Commits:"));
+        cmd->reply_append_uint32(c, metrics->commit_count);
+        cmd->reply_append_ch(c, '/');
+        cmd->reply_append_uint32(c, metrics->commit_fail_count);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" Fill:"));
+        cmd->reply_append_uint32(c, planner_active ? ThePrinterMain::ThePlanner::getBufferFill(c) : 0);
+        cmd->reply_append_ch(c, '/');
+        cmd->reply_append_uint32(c, metrics->min_fill);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" CommitCount:"));
+        cmd->reply_append_uint32(c, planner_active ? ThePrinterMain::ThePlanner::getCommitCount(c) : 0);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" Underruns:"));
+        cmd->reply_append_uint32(c, metrics->underrun_count);
+        cmd->reply_append_pstr(c, AMBRO_PSTR(" Splits:"));
+        cmd->reply_append_uint32(c, metrics->split_count);
+        cmd->reply_append_ch(c, '\n');
+    }
+#endif
+    
     static void planner_underrun (Context c)
     {
         auto *o = Object::self(c);
@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef APRINTER_PLANNER_GROUP_MODULE_H
+#define APRINTER_PLANNER_GROUP_MODULE_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/ListForEach.h>
+#include <aprinter/meta/TupleGet.h>
+#include <aprinter/meta/FixedPoint.h>
+#include <aprinter/meta/WrapFunction.h>
+#include <aprinter/meta/MemberType.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/Callback.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/Hints.h>
+#include <aprinter/base/ProgramMemory.h>
+#include <aprinter/math/FloatTools.h>
+#include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/actuators/Steppers.h>
+#include <aprinter/printer/actuators/StepperGroup.h>
+#include <aprinter/printer/planning/MotionPlanner.h>
+#include <aprinter/printer/utils/ModuleUtils.h>
+
+namespace APrinter {
+    
+/*
+ * An independent group of axes with its own motion planner, for mechanisms
+ * which should not serialize behind the print motion (a second gantry, a
+ * tool changer carousel, a filament feeder).
+ * 
+ * The axes are driven with "M<CommandNumber> <axis><pos>... [F<speed>]",
+ * which queues an absolute move into the group's lookahead buffer and
+ * completes as soon as the move is buffered, so the command stream continues
+ * with other commands (including moves of the main planner) while the group
+ * is moving. "M<CommandNumber>" without axes waits until all moves of the
+ * group are done. Only one command may be waiting for a group at a time, a
+ * second one from another stream fails with PlannerGroupBusy.
+ * 
+ * The axes cannot be homed, their position is 0 at startup. Like G92 for
+ * the main axes, "M<CommandNumber> S1 <axis><pos>..." sets the position of
+ * the given axes without moving them. The new position applies after any
+ * moves of the group which are already buffered.
+ * 
+ * Like for the main planner, the lookahead is flushed when no new move
+ * arrives within ForceTimeout, and the steppers of the group are disabled
+ * after being idle for InactiveTime.
+ */
+
+template <typename ModuleArg>
+class PlannerGroupModule {
+    APRINTER_UNPACK_MODULE_ARG(ModuleArg)
+    
+public:
+    struct Object;
+    
+private:
+    AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_TheStepperDef, TheStepperDef)
+    AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_PlannerAxisSpec, PlannerAxisSpec)
+    
+    using Clock = typename Context::Clock;
+    using TimeType = typename Clock::TimeType;
+    using FpType = typename ThePrinterMain::FpType;
+    using Config = typename ThePrinterMain::Config;
+    using TheCommand = typename ThePrinterMain::TheCommand;
+    using TimeConversion = typename ThePrinterMain::TimeConversion;
+    using ParamsAxesList = typename Params::AxesList;
+    
+    using MaxStepsPerCycle = decltype(Config::e(Params::MaxStepsPerCycle::i()));
+    using CForceTimeoutTicks = decltype(ExprCast<TimeType>(Config::e(Params::ForceTimeout::i()) * TimeConversion()));
+    using CInactiveTimeTicks = decltype(ExprCast<TimeType>(Config::e(Params::InactiveTime::i()) * TimeConversion()));
+    
+    using StepperDefsList = MapTypeList<ParamsAxesList, GetMemberType_TheStepperDef>;
+    APRINTER_MAKE_INSTANCE(TheSteppers, (SteppersArg<Context, Object, Config, StepperDefsList>))
+    
+    struct PlannerPullHandler;
+    struct PlannerFinishedHandler;
+    struct PlannerAbortedHandler;
+    struct PlannerUnderrunCallback;
+    
+    template <int AxisIndex>
+    struct Axis {
+        struct Object;
+        using AxisSpec = TypeListGet<ParamsAxesList, AxisIndex>;
+        static char const AxisName = AxisSpec::Name;
+        static_assert(AxisName != 'F' && AxisName != 'S', "Axis name not allowed");
+        
+        struct LazySteppersList {
+            using List = MakeTypeList<typename TheSteppers::template Stepper<AxisIndex>>;
+        };
+        APRINTER_MAKE_INSTANCE(TheStepperGroup, (StepperGroupArg<Context, LazySteppersList>))
+        
+        template <typename TheModule=PlannerGroupModule> struct DelayedAxisDriverConsumersList;
+        APRINTER_MAKE_INSTANCE(TheAxisDriver, (AxisSpec::TheAxisDriverService::template Driver<Context, Object, TheStepperGroup, DelayedAxisDriverConsumersList<>>))
+        
+        using StepFixedType = FixedPoint<AxisSpec::StepBits, false, 0>;
+        using AbsStepFixedType = FixedPoint<AxisSpec::StepBits - 1, true, 0>;
+        
+        using DistConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()));
+        using SpeedConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()) / TimeConversion());
+        using AccelConversion = decltype(Config::e(AxisSpec::DefaultStepsPerUnit::i()) / (TimeConversion() * TimeConversion()));
+        
+        using AbsStepFixedTypeMin = APRINTER_FP_CONST_EXPR(AbsStepFixedType::minValue().fpValueConstexpr());
+        using AbsStepFixedTypeMax = APRINTER_FP_CONST_EXPR(AbsStepFixedType::maxValue().fpValueConstexpr());
+        
+        using MinReqPos = decltype(ExprFmax(Config::e(AxisSpec::DefaultMin::i()), AbsStepFixedTypeMin() / DistConversion()));
+        using MaxReqPos = decltype(ExprFmin(Config::e(AxisSpec::DefaultMax::i()), AbsStepFixedTypeMax() / DistConversion()));
+        
+        using PlannerMaxSpeedRec = decltype(ExprRec(Config::e(AxisSpec::DefaultMaxSpeed::i()) * SpeedConversion()));
+        using PlannerMaxAccelRec = decltype(ExprRec(Config::e(AxisSpec::DefaultMaxAccel::i()) * AccelConversion()));
+        using PlannerMaxJerkRec = APRINTER_FP_CONST_EXPR(0.0); // jerk limiting is not enabled
+        
+        struct PlannerPrestepCallback;
+        struct PlannerAxisSpec : public MotionPlannerAxisSpec<
+            TheAxisDriver,
+            AxisSpec::StepBits,
+            decltype(Config::e(AxisSpec::DefaultDistanceFactor::i())),
+            decltype(Config::e(AxisSpec::DefaultCorneringDistance::i())),
+            PlannerMaxSpeedRec,
+            PlannerMaxAccelRec,
+            PlannerMaxJerkRec,
+            DistConversion,
+            MotionPlannerNoInputShaper,
+            MotionPlannerNoPressureAdvance,
+            PlannerPrestepCallback
+        > {};
+        
+        static void init (Context c)
+        {
+            auto *o = Object::self(c);
+            TheAxisDriver::init(c);
+            o->m_req_pos = 0.0f;
+            o->m_end_pos = AbsStepFixedType::importBits(0);
+        }
+        
+        static void deinit (Context c)
+        {
+            TheAxisDriver::deinit(c);
+        }
+        
+        static void disable_stepper (Context c)
+        {
+            TheStepperGroup::disable(c);
+        }
+        
+        static void emergency ()
+        {
+            TheStepperGroup::emergency();
+        }
+        
+        static bool has_param (bool accum, Context c, TheCommand *cmd)
+        {
+            return accum || cmd->find_command_param(c, AxisName, nullptr);
+        }
+        
+        static void set_position (Context c, TheCommand *cmd)
+        {
+            auto *o = Object::self(c);
+            
+            FpType req;
+            if (cmd->find_command_param_fp(c, AxisName, &req)) {
+                o->m_req_pos = FloatMax(APRINTER_CFG(Config, CMinReqPos, c), FloatMin(APRINTER_CFG(Config, CMaxReqPos, c), req));
+                o->m_end_pos = AbsStepFixedType::importFpSaturatedRound(o->m_req_pos * APRINTER_CFG(Config, CDistConversion, c));
+            }
+        }
+        
+        template <typename PlannerCmd>
+        static void do_move (Context c, TheCommand *cmd, FpType *distance_squared, PlannerCmd *planner_cmd)
+        {
+            auto *o = Object::self(c);
+            
+            FpType req;
+            if (cmd->find_command_param_fp(c, AxisName, &req)) {
+                o->m_req_pos = FloatMax(APRINTER_CFG(Config, CMinReqPos, c), FloatMin(APRINTER_CFG(Config, CMaxReqPos, c), req));
+            }
+            
+            AbsStepFixedType old_end_pos = o->m_end_pos;
+            o->m_end_pos = AbsStepFixedType::importFpSaturatedRound(o->m_req_pos * APRINTER_CFG(Config, CDistConversion, c));
+            
+            bool dir = (o->m_end_pos >= old_end_pos);
+            StepFixedType move = StepFixedType::importBits(dir ? 
+                ((typename StepFixedType::IntType)o->m_end_pos.bitsValue() - (typename StepFixedType::IntType)old_end_pos.bitsValue()) :
+                ((typename StepFixedType::IntType)old_end_pos.bitsValue() - (typename StepFixedType::IntType)o->m_end_pos.bitsValue())
+            );
+            
+            if (AMBRO_UNLIKELY(move.bitsValue() != 0)) {
+                FpType delta = move.template fpValue<FpType>() * APRINTER_CFG(Config, CDistConversionRec, c);
+                *distance_squared += delta * delta;
+                TheStepperGroup::enable(c);
+            }
+            
+            auto *mycmd = TupleGetElem<AxisIndex>(planner_cmd->axes.axes());
+            mycmd->dir = dir;
+            mycmd->x = move;
+        }
+        
+        static bool planner_prestep_callback (typename TheAxisDriver::CommandCallbackContext c)
+        {
+            return false;
+        }
+        struct PlannerPrestepCallback : public AMBRO_WFUNC_TD(&Axis::planner_prestep_callback) {};
+        
+        template <typename TheModule>
+        struct DelayedAxisDriverConsumersList {
+            using List = MakeTypeList<typename TheModule::ThePlanner::template TheAxisDriverConsumer<AxisIndex>>;
+        };
+        
+        using CDistConversion = decltype(ExprCast<FpType>(DistConversion()));
+        using CDistConversionRec = decltype(ExprCast<FpType>(ExprRec(DistConversion())));
+        using CMinReqPos = decltype(ExprCast<FpType>(MinReqPos()));
+        using CMaxReqPos = decltype(ExprCast<FpType>(MaxReqPos()));
+        
+        using ConfigExprs = MakeTypeList<CDistConversion, CDistConversionRec, CMinReqPos, CMaxReqPos>;
+        
+        struct Object : public ObjBase<Axis, typename PlannerGroupModule::Object, MakeTypeList<
+            TheAxisDriver
+        >> {
+            AbsStepFixedType m_end_pos;
+            FpType m_req_pos;
+        };
+    };
+    
+    using AxesList = IndexElemList<ParamsAxesList, Axis>;
+    
+    using PlannerAxes = MapTypeList<AxesList, GetMemberType_PlannerAxisSpec>;
+    
+public:
+    APRINTER_MAKE_INSTANCE(ThePlanner, (MotionPlannerArg<
+        Context, Object, Config, PlannerAxes, Params::StepperSegmentBufferSize,
+        Params::LookaheadBufferSize, Params::LookaheadCommitCount, Params::LookaheadCommitCount, FpType, FpType, MaxStepsPerCycle,
+        PlannerPullHandler, PlannerFinishedHandler, PlannerAbortedHandler, PlannerUnderrunCallback,
+        EmptyTypeList, EmptyTypeList, false, MotionPlannerNoJunctionDeviation
+    >))
+    using PlannerSplitBuffer = typename ThePlanner::SplitBuffer;
+    
+    template <int AxisIndex>
+    using GetAxisTimer = typename Axis<AxisIndex>::TheAxisDriver::GetTimer;
+    
+public:
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        o->force_timer.init(c, APRINTER_CB_STATFUNC_T(&PlannerGroupModule::force_timer_handler));
+        o->disable_timer.init(c, APRINTER_CB_STATFUNC_T(&PlannerGroupModule::disable_timer_handler));
+        TheSteppers::init(c);
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::init(c)));
+        o->cmd = nullptr;
+        o->time_freq_by_max_speed = 0.0f;
+        o->planner_running = false;
+        o->pull_pending = false;
+    }
+    
+    static void deinit (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        if (o->planner_running) {
+            ThePlanner::deinit(c);
+        }
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::deinit(c)));
+        TheSteppers::deinit(c);
+        o->disable_timer.deinit(c);
+        o->force_timer.deinit(c);
+    }
+    
+    static bool check_command (Context c, TheCommand *cmd)
+    {
+        if (cmd->getCmdNumber(c) == Params::CommandNumber) {
+            handle_group_command(c, cmd);
+            return false;
+        }
+        return true;
+    }
+    
+    static void emergency ()
+    {
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::emergency()));
+    }
+    
+private:
+    static void handle_group_command (Context c, TheCommand *cmd)
+    {
+        auto *o = Object::self(c);
+        
+        if (o->cmd) {
+            cmd->reportError(c, AMBRO_PSTR("PlannerGroupBusy"));
+            return cmd->finishCommand(c);
+        }
+        
+        if (cmd->get_command_param_uint32(c, 'S', 0) == 1) {
+            // Moves already in the planner were converted to steps, so the
+            // new position can be taken over right away.
+            ListFor<AxesList>([&] APRINTER_TL(axis, axis::set_position(c, cmd)));
+            return cmd->finishCommand(c);
+        }
+        
+        bool is_wait = !ListForFold<AxesList>(false, [&] APRINTER_TLA(axis, (bool accum), return axis::has_param(accum, c, cmd)));
+        
+        if (!o->planner_running) {
+            if (is_wait) {
+                return cmd->finishCommand(c);
+            }
+            o->disable_timer.unset(c);
+            ThePlanner::init(c, false);
+            o->planner_running = true;
+            o->pull_pending = false;
+        }
+        
+        o->cmd = cmd;
+        o->cmd_is_wait = is_wait;
+        if (o->pull_pending) {
+            work_command(c);
+        }
+    }
+    
+    static void work_command (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(o->cmd)
+        AMBRO_ASSERT(o->planner_running)
+        AMBRO_ASSERT(o->pull_pending)
+        
+        o->force_timer.unset(c);
+        
+        if (o->cmd_is_wait) {
+            // The command is finished from planner_finished_handler().
+            return ThePlanner::waitFinished(c);
+        }
+        
+        TheCommand *cmd = o->cmd;
+        o->cmd = nullptr;
+        
+        FpType speed;
+        if (cmd->find_command_param_fp(c, 'F', &speed)) {
+            o->time_freq_by_max_speed = (FpType)(TimeConversion::value() / Params::SpeedLimitMultiply::value()) / FloatMakePosOrPosZero(speed);
+        }
+        
+        PlannerSplitBuffer *planner_cmd = ThePlanner::getBuffer(c);
+        FpType distance_squared = 0.0f;
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::do_move(c, cmd, &distance_squared, planner_cmd)));
+        planner_cmd->axes.rel_max_v_rec = FloatSqrt(distance_squared) * o->time_freq_by_max_speed;
+        
+        o->pull_pending = false;
+        ThePlanner::axesCommandDone(c);
+        
+        return cmd->finishCommand(c);
+    }
+    
+    static void force_timer_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(o->planner_running)
+        AMBRO_ASSERT(o->pull_pending)
+        AMBRO_ASSERT(!o->cmd)
+        
+        ThePlanner::waitFinished(c);
+    }
+    
+    static void disable_timer_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(!o->planner_running)
+        
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::disable_stepper(c)));
+    }
+    
+    static void planner_pull_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(o->planner_running)
+        AMBRO_ASSERT(!o->pull_pending)
+        
+        o->pull_pending = true;
+        if (o->cmd) {
+            return work_command(c);
+        }
+        o->force_timer.appendAfter(c, APRINTER_CFG(Config, CForceTimeoutTicks, c));
+    }
+    struct PlannerPullHandler : public AMBRO_WFUNC_TD(&PlannerGroupModule::planner_pull_handler) {};
+    
+    static void planner_finished_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(o->planner_running)
+        AMBRO_ASSERT(o->pull_pending)
+        AMBRO_ASSERT(!o->cmd || o->cmd_is_wait)
+        
+        ThePlanner::deinit(c);
+        o->force_timer.unset(c);
+        o->planner_running = false;
+        o->pull_pending = false;
+        o->disable_timer.appendAfter(c, APRINTER_CFG(Config, CInactiveTimeTicks, c));
+        
+        if (o->cmd) {
+            TheCommand *cmd = o->cmd;
+            o->cmd = nullptr;
+            cmd->finishCommand(c);
+        }
+    }
+    struct PlannerFinishedHandler : public AMBRO_WFUNC_TD(&PlannerGroupModule::planner_finished_handler) {};
+    
+    static void planner_aborted_handler (Context c)
+    {
+        // The prestep callback is never enabled, so moves are not aborted.
+        AMBRO_ASSERT(false)
+    }
+    struct PlannerAbortedHandler : public AMBRO_WFUNC_TD(&PlannerGroupModule::planner_aborted_handler) {};
+    
+    static void planner_underrun_callback (Context c)
+    {
+    }
+    struct PlannerUnderrunCallback : public AMBRO_WFUNC_TD(&PlannerGroupModule::planner_underrun_callback) {};
+    
+public:
+    using ConfigExprs = MakeTypeList<CForceTimeoutTicks, CInactiveTimeTicks>;
+    
+    struct Object : public ObjBase<PlannerGroupModule, ParentObject, JoinTypeLists<
+        AxesList,
+        MakeTypeList<
+            TheSteppers,
+            ThePlanner
+        >
+    >> {
+        typename Context::EventLoop::TimedEvent force_timer;
+        typename Context::EventLoop::TimedEvent disable_timer;
+        TheCommand *cmd;
+        FpType time_freq_by_max_speed;
+        bool planner_running;
+        bool pull_pending;
+        bool cmd_is_wait;
+    };
+};
+
+APRINTER_ALIAS_STRUCT(PlannerGroupAxisParams, (
+    APRINTER_AS_VALUE(char, Name),
+    APRINTER_AS_TYPE(DefaultStepsPerUnit),
+    APRINTER_AS_TYPE(DefaultMin),
+    APRINTER_AS_TYPE(DefaultMax),
+    APRINTER_AS_TYPE(DefaultMaxSpeed),
+    APRINTER_AS_TYPE(DefaultMaxAccel),
+    APRINTER_AS_TYPE(DefaultDistanceFactor),
+    APRINTER_AS_TYPE(DefaultCorneringDistance),
+    APRINTER_AS_VALUE(int, StepBits),
+    APRINTER_AS_TYPE(TheStepperDef),
+    APRINTER_AS_TYPE(TheAxisDriverService)
+))
+
+APRINTER_ALIAS_STRUCT_EXT(PlannerGroupModuleService, (
+    APRINTER_AS_VALUE(uint16_t, CommandNumber),
+    APRINTER_AS_VALUE(int, StepperSegmentBufferSize),
+    APRINTER_AS_VALUE(int, LookaheadBufferSize),
+    APRINTER_AS_VALUE(int, LookaheadCommitCount),
+    APRINTER_AS_TYPE(MaxStepsPerCycle),
+    APRINTER_AS_TYPE(SpeedLimitMultiply),
+    APRINTER_AS_TYPE(ForceTimeout),
+    APRINTER_AS_TYPE(InactiveTime),
+    APRINTER_AS_TYPE(AxesList)
+), (
+    APRINTER_MODULE_TEMPLATE(PlannerGroupModuleService, PlannerGroupModule)
+))
+
+}
+
+#endif
@@ -28,6 +28,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdio.h>
 
 #include <aprinter/meta/ChooseInt.h>
 #include <aprinter/meta/MinMax.h>
@@ -36,19 +37,23 @@
 #include <aprinter/meta/TypeList.h>
 #include <aprinter/meta/TypeListUtils.h>
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/StructIf.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/base/Callback.h>
 #include <aprinter/base/ProgramMemory.h>
 #include <aprinter/base/Assert.h>
+#include <aprinter/base/LoopUtils.h>
+#include <aprinter/math/FloatTools.h>
 #include <aprinter/printer/Configuration.h>
 #include <aprinter/printer/input/InputCommon.h>
 #include <aprinter/printer/ServiceList.h>
 #include <aprinter/printer/utils/GcodeCommand.h>
 #include <aprinter/printer/utils/ModuleUtils.h>
 #include <aprinter/printer/utils/JsonBuilder.h>
+#include <aprinter/printer/utils/GcodeTimeEstimator.h>
 
 namespace APrinter {
-
+    
 template <typename ModuleArg>
 class SdCardModule {
     APRINTER_UNPACK_MODULE_ARG(ModuleArg)
@@ -57,13 +62,16 @@ public:
     struct Object;
     
 private:
-    using TimeType = typename Context::Clock::TimeType;
+    using Clock = typename Context::Clock;
+    using TimeType = typename Clock::TimeType;
+    using FpType = typename ThePrinterMain::FpType;
     using TheCommand = typename ThePrinterMain::TheCommand;
     
     struct InputReadHandler;
     struct InputClearBufferHandler;
     struct InputStartHandler;
-    APRINTER_MAKE_INSTANCE(TheInput, (Params::InputService::template Input<Context, Object, InputClientParams<ThePrinterMain, InputReadHandler, InputClearBufferHandler, InputStartHandler>>))
+    struct InputPrescanHandler;
+    APRINTER_MAKE_INSTANCE(TheInput, (Params::InputService::template Input<Context, Object, InputClientParams<ThePrinterMain, InputReadHandler, InputClearBufferHandler, InputStartHandler, InputPrescanHandler>>))
     
     using DataWordType = typename TheInput::DataWordType;
     
@@ -83,7 +91,8 @@ private:
     static const size_t WrapExtraSizeWords = (WrapExtraSize + (sizeof(DataWordType) - 1)) / sizeof(DataWordType);
     
     using ParserSizeType = ChooseIntForMax<MaxCommandSize, false>;
-    using TheGcodeParser = typename Params::TheGcodeParserService::template Parser<Context, ParserSizeType, typename ThePrinterMain::FpType>;
+    using TheGcodeParser = typename Params::TheGcodeParserService::template Parser<Context, ParserSizeType, FpType>;
+    using LayerStart = typename GcodeTimeEstimator<FpType>::LayerStart;
     
     static TimeType const BaseRetryTimeTicks = 0.5 * Context::Clock::time_freq;
     static int const ReadRetryCount = 5;
@@ -140,6 +149,7 @@ public:
     {
         json->addKeyObject(JsonSafeString{"sdcard"});
         TheInput::get_json_status(c, json);
+        EstimateFeature::get_json_status(c, json);
         json->endObject();
     }
     
@@ -150,7 +160,7 @@ public:
     
 private:
     struct StreamCallback: public ThePrinterMain::CommandStreamCallback, ThePrinterMain::SendBufEventCallback {
-        void finish_command_impl (Context c)
+        void finish_command_impl (Context c, bool no_ok)
         {
             auto *o = Object::self(c);
             AMBRO_ASSERT(o->m_state == SDCARD_RUNNING)
@@ -176,6 +186,7 @@ private:
             AMBRO_ASSERT(o->gcode_parser.getLength(c) <= o->m_length)
             
             size_t cmd_len = o->gcode_parser.getLength(c);
+            EstimateFeature::command_done(c, o->command_stream.getGcodeCommand(c), cmd_len);
             o->m_start = buf_add(o->m_start, cmd_len);
             o->m_length -= cmd_len;
             
@@ -283,6 +294,7 @@ private:
         o->m_reading = false;
         o->m_retry_counter = 0;
         o->command_stream.clearError(c);
+        EstimateFeature::start(c);
         
         if (can_read(c)) {
             start_read(c);
@@ -355,6 +367,10 @@ private:
                 cmd->reportError(c, AMBRO_PSTR("SdPrintRunning"));
                 break;
             }
+            uint32_t layer;
+            if (cmd->find_command_param_uint32(c, 'L', &layer)) {
+                return ResumeFeature::start_resume(c, cmd, layer);
+            }
             uint32_t seek_pos = cmd->get_command_param_uint32(c, 'S', 0);
             if (seek_pos != 0) {
                 cmd->reportError(c, AMBRO_PSTR("CanOnlySeekToZero"));
@@ -370,6 +386,11 @@ private:
     static void input_read_handler (Context c, bool error, size_t bytes_read)
     {
         auto *o = Object::self(c);
+        
+        if (o->m_state == SDCARD_PAUSED) {
+            return ResumeFeature::scan_read_handler(c, error, bytes_read);
+        }
+        
         AMBRO_ASSERT(o->m_state == SDCARD_RUNNING || o->m_state == SDCARD_PAUSING)
         buf_sanity(c);
         AMBRO_ASSERT(o->m_reading)
@@ -388,6 +409,7 @@ private:
                 memcpy((char *)o->m_buffer + BufferBaseSize, (char *)o->m_buffer, MinValue(bytes_read - (BufferBaseSize - write_offset), WrapExtraSize));
             }
             o->m_length += bytes_read;
+            ResumeFeature::data_read(c);
         }
         
         if (o->m_state == SDCARD_PAUSING) {
@@ -436,6 +458,13 @@ private:
     }
     struct InputStartHandler : public AMBRO_WFUNC_TD(&SdCardModule::input_start_handler) {};
     
+    static void input_prescan_handler (Context c, char const *data, size_t length)
+    {
+        ResumeFeature::prescan_block(c);
+        EstimateFeature::prescan_data(c, data, length);
+    }
+    struct InputPrescanHandler : public AMBRO_WFUNC_TD(&SdCardModule::input_prescan_handler) {};
+    
     static void next_event_handler (Context c)
     {
         auto *o = Object::self(c);
@@ -508,6 +537,8 @@ private:
         o->gcode_parser.init(c);
         o->m_start = 0;
         o->m_length = 0;
+        EstimateFeature::reset(c);
+        ResumeFeature::reset(c);
     }
     
     static void deinit_buffering (Context c)
@@ -551,12 +582,506 @@ private:
         AMBRO_ASSERT(o->m_length <= BufferBaseSize)
     }
     
+    // Estimation of the remaining time and the layer progress of the print.
+    // The input reads the whole file ahead of the printing (prescan), and the
+    // same rough estimate is done for the prescanned text and for the parsed
+    // executed commands. The estimate of the rest is scaled by the ratio of
+    // the real duration of the motion to the estimate of the executed part,
+    // the former being measured as the time during which committed motion
+    // was pending in the planner (which excludes e.g. waiting for heaters).
+    AMBRO_STRUCT_IF(EstimateFeature, TheInput::HasPrescan && Params::TheGcodeParserService::TextFormat) {
+        struct Object;
+        
+        static void reset (Context c)
+        {
+            auto *o = Object::self(c);
+            o->prescan.init();
+            o->executed.init();
+            o->prescan_pos = 0;
+            o->file_pos = 0;
+            o->print_time = 0.0f;
+            o->motion_time = 0.0f;
+            o->skipped_time = 0.0f;
+        }
+        
+        static void start (Context c)
+        {
+            auto *o = Object::self(c);
+            o->time_mark = Clock::getTime(c);
+            o->time_ahead = ThePrinterMain::get_committed_time_ahead(c);
+        }
+        
+        // Needs to be called while printing often enough that the clock
+        // does not wrap, which is ensured by calling it for each command.
+        static void update_time (Context c)
+        {
+            auto *o = Object::self(c);
+            
+            TimeType now = Clock::getTime(c);
+            TimeType elapsed = now - o->time_mark;
+            o->print_time += (FpType)elapsed * (FpType)Clock::time_unit;
+            o->motion_time += (FpType)MinValue(elapsed, o->time_ahead) * (FpType)Clock::time_unit;
+            o->time_mark = now;
+            o->time_ahead = ThePrinterMain::get_committed_time_ahead(c);
+        }
+        
+        static void command_done (Context c, GcodeCommand<Context, FpType> *cmd, size_t length)
+        {
+            auto *o = Object::self(c);
+            update_time(c);
+            
+            auto num_parts = cmd->getNumParts(c);
+            if (num_parts >= 0) {
+                o->executed.addPart(cmd->getCmdCode(c), cmd->getCmdNumber(c));
+                for (auto i : LoopRangeAuto(num_parts)) {
+                    auto part = cmd->getPart(c, i);
+                    o->executed.addPart(cmd->getPartCode(c, part), cmd->getPartFpValue(c, part));
+                }
+                o->executed.endCommand();
+            }
+            o->file_pos += length;
+        }
+        
+        static void prescan_data (Context c, char const *data, size_t length)
+        {
+            auto *o = Object::self(c);
+            o->prescan.feed(data, length, [&](LayerStart const &layer_start) {
+                ResumeFeature::add_layer(c, layer_start);
+            });
+            o->prescan_pos += length;
+        }
+        
+        // Continues the estimate of the executed part when printing is
+        // resumed at a layer, not counting the injected commands. The motion
+        // measured so far no longer corresponds to the executed estimate, so
+        // the calibration starts over from the layer.
+        static void resume (Context c, LayerStart const &layer_start, size_t injected_length)
+        {
+            auto *o = Object::self(c);
+            o->executed.restore(layer_start);
+            o->skipped_time = layer_start.time;
+            o->motion_time = 0.0f;
+            o->file_pos = (layer_start.offset > injected_length) ? (layer_start.offset - injected_length) : 0;
+        }
+        
+        static uint32_t get_prescan_layers (Context c)
+        {
+            auto *o = Object::self(c);
+            return o->prescan.getLayer();
+        }
+        
+        template <typename TheJsonBuilder>
+        static void get_json_status (Context c, TheJsonBuilder *json)
+        {
+            auto *o = Object::self(c);
+            auto *mo = SdCardModule::Object::self(c);
+            
+            if (mo->m_state != SDCARD_PAUSED) {
+                update_time(c);
+            }
+            
+            uint32_t file_size = TheInput::getFileSize(c);
+            bool prescan_done = (o->prescan_pos >= file_size);
+            
+            json->addSafeKeyVal("fileSize", JsonUint32{file_size});
+            json->addSafeKeyVal("filePos", JsonUint32{o->file_pos});
+            json->addSafeKeyVal("printTime", JsonDouble{o->print_time});
+            
+            if (file_size == 0 || o->prescan_pos == 0) {
+                json->addSafeKeyVal("timeLeft", JsonNull());
+            } else {
+                // Before the prescan is done, extrapolate its estimate to the file size.
+                FpType total = o->prescan.getTime();
+                if (!prescan_done) {
+                    total *= (FpType)file_size / o->prescan_pos;
+                }
+                
+                // Calibrate only when there is a meaningful part of the estimate executed.
+                FpType done = o->executed.getTime();
+                FpType calib_done = done - o->skipped_time;
+                FpType ahead = (FpType)o->time_ahead * (FpType)Clock::time_unit;
+                FpType ratio = (calib_done >= MinCalibrationTime()) ? ((o->motion_time + ahead) / calib_done) : 1.0f;
+                
+                json->addSafeKeyVal("timeLeft", JsonDouble{FloatMakePosOrPosZero(total - done) * ratio + ahead});
+            }
+            
+            json->addSafeKeyVal("layer", JsonUint32{o->executed.getLayer()});
+            if (file_size == 0 || !prescan_done) {
+                json->addSafeKeyVal("layerCount", JsonNull());
+            } else {
+                json->addSafeKeyVal("layerCount", JsonUint32{o->prescan.getLayer()});
+            }
+        }
+        
+        static FpType MinCalibrationTime ()
+        {
+            return 10.0f;
+        }
+        
+        struct Object : public ObjBase<EstimateFeature, typename SdCardModule::Object, EmptyTypeList> {
+            GcodeTimeEstimator<FpType> prescan;
+            GcodeTimeEstimator<FpType> executed;
+            uint32_t prescan_pos;
+            uint32_t file_pos;
+            FpType print_time;
+            FpType motion_time;
+            FpType skipped_time;
+            TimeType time_mark;
+            TimeType time_ahead;
+        };
+    } AMBRO_STRUCT_ELSE(EstimateFeature) {
+        static void reset (Context c) {}
+        static void start (Context c) {}
+        static void update_time (Context c) {}
+        static void command_done (Context c, GcodeCommand<Context, FpType> *cmd, size_t length) {}
+        static void prescan_data (Context c, char const *data, size_t length) {}
+        static void resume (Context c, LayerStart const &layer_start, size_t injected_length) {}
+        static uint32_t get_prescan_layers (Context c) { return 0; }
+        template <typename TheJsonBuilder>
+        static void get_json_status (Context c, TheJsonBuilder *json) {}
+        struct Object {};
+    };
+    
+    // Resuming the print at the start of a layer (M26 L<layer>, while paused,
+    // followed by M24). During the prescan, the block positions and the
+    // estimator state at the lines starting layers are recorded in an index
+    // of ResumeIndexSize entries. When it fills up, every other entry is
+    // dropped and from then on only every other layer is recorded, so the
+    // index covers the whole file with the layers spaced evenly. The file is
+    // then seeked to the nearest indexed layer at or before the requested one,
+    // from where it is read without executing until the layer is found. The
+    // printing continues from the start of that line, preceded by commands
+    // restoring the position, feed rate and positioning modes.
+    AMBRO_STRUCT_IF(ResumeFeature, TheInput::HasSeek && TheInput::HasPrescan && Params::TheGcodeParserService::TextFormat && Params::ResumeIndexSize > 0) {
+        struct Object;
+        using SeekPosition = typename TheInput::SeekPosition;
+        static size_t const IndexSize = Params::ResumeIndexSize;
+        static size_t const MaxPreambleSize = 128;
+        static size_t const MaxPreambleLineSize = 40;
+        static_assert(IndexSize >= 2, "");
+        static_assert(BufferBaseSize >= BlockSize + MaxPreambleSize, "");
+        static_assert(MaxCommandSize >= MaxPreambleLineSize, "");
+        
+        struct IndexEntry {
+            SeekPosition block;
+            LayerStart layer_start;
+        };
+        
+        // The positions of the last two blocks read, for finding the block
+        // where a line started.
+        struct RecentBlocks {
+            void reset ()
+            {
+                have_block = false;
+                have_prev_block = false;
+            }
+            
+            void push (SeekPosition pos)
+            {
+                prev_block = block;
+                have_prev_block = have_block;
+                block = pos;
+                have_block = true;
+            }
+            
+            bool find (uint32_t offset, SeekPosition *out_block)
+            {
+                if (have_block && offset >= block.file_pos) {
+                    *out_block = block;
+                    return true;
+                }
+                if (have_prev_block && offset >= prev_block.file_pos) {
+                    *out_block = prev_block;
+                    return true;
+                }
+                return false;
+            }
+            
+            SeekPosition block;
+            SeekPosition prev_block;
+            bool have_block;
+            bool have_prev_block;
+        };
+        
+        static void reset (Context c)
+        {
+            auto *o = Object::self(c);
+            o->num_entries = 0;
+            o->stride = 1;
+            o->prescan_blocks.reset();
+            o->scanning = false;
+            o->pending = false;
+        }
+        
+        static void prescan_block (Context c)
+        {
+            auto *o = Object::self(c);
+            o->prescan_blocks.push(TheInput::getPrescanPosition(c));
+        }
+        
+        static void add_layer (Context c, LayerStart const &layer_start)
+        {
+            auto *o = Object::self(c);
+            
+            if ((layer_start.layer - 1) % o->stride != 0) {
+                return;
+            }
+            
+            while (o->num_entries == IndexSize) {
+                size_t num_kept = 0;
+                for (size_t i = 0; i < o->num_entries; i++) {
+                    if ((o->index[i].layer_start.layer - 1) % (2 * o->stride) == 0) {
+                        o->index[num_kept++] = o->index[i];
+                    }
+                }
+                o->num_entries = num_kept;
+                o->stride *= 2;
+                if ((layer_start.layer - 1) % o->stride != 0) {
+                    return;
+                }
+            }
+            
+            SeekPosition block;
+            if (!o->prescan_blocks.find(layer_start.offset, &block)) {
+                return;
+            }
+            
+            IndexEntry *entry = &o->index[o->num_entries++];
+            entry->block = block;
+            entry->layer_start = layer_start;
+        }
+        
+        static void start_resume (Context c, TheCommand *cmd, uint32_t layer)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(!o->scanning)
+            
+            if (layer == 0 || layer > EstimateFeature::get_prescan_layers(c) || o->num_entries == 0) {
+                cmd->reportError(c, AMBRO_PSTR("LayerNotFound"));
+                return cmd->finishCommand(c);
+            }
+            
+            if (!TheInput::startingIo(c, cmd)) {
+                cmd->reportError(c, nullptr);
+                return cmd->finishCommand(c);
+            }
+            
+            size_t entry_index = 0;
+            while (entry_index + 1 < o->num_entries && o->index[entry_index + 1].layer_start.layer <= layer) {
+                entry_index++;
+            }
+            IndexEntry *entry = &o->index[entry_index];
+            
+            if (entry->layer_start.layer == layer) {
+                return complete_resume(c, entry->block, entry->layer_start);
+            }
+            
+            TheInput::seek(c, entry->block);
+            o->scan.restore(entry->layer_start);
+            o->target_layer = layer;
+            o->skip = entry->layer_start.offset - entry->block.file_pos;
+            o->scan_blocks.reset();
+            o->scanning = true;
+            start_scan_read(c);
+        }
+        
+        static void scan_read_handler (Context c, bool error, size_t bytes_read)
+        {
+            auto *o = Object::self(c);
+            auto *mo = SdCardModule::Object::self(c);
+            AMBRO_ASSERT(o->scanning)
+            AMBRO_ASSERT(o->skip <= bytes_read || error)
+            
+            if (error) {
+                return scan_failed(c);
+            }
+            
+            bool found = false;
+            o->scan.feed((char const *)mo->m_buffer + o->skip, bytes_read - o->skip, [&](LayerStart const &layer_start) {
+                if (!found && layer_start.layer == o->target_layer) {
+                    found = true;
+                    o->target = layer_start;
+                }
+            });
+            o->skip = 0;
+            
+            if (found) {
+                SeekPosition block;
+                if (!o->scan_blocks.find(o->target.offset, &block)) {
+                    return scan_failed(c);
+                }
+                o->scanning = false;
+                return complete_resume(c, block, o->target);
+            }
+            
+            if (!TheInput::canRead(c)) {
+                return scan_failed(c);
+            }
+            start_scan_read(c);
+        }
+        
+        // Called when data has been read into the buffer while printing.
+        static void data_read (Context c)
+        {
+            auto *o = Object::self(c);
+            auto *mo = SdCardModule::Object::self(c);
+            
+            if (!o->pending) {
+                return;
+            }
+            o->pending = false;
+            AMBRO_ASSERT(mo->m_start == 0)
+            AMBRO_ASSERT(o->skip < mo->m_length)
+            
+            // Replace the data before the line with the preamble. The end of
+            // the data stays where it was, so reading can continue normally.
+            char preamble[MaxPreambleSize];
+            size_t length = make_preamble(preamble, o->target);
+            size_t start = (o->skip >= length) ? (o->skip - length) : (BufferBaseSize - (length - o->skip));
+            for (size_t i = 0; i < length; i++) {
+                size_t pos = buf_add(start, i);
+                ((char *)mo->m_buffer)[pos] = preamble[i];
+                if (pos < WrapExtraSize) {
+                    ((char *)mo->m_buffer)[BufferBaseSize + pos] = preamble[i];
+                }
+            }
+            mo->m_start = start;
+            mo->m_length = mo->m_length - o->skip + length;
+            
+            // The parser may have started a command at the old start.
+            mo->gcode_parser.deinit(c);
+            mo->gcode_parser.init(c);
+            
+            EstimateFeature::resume(c, o->target, length);
+        }
+        
+    private:
+        static void start_scan_read (Context c)
+        {
+            auto *o = Object::self(c);
+            auto *mo = SdCardModule::Object::self(c);
+            
+            o->scan_blocks.push(TheInput::getPosition(c));
+            TheInput::startRead(c, mo->m_buffer);
+        }
+        
+        static void scan_failed (Context c)
+        {
+            auto *o = Object::self(c);
+            
+            o->scanning = false;
+            TheInput::pausingIo(c);
+            
+            // The buffer was used for reading, so the printing cannot
+            // continue where it was paused. Start over from the beginning.
+            auto *cmd = ThePrinterMain::get_locked(c);
+            TheInput::rewind(c, cmd);
+            cmd->reportError(c, AMBRO_PSTR("LayerNotFound"));
+            cmd->finishCommand(c);
+        }
+        
+        static void complete_resume (Context c, SeekPosition block, LayerStart const &layer_start)
+        {
+            auto *o = Object::self(c);
+            auto *mo = SdCardModule::Object::self(c);
+            
+            TheInput::seek(c, block);
+            TheInput::pausingIo(c);
+            
+            mo->command_stream.maybeCancelCommand(c);
+            mo->gcode_parser.deinit(c);
+            mo->gcode_parser.init(c);
+            mo->m_start = 0;
+            mo->m_length = 0;
+            
+            o->target = layer_start;
+            o->skip = layer_start.offset - block.file_pos;
+            o->pending = true;
+            
+            auto *cmd = ThePrinterMain::get_locked(c);
+            cmd->reply_append_pstr(c, AMBRO_PSTR("ResumeLine:"));
+            cmd->reply_append_uint32(c, layer_start.line + 1);
+            cmd->reply_append_ch(c, '\n');
+            cmd->finishCommand(c);
+        }
+        
+        static size_t make_preamble (char *buf, LayerStart const &s)
+        {
+            char *p = buf;
+            p = append_pstr(p, AMBRO_PSTR("G90\nG1 Z"));
+            p = append_fp(p, s.pos[2]);
+            if (s.speed > 0.0f) {
+                p = append_pstr(p, AMBRO_PSTR(" F"));
+                p = append_fp(p, s.speed * 60.0f);
+            }
+            p = append_pstr(p, AMBRO_PSTR("\nG1 X"));
+            p = append_fp(p, s.pos[0]);
+            p = append_pstr(p, AMBRO_PSTR(" Y"));
+            p = append_fp(p, s.pos[1]);
+            p = append_pstr(p, AMBRO_PSTR("\nG92 E"));
+            p = append_fp(p, s.pos[3]);
+            p = append_pstr(p, AMBRO_PSTR("\n"));
+            if (s.relative) {
+                p = append_pstr(p, AMBRO_PSTR("G91\n"));
+            }
+            p = append_pstr(p, s.relative_e ? AMBRO_PSTR("M83\n") : AMBRO_PSTR("M82\n"));
+            AMBRO_ASSERT(p - buf <= MaxPreambleSize)
+            return p - buf;
+        }
+        
+        static char * append_pstr (char *p, AMBRO_PGM_P pstr)
+        {
+            char ch;
+            while ((ch = AMBRO_PGM_READBYTE(pstr++))) {
+                *p++ = ch;
+            }
+            return p;
+        }
+        
+        static char * append_fp (char *p, FpType x)
+        {
+#if defined(AMBROLIB_AVR)
+            return p + AMBRO_PGM_SPRINTF(p, AMBRO_PSTR("%g"), x);
+#else
+            return p + sprintf(p, "%g", (double)x);
+#endif
+        }
+        
+    public:
+        struct Object : public ObjBase<ResumeFeature, typename SdCardModule::Object, EmptyTypeList> {
+            IndexEntry index[IndexSize];
+            size_t num_entries;
+            uint32_t stride;
+            RecentBlocks prescan_blocks;
+            RecentBlocks scan_blocks;
+            GcodeTimeEstimator<FpType> scan;
+            LayerStart target;
+            uint32_t target_layer;
+            size_t skip;
+            bool scanning;
+            bool pending;
+        };
+    } AMBRO_STRUCT_ELSE(ResumeFeature) {
+        static void reset (Context c) {}
+        static void prescan_block (Context c) {}
+        static void add_layer (Context c, LayerStart const &layer_start) {}
+        static void start_resume (Context c, TheCommand *cmd, uint32_t layer)
+        {
+            cmd->reportError(c, AMBRO_PSTR("LayerSeekNotSupported"));
+            cmd->finishCommand(c);
+        }
+        static void scan_read_handler (Context c, bool error, size_t bytes_read) { AMBRO_ASSERT(false) }
+        static void data_read (Context c) {}
+        struct Object {};
+    };
+    
     static void complete_pause (Context c)
     {
         auto *o = Object::self(c);
         AMBRO_ASSERT(o->m_state == SDCARD_RUNNING || o->m_state == SDCARD_PAUSING)
         AMBRO_ASSERT(!o->m_reading)
         
+        EstimateFeature::update_time(c);
         TheInput::pausingIo(c);
         o->m_retry_timer.unset(c);
         o->m_state = SDCARD_PAUSED;
@@ -564,7 +1089,9 @@ private:
     
 public:
     struct Object : public ObjBase<SdCardModule, ParentObject, MakeTypeList<
-        TheInput
+        TheInput,
+        EstimateFeature,
+        ResumeFeature
     >> {
         TheGcodeParser gcode_parser;
         typename ThePrinterMain::CommandStream command_stream;
@@ -589,7 +1116,8 @@ APRINTER_ALIAS_STRUCT_EXT(SdCardModuleService, (
     APRINTER_AS_TYPE(InputService),
     APRINTER_AS_TYPE(TheGcodeParserService),
     APRINTER_AS_VALUE(size_t, BufferBaseSize),
-    APRINTER_AS_VALUE(size_t, MaxCommandSize)
+    APRINTER_AS_VALUE(size_t, MaxCommandSize),
+    APRINTER_AS_VALUE(size_t, ResumeIndexSize)
 ), (
     APRINTER_MODULE_TEMPLATE(SdCardModuleService, SdCardModule)
     
@@ -41,6 +41,21 @@
 
 namespace APrinter {
 
+/*
+ * Serial port command stream.
+ * 
+ * By default, each command is answered with "ok" when it is done, so the
+ * host sends the next one only then. "M110 W1" (W0 to disable) turns on a
+ * windowed protocol, where the host may have multiple line numbered commands
+ * in flight, as many as fit into the receive buffer (reported in the reply
+ * as "RecvBuffer:<bytes>"). Commands are then acknowledged with
+ * "ok N<line>" (just "ok" for unnumbered commands). A command which fails
+ * to parse or does not have the expected line number is answered with
+ * "Resend: <line>" instead, and the following commands are dropped until
+ * the command with that line number is received, so that the host can
+ * simply continue sending from that line. Unnumbered commands dropped this
+ * way are answered with an error and "ok", as they will not be resent.
+ */
 template <typename ModuleArg>
 class SerialModule {
     APRINTER_UNPACK_MODULE_ARG(ModuleArg)
@@ -58,6 +73,8 @@ private:
     
     static_assert(SendSizeType::maxIntValue() >= ThePrinterMain::CommandSendBufClearance, "Serial send buffer is too small");
     
+    static size_t const RecvBufferSize = (size_t)1 << Params::RecvBufferSizeExp;
+    
 public:
     static void init (Context c)
     {
@@ -67,6 +84,8 @@ public:
         o->command_stream.init(c, &o->callback, &o->callback);
         o->m_recv_next_error = 0;
         o->m_line_number = 1;
+        o->m_windowed = false;
+        o->m_resync = false;
     }
     
     static void deinit (Context c)
@@ -95,6 +114,10 @@ private:
             bool is_m110 = (o->gcode_parser.getCmdCode(c) == 'M' && o->gcode_parser.getCmdNumber(c) == 110);
             if (is_m110) {
                 o->m_line_number = o->command_stream.get_command_param_uint32(c, 'L', (o->gcode_parser.getCmd(c)->have_line_number ? o->gcode_parser.getCmd(c)->line_number : (uint32_t)-1));
+                if (o->command_stream.find_command_param(c, 'W', nullptr)) {
+                    set_windowed(c, o->command_stream.get_command_param_uint32(c, 'W', 0) != 0);
+                }
+                o->m_resync = false;
             }
             if (o->gcode_parser.getCmd(c)->have_line_number) {
                 if (o->gcode_parser.getCmd(c)->line_number != o->m_line_number) {
@@ -113,11 +136,23 @@ private:
             return true;
         }
         
-        void finish_command_impl (Context c)
+        void finish_command_impl (Context c, bool no_ok)
         {
             auto *o = Object::self(c);
             AMBRO_ASSERT(o->command_stream.hasCommand(c))
             
+            // Commands which write their own ok reply (e.g. M105) finish with no_ok,
+            // that reply is then the acknowledgement, without the line number.
+            if (o->m_windowed && !no_ok) {
+                o->command_stream.reply_append_pstr(c, AMBRO_PSTR("ok"));
+                if (o->gcode_parser.getCmd(c)->have_line_number) {
+                    o->command_stream.reply_append_pstr(c, AMBRO_PSTR(" N"));
+                    o->command_stream.reply_append_uint32(c, o->gcode_parser.getCmd(c)->line_number);
+                }
+                o->command_stream.reply_append_ch(c, '\n');
+                TheSerial::sendPoke(c);
+            }
+            
             TheSerial::recvConsume(c, RecvSizeType::import(o->gcode_parser.getLength(c)));
             TheSerial::recvForceEvent(c);
         }
@@ -194,6 +229,11 @@ private:
         bool overrun;
         RecvSizeType avail = TheSerial::recvQuery(c, &overrun);
         if (o->gcode_parser.extendCommand(c, avail.value())) {
+            if (o->m_windowed && !check_windowed_command(c)) {
+                TheSerial::recvConsume(c, RecvSizeType::import(o->gcode_parser.getLength(c)));
+                TheSerial::recvForceEvent(c);
+                return;
+            }
             return o->command_stream.startCommand(c, &o->gcode_parser);
         }
         if (overrun) {
@@ -205,6 +245,58 @@ private:
     }
     struct SerialRecvHandler : public AMBRO_WFUNC_TD(&SerialModule::serial_recv_handler) {};
     
+    static void set_windowed (Context c, bool windowed)
+    {
+        auto *o = Object::self(c);
+        
+        o->m_windowed = windowed;
+        o->command_stream.setAutoOkAndPoke(c, !windowed);
+        if (windowed) {
+            o->command_stream.reply_append_pstr(c, AMBRO_PSTR("RecvBuffer:"));
+            o->command_stream.reply_append_uint32(c, RecvBufferSize);
+            o->command_stream.reply_append_ch(c, '\n');
+        }
+    }
+    
+    // Decides whether a received command is to be executed when the windowed
+    // protocol is used. If not, it is dropped, requesting the resend of the
+    // expected line unless this has already been done. Another request is
+    // only made when the expected line itself is received broken.
+    static bool check_windowed_command (Context c)
+    {
+        auto *o = Object::self(c);
+        auto *cmd = o->gcode_parser.getCmd(c);
+        
+        auto num_parts = o->gcode_parser.getNumParts(c);
+        if (num_parts == GCODE_ERROR_NO_PARTS) {
+            return true;
+        }
+        
+        bool is_expected = cmd->have_line_number && cmd->line_number == o->m_line_number;
+        if (num_parts >= 0) {
+            bool is_m110 = (o->gcode_parser.getCmdCode(c) == 'M' && o->gcode_parser.getCmdNumber(c) == 110);
+            if (is_expected || is_m110 || (!cmd->have_line_number && !o->m_resync)) {
+                o->m_resync = false;
+                return true;
+            }
+            if (!cmd->have_line_number) {
+                o->command_stream.reply_append_error(c, AMBRO_PSTR("ResendPending"));
+                o->command_stream.reply_append_pstr(c, AMBRO_PSTR("ok\n"));
+                TheSerial::sendPoke(c);
+                return false;
+            }
+        }
+        
+        if (!o->m_resync || is_expected) {
+            o->m_resync = true;
+            o->command_stream.reply_append_pstr(c, AMBRO_PSTR("Resend: "));
+            o->command_stream.reply_append_uint32(c, o->m_line_number);
+            o->command_stream.reply_append_ch(c, '\n');
+            TheSerial::sendPoke(c);
+        }
+        return false;
+    }
+    
     static void serial_send_handler (Context c)
     {
         auto *o = Object::self(c);
@@ -221,6 +313,8 @@ public:
         StreamCallback callback;
         int8_t m_recv_next_error;
         uint32_t m_line_number;
+        bool m_windowed;
+        bool m_resync;
     };
 };
 
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_STEP_TRACE_MODULE_H
+#define APRINTER_STEP_TRACE_MODULE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/ListForEach.h>
+#include <aprinter/meta/MinMax.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/ProgramMemory.h>
+#include <aprinter/printer/ServiceList.h>
+#include <aprinter/printer/utils/WebRequest.h>
+#include <aprinter/printer/utils/ModuleUtils.h>
+
+#ifndef AXISDRIVER_STEP_TRACE
+#error "StepTraceModule requires AXISDRIVER_STEP_TRACE"
+#endif
+
+namespace APrinter {
+
+/*
+ * Drains the step traces recorded by the axis drivers (AXISDRIVER_STEP_TRACE).
+ *
+ * The trace of an axis is a sequence of binary records, each being the
+ * clock time of the event (little endian, sizeof(TimeType) bytes) followed
+ * by the flags byte (bit 0: step, bit 1: direction). These are transferred
+ * hex encoded, at most ChunkEntries records per chunk.
+ *
+ * M950 prints lines "<axis> <hex>" followed by "<axis> dropped <count>"
+ * for each axis. The rr_steptrace web request returns the same as JSON:
+ * {"entryBytes":N,"axes":[{"axis":"X","data":["<hex>",...],"dropped":N},...]}.
+ * Each request drains what has been recorded, the dropped count is the
+ * number of events which did not fit into the buffer since the last request.
+ */
+
+template <typename ModuleArg>
+class StepTraceModule {
+    APRINTER_UNPACK_MODULE_ARG(ModuleArg)
+    
+public:
+    struct Object;
+    
+private:
+    using TheCommand = typename ThePrinterMain::TheCommand;
+    using TimeType = typename Context::Clock::TimeType;
+    
+    static int const NumAxes = ThePrinterMain::NumAxes;
+    static size_t const EntryBytes = sizeof(TimeType) + 1;
+    static size_t const ChunkEntries = 8;
+    static size_t const ChunkHexLength = 2 * EntryBytes * ChunkEntries;
+    static size_t const MaxLineLength = 32 + ChunkHexLength;
+    
+    static char encode_hex_digit (int value)
+    {
+        return (value < 10) ? ('0' + value) : ('A' + (value - 10));
+    }
+    
+    template <int AxisIndex>
+    struct AxisHelper {
+        using TheAxisDriver = typename ThePrinterMain::template GetAxisDriver<AxisIndex>;
+        using StepTraceEntry = typename TheAxisDriver::StepTraceEntry;
+        static char const AxisName = ThePrinterMain::template PhysVirtAxisHelper<AxisIndex>::AxisName;
+        
+        static char get_name ()
+        {
+            return AxisName;
+        }
+        
+        static size_t get_size ()
+        {
+            return TheAxisDriver::StepTraceSize;
+        }
+        
+        static size_t read_hex (Context c, size_t max_entries, char *out)
+        {
+            StepTraceEntry entries[ChunkEntries];
+            size_t count = TheAxisDriver::readStepTrace(c, entries, MinValue(max_entries, ChunkEntries));
+            
+            for (size_t i = 0; i < count; i++) {
+                uint8_t bytes[EntryBytes];
+                TimeType time = entries[i].time;
+                for (size_t j = 0; j < sizeof(TimeType); j++) {
+                    bytes[j] = time;
+                    time >>= 8;
+                }
+                bytes[EntryBytes - 1] = entries[i].flags;
+                
+                for (uint8_t byte : bytes) {
+                    *out++ = encode_hex_digit(byte >> 4);
+                    *out++ = encode_hex_digit(byte & 0xF);
+                }
+            }
+            
+            return 2 * EntryBytes * count;
+        }
+        
+        static uint32_t take_dropped (Context c)
+        {
+            return TheAxisDriver::takeStepTraceDropped(c);
+        }
+    };
+    
+    using AxisHelperList = IndexElemListCount<NumAxes, AxisHelper>;
+    
+    static char axis_name (int axis_index)
+    {
+        return ListForOne<AxisHelperList, 0, char>(axis_index, [&] APRINTER_TL(helper, return helper::get_name()));
+    }
+    
+    static size_t axis_trace_size (int axis_index)
+    {
+        return ListForOne<AxisHelperList, 0, size_t>(axis_index, [&] APRINTER_TL(helper, return helper::get_size()));
+    }
+    
+    // Reads the next chunk of an axis trace as hex. The remaining count limits
+    // draining to one buffer worth, so this ends even when the axis is stepping.
+    static size_t axis_read_hex (Context c, int axis_index, size_t *remaining, char *out)
+    {
+        size_t length = ListForOne<AxisHelperList, 0, size_t>(axis_index, [&] APRINTER_TL(helper, return helper::read_hex(c, *remaining, out)));
+        *remaining -= length / (2 * EntryBytes);
+        return length;
+    }
+    
+    static uint32_t axis_take_dropped (Context c, int axis_index)
+    {
+        return ListForOne<AxisHelperList, 0, uint32_t>(axis_index, [&] APRINTER_TL(helper, return helper::take_dropped(c)));
+    }
+    
+public:
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        o->dumping = false;
+    }
+    
+    static bool check_command (Context c, TheCommand *cmd)
+    {
+        if (cmd->getCmdNumber(c) == 950) {
+            handle_dump_command(c, cmd);
+            return false;
+        }
+        return true;
+    }
+    
+private:
+    static void handle_dump_command (Context c, TheCommand *cmd)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(!o->dumping)
+        
+        if (!cmd->tryLockedCommand(c)) {
+            return;
+        }
+        
+        o->dumping = true;
+        o->axis_index = 0;
+        o->remaining = axis_trace_size(0);
+        
+        return request_send_buf(c, cmd);
+    }
+    
+    static void request_send_buf (Context c, TheCommand *cmd)
+    {
+        auto *o = Object::self(c);
+        
+        if (!cmd->requestSendBufEvent(c, MaxLineLength, &StepTraceModule::send_buf_event_handler)) {
+            cmd->reportError(c, AMBRO_PSTR("SendBufRequestFailed"));
+            o->dumping = false;
+            return cmd->finishCommand(c);
+        }
+    }
+    
+    static void send_buf_event_handler (Context c)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(o->dumping)
+        
+        auto *cmd = ThePrinterMain::get_locked(c);
+        
+        char hex[ChunkHexLength];
+        size_t length = (o->remaining > 0) ? axis_read_hex(c, o->axis_index, &o->remaining, hex) : 0;
+        
+        cmd->reply_append_ch(c, axis_name(o->axis_index));
+        if (length > 0) {
+            cmd->reply_append_ch(c, ' ');
+            cmd->reply_append_buffer(c, hex, length);
+            cmd->reply_append_ch(c, '\n');
+        } else {
+            cmd->reply_append_pstr(c, AMBRO_PSTR(" dropped "));
+            cmd->reply_append_uint32(c, axis_take_dropped(c, o->axis_index));
+            cmd->reply_append_ch(c, '\n');
+            
+            o->axis_index++;
+            if (o->axis_index == NumAxes) {
+                o->dumping = false;
+                return cmd->finishCommand(c);
+            }
+            o->remaining = axis_trace_size(o->axis_index);
+        }
+        cmd->reply_poke(c);
+        
+        return request_send_buf(c, cmd);
+    }
+    
+public:
+    template <typename WebApiConfig>
+    struct WebApi {
+        static bool handle_web_request (Context c, MemRef req_type, WebRequest<Context> *request)
+        {
+            if (req_type.equalTo("steptrace")) {
+                return request->template acceptRequest<StepTraceRequest>(c);
+            }
+            return true;
+        }
+        
+        class StepTraceRequest : public WebRequestHandler<Context, StepTraceRequest> {
+            static_assert(ChunkHexLength + 64 <= WebApiConfig::JsonBufferSize, "");
+            
+        public:
+            void init (Context c)
+            {
+                JsonBuilder *json = this->startJson(c);
+                json->startObject();
+                json->addSafeKeyVal("entryBytes", JsonUint32{EntryBytes});
+                json->addKeyArray(JsonString{"axes"});
+                this->endJson(c);
+                
+                m_axis_index = 0;
+                m_axis_started = false;
+                this->waitForJsonBuffer(c);
+            }
+            
+            void jsonBufferAvailable (Context c)
+            {
+                JsonBuilder *json = this->startJson(c);
+                
+                if (m_axis_index == NumAxes) {
+                    json->endArray();
+                    json->endObject();
+                    this->endJson(c);
+                    return this->completeHandling(c);
+                }
+                
+                if (!m_axis_started) {
+                    m_axis_started = true;
+                    m_remaining = axis_trace_size(m_axis_index);
+                    json->startObject();
+                    json->addSafeKeyVal("axis", JsonSafeChar{axis_name(m_axis_index)});
+                    json->addKeyArray(JsonString{"data"});
+                }
+                
+                char hex[ChunkHexLength];
+                size_t length = (m_remaining > 0) ? axis_read_hex(c, m_axis_index, &m_remaining, hex) : 0;
+                
+                if (length > 0) {
+                    json->add(JsonString{MemRef(hex, length)});
+                } else {
+                    json->endArray();
+                    json->addSafeKeyVal("dropped", JsonUint32{axis_take_dropped(c, m_axis_index)});
+                    json->endObject();
+                    m_axis_index++;
+                    m_axis_started = false;
+                }
+                
+                if (!this->endJson(c)) {
+                    return this->completeHandling(c);
+                }
+                
+                this->waitForJsonBuffer(c);
+            }
+            
+        private:
+            int m_axis_index;
+            bool m_axis_started;
+            size_t m_remaining;
+        };
+        
+        using WebApiRequestHandlers = MakeTypeList<StepTraceRequest>;
+    };
+    
+public:
+    struct Object : public ObjBase<StepTraceModule, ParentObject, EmptyTypeList> {
+        bool dumping;
+        int axis_index;
+        size_t remaining;
+    };
+};
+
+struct StepTraceModuleService {
+    APRINTER_MODULE_TEMPLATE(StepTraceModuleService, StepTraceModule)
+    using ProvidedServices = MakeTypeList<ServiceDefinition<ServiceList::WebApiHandlerService>>;
+};
+
+}
+
+#endif
@@ -302,7 +302,7 @@ private:
             }
         }
         
-        void finish_command_impl (Context c) override
+        void finish_command_impl (Context c, bool no_ok) override
         {
             AMBRO_ASSERT(state_not_disconnected(m_state))
             
@@ -944,7 +944,7 @@ private:
             }
         }
         
-        void finish_command_impl (Context c) override
+        void finish_command_impl (Context c, bool no_ok) override
         {
             AMBRO_ASSERT(m_state == OneOf(State::ATTACHED, State::FINISHING))
             
@@ -63,6 +63,29 @@ struct LinearPlanner {
         segment->a_x_rec = 1.0f / a_x;
     }
     
+    // Updates the speed limits of an initialized segment, keeping its acceleration.
+    static void changeMaxV (SegmentData *segment, FpType prev_max_v, FpType max_start_v, FpType max_v)
+    {
+        AMBRO_ASSERT(FloatIsPosOrPosZero(prev_max_v))
+        AMBRO_ASSERT(FloatIsPosOrPosZero(max_start_v))
+        AMBRO_ASSERT(FloatIsPosOrPosZero(max_v))
+        
+        segment->max_v = max_v;
+        segment->max_start_v = FloatMin(prev_max_v, FloatMin(max_start_v, max_v));
+    }
+    
+    // Allows only the given fraction of the speed change that the acceleration
+    // permits over the segment. The fractions returned by pull() are still those
+    // of phases at the full acceleration, so at least the rest of the segment is
+    // left at constant speed.
+    static void limitSpeedChange (SegmentData *segment, FpType fraction)
+    {
+        AMBRO_ASSERT(FloatIsPosOrPosZero(fraction))
+        AMBRO_ASSERT(fraction <= 1.0f)
+        
+        segment->a_x *= fraction;
+    }
+    
     static FpType push (SegmentData *segment, SegmentState *s, FpType end_v)
     {
         AMBRO_ASSERT(FloatIsPosOrPosZero(segment->a_x))
@@ -88,7 +111,7 @@ struct LinearPlanner {
         FpType start_v_plus_a_x = start_v + segment->a_x;
         if (end_v > start_v_plus_a_x) {
             end_v = start_v_plus_a_x;
-            result->const_start = 1.0f;
+            result->const_start = segment->a_x * segment->a_x_rec;
             result->const_end = 0.0f;
             result->const_v = end_v;
         } else {
@@ -99,7 +122,7 @@ struct LinearPlanner {
                 result->const_v = segment->max_v;
             } else {
                 result->const_start = (half_start_v_plus_a_x_plus_end_v - start_v) * segment->a_x_rec;
-                result->const_end = 1.0f - result->const_start;
+                result->const_end = (half_start_v_plus_a_x_plus_end_v - end_v) * segment->a_x_rec;
                 result->const_v = half_start_v_plus_a_x_plus_end_v;
             }
         }
@@ -45,6 +45,8 @@
 #include <aprinter/meta/MemberType.h>
 #include <aprinter/meta/MinMax.h>
 #include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/StructIf.h>
+#include <aprinter/meta/BasicMetaUtils.h>
 #include <aprinter/base/Object.h>
 #include <aprinter/base/Assert.h>
 #include <aprinter/base/Hints.h>
@@ -56,6 +58,40 @@
 
 namespace APrinter {
 
+struct MotionPlannerNoInputShaper {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(MotionPlannerInputShaper, (
+    APRINTER_AS_TYPE(Type),
+    APRINTER_AS_TYPE(Frequency),
+    APRINTER_AS_TYPE(Damping)
+), (
+    static bool const Enabled = true;
+))
+
+struct MotionPlannerNoPressureAdvance {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(MotionPlannerPressureAdvance, (
+    APRINTER_AS_TYPE(K),
+    APRINTER_AS_TYPE(SmoothTime)
+), (
+    static bool const Enabled = true;
+))
+
+struct MotionPlannerNoJunctionDeviation {
+    static bool const Enabled = false;
+};
+
+APRINTER_ALIAS_STRUCT_EXT(MotionPlannerJunctionDeviation, (
+    APRINTER_AS_TYPE(Deviation),
+    APRINTER_AS_VALUE(uint32_t, CartesianAxesMask)
+), (
+    static bool const Enabled = true;
+))
+
 APRINTER_ALIAS_STRUCT(MotionPlannerAxisSpec, (
     APRINTER_AS_TYPE(TheAxisDriver),
     APRINTER_AS_VALUE(int, StepBits),
@@ -63,6 +99,10 @@ APRINTER_ALIAS_STRUCT(MotionPlannerAxisSpec, (
     APRINTER_AS_TYPE(CorneringDistance),
     APRINTER_AS_TYPE(MaxSpeedRec),
     APRINTER_AS_TYPE(MaxAccelRec),
+    APRINTER_AS_TYPE(MaxJerkRec),
+    APRINTER_AS_TYPE(StepsPerUnit),
+    APRINTER_AS_TYPE(InputShaper),
+    APRINTER_AS_TYPE(PressureAdvance),
     APRINTER_AS_TYPE(PrestepCallback)
 ))
 
@@ -95,7 +135,9 @@ class MotionPlanner {
     static int const StepperSegmentBufferSize = Arg::StepperSegmentBufferSize;
     static int const LookaheadBufferSize      = Arg::LookaheadBufferSize;
     static int const LookaheadCommitCount     = Arg::LookaheadCommitCount;
+    static int const MinLookaheadCommitCount  = Arg::MinLookaheadCommitCount;
     using FpType                              = typename Arg::FpType;
+    using PlannerFpType                       = typename Arg::PlannerFpType;
     using MaxStepsPerCycle                    = typename Arg::MaxStepsPerCycle;
     using PullHandler                         = typename Arg::PullHandler;
     using FinishedHandler                     = typename Arg::FinishedHandler;
@@ -103,6 +145,8 @@ class MotionPlanner {
     using UnderrunCallback                    = typename Arg::UnderrunCallback;
     using ParamsChannelsList                  = typename Arg::ParamsChannelsList;
     using ParamsLasersList                    = typename Arg::ParamsLasersList;
+    static bool const JerkLimitEnabled        = Arg::JerkLimitEnabled;
+    using JunctionDeviationParams             = typename Arg::JunctionDeviationParams;
     
 public:
     struct Object;
@@ -112,23 +156,28 @@ private:
     static_assert(LookaheadBufferSize >= 2, "");
     static_assert(LookaheadCommitCount >= 1, "");
     static_assert(LookaheadCommitCount < LookaheadBufferSize, "");
+    static_assert(MinLookaheadCommitCount >= 1, "");
+    static_assert(MinLookaheadCommitCount <= LookaheadCommitCount, "");
     using Loop = typename Context::EventLoop;
     using Clock = typename Context::Clock;
     using TimeType = typename Clock::TimeType;
     static const int NumAxes = TypeListLength<ParamsAxesList>::Value;
     static_assert(NumAxes > 0, "");
     static const int NumChannels = TypeListLength<ParamsChannelsList>::Value;
+    static const int NumLasers = TypeListLength<ParamsLasersList>::Value;
     using SegmentBufferSizeType = ChooseIntForMax<2 * LookaheadBufferSize, false>; // twice for segments_add()
-    static const size_t StepperCommitBufferSize = 3 * StepperSegmentBufferSize;
-    static const size_t StepperBackupBufferSize = 3 * (LookaheadBufferSize - LookaheadCommitCount);
-    using StepperCommitBufferSizeType = ChooseIntForMax<StepperCommitBufferSize, false>;
-    using StepperBackupBufferSizeType = ChooseIntForMax<2 * StepperBackupBufferSize, false>;
     using StepperFastEvent = typename Context::EventLoop::template FastEventSpec<MotionPlanner>;
     using CallbackFastEvent = typename Context::EventLoop::template FastEventSpec<StepperFastEvent>;
     static const int TypeBits = BitsInInt<NumChannels>::Value;
     using AxisMaskType = ChooseInt<NumAxes + TypeBits, false>;
     static const AxisMaskType TypeMask = ((AxisMaskType)1 << TypeBits) - 1;
-    using TheLinearPlanner = LinearPlanner<FpType>;
+    using CommitMaskType = ChooseInt<NumAxes + NumLasers, false>;
+    template <typename TheAxisSpec, typename AccumEnabled>
+    using InputShaperEnabledFoldFunc = WrapBool<(AccumEnabled::Value || TheAxisSpec::InputShaper::Enabled)>;
+    static bool const InputShaperEnabled = TypeListFold<ParamsAxesList, WrapBool<false>, InputShaperEnabledFoldFunc>::Value;
+    static bool const RampExtensionEnabled = (JerkLimitEnabled || InputShaperEnabled);
+    static int const MaxRampImpulses = 3;
+    using TheLinearPlanner = LinearPlanner<PlannerFpType>;
     using Constants = MotionPlannerConstants<Context>;
     
     using MinSecondsPerStep = decltype(ExprRec(MaxStepsPerCycle() * typename Constants::FCpu()));
@@ -230,10 +279,21 @@ private:
         SegmentLasersTuple * lasers () { return this; };
     };
     
-    struct SegmentAxesPart : public SegmentAxesHelper, public SegmentLasersHelper {
+    AMBRO_STRUCT_IF(SegmentRampPart, RampExtensionEnabled) {
+        FpType jerk_time;
+        FpType shaper_time;
+        FpType shaper_offset;
+        FpType distance_rec;
+    };
+    
+    struct SegmentAxesPart : public SegmentAxesHelper, public SegmentLasersHelper, public SegmentRampPart {
         typename TheLinearPlanner::SegmentData lp_seg;
         FpType max_accel_rec;
         FpType rel_max_speed_rec;
+        FpType feed_rel_max_speed_rec;
+        FpType limit_rel_max_speed_rec;
+        FpType distance_squared;
+        PlannerFpType junction_max_start_v;
     };
     
     struct Segment {
@@ -246,19 +306,36 @@ private:
     
     enum {STATE_BUFFERING, STATE_STEPPING, STATE_ABORTED};
     
-    template <typename TheAxis>
+    template <typename TheAxis, int CommandsPerSegment>
     struct AxisCommon {
         struct Object;
+        static const size_t StepperCommitBufferSize = CommandsPerSegment * StepperSegmentBufferSize;
+        static const size_t StepperBackupBufferSize = CommandsPerSegment * (LookaheadBufferSize - MinLookaheadCommitCount);
+        using StepperCommitBufferSizeType = ChooseIntForMax<StepperCommitBufferSize, false>;
+        using StepperBackupBufferSizeType = ChooseIntForMax<2 * StepperBackupBufferSize, false>;
         using TheStepper = typename TheAxis::TheStepper;
         using StepperCommand = typename TheStepper::Command;
         using StepperCommandCallbackContext = typename TheStepper::CommandCallbackContext;
         using ComputeState = typename TheAxis::ComputeState;
+        static CommitMaskType const CommitMask = (CommitMaskType)1 << TheAxis::CommonIndex;
+        
+        // The stepper ISR consumes commands up to its own copy of the extent,
+        // only adopting the most recently published one (m_published[!m_current_backup])
+        // once it runs out of commands. Hence do_commit() can publish the new extent
+        // without locking, and the commit itself only needs to set m_commit_fresh.
+        struct CommitExtent {
+            StepperCommitBufferSizeType commit_end;
+            StepperBackupBufferSizeType backup_start;
+            StepperBackupBufferSizeType backup_end;
+        };
         
         static void init (Context c, bool prestep_callback_enabled)
         {
             auto *o = Object::self(c);
             o->m_commit_start = 0;
-            o->m_commit_end = 0;
+            o->m_extent = CommitExtent{0, 0, 0};
+            o->m_published[0] = o->m_extent;
+            o->m_published[1] = o->m_extent;
             o->m_busy = false;
             TheAxis::init_impl(c, prestep_callback_enabled);
         }
@@ -309,14 +386,21 @@ private:
         static bool have_commit_space (bool accum, Context c)
         {
             auto *o = Object::self(c);
-            return (accum && commit_avail(o->m_commit_start, o->m_commit_end) >= 3 * LookaheadCommitCount);
+            return (accum && commit_avail(o->m_commit_start, published_extent(c)->commit_end) >= CommandsPerSegment * AdaptiveCommitFeature::get_commit_count(c));
+        }
+        
+        static CommitExtent * published_extent (Context c)
+        {
+            auto *o = Object::self(c);
+            auto *m = MotionPlanner::Object::self(c);
+            return &o->m_published[!m->m_current_backup];
         }
         
         static void start_commands (Context c)
         {
             auto *o = Object::self(c);
             auto *m = MotionPlanner::Object::self(c);
-            o->m_new_commit_end = o->m_commit_end;
+            o->m_new_commit_end = published_extent(c)->commit_end;
             o->m_new_backup_end = m->m_current_backup ? 0 : StepperBackupBufferSize;
         }
         
@@ -341,9 +425,10 @@ private:
         {
             auto *o = Object::self(c);
             auto *m = MotionPlanner::Object::self(c);
-            o->m_commit_end = o->m_new_commit_end;
-            o->m_backup_start = m->m_current_backup ? 0 : StepperBackupBufferSize;
-            o->m_backup_end = o->m_new_backup_end;
+            CommitExtent *ext = &o->m_published[m->m_current_backup];
+            ext->commit_end = o->m_new_commit_end;
+            ext->backup_start = m->m_current_backup ? 0 : StepperBackupBufferSize;
+            ext->backup_end = o->m_new_backup_end;
         }
         
         static void start_stepping (Context c, TimeType start_time)
@@ -352,7 +437,8 @@ private:
             auto *m = MotionPlanner::Object::self(c);
             AMBRO_ASSERT(!o->m_busy)
             
-            if (o->m_commit_start != o->m_commit_end) {
+            o->m_extent = *published_extent(c);
+            if (o->m_commit_start != o->m_extent.commit_end) {
                 if (TheAxis::IsFirst) {
                     // Only first axis sets it so it doesn't get re-set after a fast underflow.
                     // Can't happen anyway due to the start time offset.
@@ -379,19 +465,27 @@ private:
             AMBRO_ASSERT(m->m_state == STATE_STEPPING)
             
             Context::EventLoop::template triggerFastEvent<StepperFastEvent>(c);
-            if (AMBRO_UNLIKELY(o->m_commit_start != o->m_commit_end)) {
+            if (AMBRO_UNLIKELY(o->m_commit_start == o->m_extent.commit_end)) {
+                AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+                    if ((m->m_commit_fresh & CommitMask)) {
+                        m->m_commit_fresh &= ~CommitMask;
+                        o->m_extent = o->m_published[!m->m_current_backup];
+                    }
+                    if (o->m_commit_start == o->m_extent.commit_end) {
+                        m->m_syncing = false;
+                    }
+                }
+            }
+            if (AMBRO_LIKELY(o->m_commit_start != o->m_extent.commit_end)) {
                 *cmd = &o->m_commit_buffer[o->m_commit_start];
                 o->m_commit_start = commit_inc(o->m_commit_start);
             } else {
-                AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
-                    m->m_syncing = false;
-                }
-                if (o->m_backup_start == o->m_backup_end) {
+                if (o->m_extent.backup_start == o->m_extent.backup_end) {
                     o->m_busy = false;
                     return false;
                 }
-                *cmd = &o->m_backup_buffer[o->m_backup_start];
-                o->m_backup_start++;
+                *cmd = &o->m_backup_buffer[o->m_extent.backup_start];
+                o->m_extent.backup_start++;
             }
             return true;
         }
@@ -414,9 +508,8 @@ private:
             TheAxis
         >> {
             StepperCommitBufferSizeType m_commit_start;
-            StepperCommitBufferSizeType m_commit_end;
-            StepperBackupBufferSizeType m_backup_start;
-            StepperBackupBufferSizeType m_backup_end;
+            CommitExtent m_extent;
+            CommitExtent m_published[2];
             StepperCommitBufferSizeType m_new_commit_end;
             StepperBackupBufferSizeType m_new_backup_end;
             bool m_busy;
@@ -439,9 +532,13 @@ public:
         friend MotionPlanner;
         
         struct Object;
-        using TheCommon = AxisCommon<Axis>;
+        static int const CommandsPerRamp = RampExtensionEnabled ? (2 * MaxRampImpulses) : 1; // accel/decel phases may be split
+        static int const CommandsPerAdvancePhase = 5; // see PressureAdvanceFeature::gen_piece
+        static int const CommandsPerSegment = AxisSpec::PressureAdvance::Enabled ? MaxValue(3 * CommandsPerAdvancePhase, 2 * CommandsPerRamp + 1) : (2 * CommandsPerRamp + 1);
+        using TheCommon = AxisCommon<Axis, CommandsPerSegment>;
         using TheStepper = TheAxisDriver;
         static bool const IsFirst = (AxisIndex == 0);
+        static int const CommonIndex = AxisIndex;
         using StepperStepFixedType = typename TheAxisDriver::StepFixedType;
         using TheAxisSegment = AxisSegment<AxisIndex>;
         static const AxisMaskType TheAxisMask = (AxisMaskType)1 << (AxisIndex + TypeBits);
@@ -457,6 +554,7 @@ public:
             auto *o = Object::self(c);
             TheAxisDriver::setPrestepCallbackEnabled(c, prestep_callback_enabled);
             o->last_x_by_distance = 0.0f;
+            PressureAdvanceFeature::reset_staging(c);
         }
         
         static void deinit_impl (Context c)
@@ -549,7 +647,35 @@ public:
         static FpType compute_segment_buffer_entry_accel (AccumType accum, Context c, TheComputeStateTuple const *cst)
         {
             ComputeState const *cs = TupleFindElem<ComputeState>(cst);
-            return FloatMax(accum, cs->x * APRINTER_CFG(Config, CMaxAccelRec, c));
+            return FloatMax(accum, cs->x * PressureAdvanceFeature::get_max_accel_rec(c));
+        }
+        
+        template <typename TheComputeStateTuple>
+        static FpType compute_segment_buffer_entry_advance_speed (FpType accum, Context c, TheComputeStateTuple const *cst, FpType rel_max_accel_rec)
+        {
+            ComputeState const *cs = TupleFindElem<ComputeState>(cst);
+            return PressureAdvanceFeature::limit_speed(accum, c, cs->x, rel_max_accel_rec);
+        }
+        
+        template <typename AccumType, typename TheComputeStateTuple>
+        static FpType compute_segment_buffer_entry_jerk (AccumType accum, Context c, TheComputeStateTuple const *cst)
+        {
+            ComputeState const *cs = TupleFindElem<ComputeState>(cst);
+            return FloatMax(accum, cs->x * APRINTER_CFG(Config, CMaxJerkRec, c));
+        }
+        
+        template <typename AccumType, typename TheComputeStateTuple>
+        static FpType compute_segment_buffer_entry_shaper_time (AccumType accum, Context c, TheComputeStateTuple const *cst)
+        {
+            ComputeState const *cs = TupleFindElem<ComputeState>(cst);
+            return (cs->x != 0.0f) ? FloatMax(accum, InputShaperFeature::get_shaper_time(c)) : accum;
+        }
+        
+        template <typename AccumType, typename TheComputeStateTuple>
+        static FpType compute_segment_buffer_entry_shaper_offset (AccumType accum, Context c, TheComputeStateTuple const *cst)
+        {
+            ComputeState const *cs = TupleFindElem<ComputeState>(cst);
+            return (cs->x != 0.0f) ? FloatMin(accum, InputShaperFeature::get_shaper_offset(c)) : accum;
         }
         
         template <typename AccumType, typename TheComputeStateTuple>
@@ -567,8 +693,41 @@ public:
             return FloatMax(accum, dm * APRINTER_CFG(Config, CCorneringSpeedComputationFactor, c));
         }
         
+        template <typename TheComputeStateTuple>
+        static FpType junction_unit_vector (FpType accum, Context c, Segment const *entry, TheComputeStateTuple const *cst, FpType *unit)
+        {
+            if (!(JunctionDeviationParams::CartesianAxesMask & ((uint32_t)1 << AxisIndex))) {
+                unit[AxisIndex] = 0.0f;
+                return accum;
+            }
+            ComputeState const *cs = TupleFindElem<ComputeState>(cst);
+            FpType x = cs->x * APRINTER_CFG(Config, CUnitsPerStep, c);
+            unit[AxisIndex] = (entry->dir_and_type & TheAxisMask) ? -x : x;
+            return accum + x * x;
+        }
+        
+        static FpType junction_accel_rec (FpType accum, Context c, FpType const *junction)
+        {
+            return FloatMax(accum, FloatAbs(junction[AxisIndex]) * APRINTER_CFG(Config, CJunctionAccelRec, c));
+        }
+        
+        static void start_plan (Context c)
+        {
+            PressureAdvanceFeature::start_plan(c);
+        }
+        
+        static void save_staging (Context c)
+        {
+            PressureAdvanceFeature::save_staging(c);
+        }
+        
+        static void reset_staging (Context c)
+        {
+            PressureAdvanceFeature::reset_staging(c);
+        }
+        
         template <typename TheMinTimeType>
-        static void gen_segment_stepper_commands (Context c, Segment *entry, FpType frac_x0, FpType frac_x2, TheMinTimeType t0, TheMinTimeType t2, TheMinTimeType t1, FpType vdiff0_squared, FpType vdiff2_squared)
+        static void gen_segment_stepper_commands (Context c, Segment *entry, FpType frac_x0, FpType frac_x2, TheMinTimeType t0, TheMinTimeType t2, TheMinTimeType t1, FpType ramp0, FpType ramp2, FpType v_end, FpType v_const)
         {
             TheAxisSegment *axis_entry = TupleGetElem<AxisIndex>(entry->axes.axes());
             
@@ -596,19 +755,318 @@ public:
             }
             
             bool dir = entry->dir_and_type & TheAxisMask;
-            FpType accel_conversion = entry->axes.lp_seg.a_x_rec * xfp;
+            FpType accel_conversion = FixedPlanningFeature::export_v_squared_rec(c, entry->axes.lp_seg.a_x_rec) * xfp;
+            
+            if (PressureAdvanceFeature::is_active(c)) {
+                StepperStepFixedType a0 = FixedMin(x0, StepperStepFixedType::importFpSaturatedRound(accel_conversion * ramp0));
+                StepperStepFixedType a2 = FixedMin(x2, StepperStepFixedType::importFpSaturatedRound(accel_conversion * ramp2));
+                return PressureAdvanceFeature::gen_commands(c, entry, dir, xfp, x0, x1, x2, t0, t1, t2, a0, a2, skip1, v_end, v_const);
+            }
             
             if (x0.bitsValue() != 0) {
-                TheCommon::gen_stepper_command(c, dir, x0, t0, FixedMin(x0, StepperStepFixedType::importFpSaturatedRound(accel_conversion * vdiff0_squared)));
+                InputShaperFeature::gen_ramp_commands(c, entry, dir, x0, t0, FixedMin(x0, StepperStepFixedType::importFpSaturatedRound(accel_conversion * ramp0)), false);
             }
             if (!skip1) {
                 TheCommon::gen_stepper_command(c, dir, x1, t1, StepperStepFixedType::importBits(0));
             }
             if (x2.bitsValue() != 0) {
-                TheCommon::gen_stepper_command(c, dir, x2, t2, -FixedMin(x2, StepperStepFixedType::importFpSaturatedRound(accel_conversion * vdiff2_squared)));
+                InputShaperFeature::gen_ramp_commands(c, entry, dir, x2, t2, FixedMin(x2, StepperStepFixedType::importFpSaturatedRound(accel_conversion * ramp2)), true);
             }
         }
         
+        AMBRO_STRUCT_IF(InputShaperFeature, AxisSpec::InputShaper::Enabled) {
+            using ShaperSpec = typename AxisSpec::InputShaper;
+            
+            // Impulses of the shaper are computed from the configured type (1=ZV, 2=MZV, 3=EI,
+            // anything else disables shaping), frequency [Hz] and damping ratio.
+            using Zero = APRINTER_FP_CONST_EXPR(0.0);
+            using Half = APRINTER_FP_CONST_EXPR(0.5);
+            using One = APRINTER_FP_CONST_EXPR(1.0);
+            using TypeZvLimit = APRINTER_FP_CONST_EXPR(1.5);
+            using TypeMzvLimit = APRINTER_FP_CONST_EXPR(2.5);
+            using TypeEiLimit = APRINTER_FP_CONST_EXPR(3.5);
+            using DecayFactor = APRINTER_FP_CONST_EXPR(-M_PI);
+            using MzvDecayFactor = APRINTER_FP_CONST_EXPR(-0.75 * M_PI);
+            using MzvR1Factor = APRINTER_FP_CONST_EXPR(1.0 - M_SQRT1_2);
+            using MzvR2Factor = APRINTER_FP_CONST_EXPR(M_SQRT2 - 1.0);
+            using EiR1Factor = APRINTER_FP_CONST_EXPR(0.2625); // 0.25 * (1 + 0.05) for 5% vibration tolerance
+            using EiR2Factor = APRINTER_FP_CONST_EXPR(0.475); // 0.5 * (1 - 0.05)
+            using MzvDelay2Factor = APRINTER_FP_CONST_EXPR(0.375);
+            using MzvDelay3Factor = APRINTER_FP_CONST_EXPR(0.75);
+            
+            using IsEnabled = decltype(ShaperSpec::Type::e() >= Half() && ShaperSpec::Type::e() < TypeEiLimit() && ShaperSpec::Frequency::e() > Zero() && ShaperSpec::Damping::e() >= Zero() && ShaperSpec::Damping::e() < One());
+            using IsZv = decltype(ShaperSpec::Type::e() < TypeZvLimit());
+            using IsMzv = decltype(ShaperSpec::Type::e() >= TypeZvLimit() && ShaperSpec::Type::e() < TypeMzvLimit());
+            using DampingRoot = decltype(ExprSqrt(One() - ShaperSpec::Damping::e() * ShaperSpec::Damping::e()));
+            using DampedPeriod = decltype(typename Constants::TimeConversion() / (ShaperSpec::Frequency::e() * DampingRoot()));
+            using K = decltype(ExprExp(ExprIf(IsMzv(), MzvDecayFactor(), DecayFactor()) * ShaperSpec::Damping::e() / DampingRoot()));
+            using R1 = decltype(ExprIf(IsZv(), One(), ExprIf(IsMzv(), MzvR1Factor(), EiR1Factor())));
+            using R2 = decltype(K() * ExprIf(IsZv(), One(), ExprIf(IsMzv(), MzvR2Factor(), EiR2Factor())));
+            using R3 = decltype(ExprIf(IsZv(), Zero(), R1() * K() * K()));
+            using RSum = decltype(R1() + R2() + R3());
+            
+            using CShaperEnabled = decltype(ExprCast<bool>(IsEnabled()));
+            using CShaperA1 = decltype(ExprCast<FpType>(R1() / RSum()));
+            using CShaperA2 = decltype(ExprCast<FpType>(R2() / RSum()));
+            using CShaperA3 = decltype(ExprCast<FpType>(R3() / RSum()));
+            using Delay2 = decltype(DampedPeriod() * ExprIf(IsMzv(), MzvDelay2Factor(), Half()));
+            using Delay3 = decltype(DampedPeriod() * ExprIf(IsZv(), Half(), ExprIf(IsMzv(), MzvDelay3Factor(), One())));
+            using MeanDelay = decltype((R2() * Delay2() + R3() * Delay3()) / RSum());
+            
+            using CShaperDelay2 = decltype(ExprCast<FpType>(Delay2()));
+            using CShaperDelay3 = decltype(ExprCast<FpType>(Delay3()));
+            using CShaperTime = decltype(ExprCast<FpType>(ExprIf(IsEnabled(), MeanDelay() + MeanDelay(), Zero())));
+            using CShaperOffset = decltype(ExprCast<FpType>(ExprIf(IsEnabled(), MeanDelay() - Half() * Delay3(), Zero())));
+            
+            // The planner lengthens the phases by twice the mean delay of the impulses
+            // (the time of the shaper for symmetric ones), see RampExtensionFeature.
+            static FpType get_shaper_time (Context c)
+            {
+                return APRINTER_CFG(Config, CShaperTime, c);
+            }
+            
+            // Mean delay of the impulses relative to the middle of the shaper, which
+            // is negative when the amplitudes decay.
+            static FpType get_shaper_offset (Context c)
+            {
+                return APRINTER_CFG(Config, CShaperOffset, c);
+            }
+            
+            // The phase has been lengthened so that the convolved ramp fits in it with
+            // the acceleration within the maximum. If the planner could only lengthen it
+            // by less, the impulses are brought closer together to fit, at the cost of
+            // weaker vibration reduction.
+            template <typename StepFixedType, typename TimeFixedType>
+            static void gen_ramp_commands (Context c, Segment *entry, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel)
+            {
+                if (APRINTER_CFG(Config, CShaperEnabled, c)) {
+                    FpType scale = RampExtensionFeature::get_time_scale(c);
+                    TimeFixedType delay2 = TimeFixedType::importFpSaturatedRound(scale * APRINTER_CFG(Config, CShaperDelay2, c));
+                    TimeFixedType delay3 = TimeFixedType::importFpSaturatedRound(scale * APRINTER_CFG(Config, CShaperDelay3, c));
+                    if (AMBRO_LIKELY(delay3.bitsValue() > 0 && delay3.bitsValue() < t.bitsValue())) {
+                        FpType amplitudes[3] = {APRINTER_CFG(Config, CShaperA1, c), APRINTER_CFG(Config, CShaperA2, c), APRINTER_CFG(Config, CShaperA3, c)};
+                        TimeFixedType delays[3] = {TimeFixedType::importBits(0), FixedMin(delay2, delay3), delay3};
+                        return RampShaper::template gen_shaped_ramp<Axis>(c, dir, x, t, a_abs, decel, 3, amplitudes, delays, RampExtensionFeature::get_offset(c, decel));
+                    }
+                }
+                JerkFeature::template gen_ramp_commands<Axis>(c, entry, dir, x, t, a_abs, decel);
+            }
+            
+            using ConfigExprs = MakeTypeList<CShaperEnabled, CShaperA1, CShaperA2, CShaperA3, CShaperDelay2, CShaperDelay3, CShaperTime, CShaperOffset>;
+        } AMBRO_STRUCT_ELSE(InputShaperFeature) {
+            static FpType get_shaper_time (Context c)
+            {
+                return 0.0f;
+            }
+            
+            static FpType get_shaper_offset (Context c)
+            {
+                return 0.0f;
+            }
+            
+            template <typename StepFixedType, typename TimeFixedType>
+            static void gen_ramp_commands (Context c, Segment *entry, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel)
+            {
+                JerkFeature::template gen_ramp_commands<Axis>(c, entry, dir, x, t, a_abs, decel);
+            }
+            
+            using ConfigExprs = EmptyTypeList;
+        };
+        
+        AMBRO_STRUCT_IF(PressureAdvanceFeature, AxisSpec::PressureAdvance::Enabled) {
+            struct Object;
+            using AdvanceSpec = typename AxisSpec::PressureAdvance;
+            
+            static void start_plan (Context c)
+            {
+                auto *o = Object::self(c);
+                o->offset = o->staging_offset;
+            }
+            
+            static void save_staging (Context c)
+            {
+                auto *o = Object::self(c);
+                o->staging_offset = o->offset;
+            }
+            
+            static void reset_staging (Context c)
+            {
+                auto *o = Object::self(c);
+                o->staging_offset = 0;
+            }
+            
+            static bool is_active (Context c)
+            {
+                return APRINTER_CFG(Config, CAdvanceEnabled, c);
+            }
+            
+            static FpType get_max_accel_rec (Context c)
+            {
+                return APRINTER_CFG(Config, CAdvanceMaxAccelRec, c);
+            }
+            
+            // The velocity added by the advance during a ramp is at most 2*K times the
+            // acceleration of the axis, reduce the speed so that the sum stays in the limit.
+            static FpType limit_speed (FpType accum, Context c, FpType x, FpType rel_max_accel_rec)
+            {
+                if (!is_active(c) || !(x > 0.0f)) {
+                    return accum;
+                }
+                FpType speed_rec = x * APRINTER_CFG(Config, CMaxSpeedRec, c);
+                return FloatMax(accum, speed_rec / (1.0f - 2.0f * APRINTER_CFG(Config, CAdvanceK, c) * speed_rec / rel_max_accel_rec));
+            }
+            
+            // The extruder is driven ahead of its nominal position by K times its velocity.
+            // The offset is brought to its target value at the end of each phase, using the
+            // exact planned velocities so that it returns to zero exactly when the axis stops.
+            template <typename TheMinTimeType>
+            static void gen_commands (Context c, Segment *entry, bool dir, FpType xfp, StepperStepFixedType x0, StepperStepFixedType x1, StepperStepFixedType x2, TheMinTimeType t0, TheMinTimeType t1, TheMinTimeType t2, StepperStepFixedType a0, StepperStepFixedType a2, bool skip1, FpType v_end, FpType v_const)
+            {
+                FpType offset_conversion = APRINTER_CFG(Config, CAdvanceK, c) * xfp * FloatLdexp(FixedPlanningFeature::export_v_squared_rec(c, entry->axes.lp_seg.a_x_rec) / entry->axes.max_accel_rec, 1);
+                FpType offset_const = offset_conversion * v_const;
+                FpType offset_end = offset_conversion * v_end;
+                bool have1 = !skip1;
+                bool have2 = (x2.bitsValue() != 0);
+                
+                if (x0.bitsValue() != 0) {
+                    gen_phase_commands(c, dir, x0, t0, a0, false, (have1 || have2) ? offset_const : offset_end);
+                }
+                if (have1) {
+                    gen_phase_commands(c, dir, x1, t1, StepperStepFixedType::importBits(0), false, have2 ? offset_const : offset_end);
+                }
+                if (have2) {
+                    gen_phase_commands(c, dir, x2, t2, a2, true, offset_end);
+                }
+            }
+            
+            // Adds the change of the offset to the phase as a velocity bump with linear
+            // ramps of the smoothing time, which results in at most three pieces.
+            template <typename TimeFixedType>
+            static void gen_phase_commands (Context c, bool dir, StepperStepFixedType x, TimeFixedType t, StepperStepFixedType a_abs, bool decel, FpType offset_target)
+            {
+                auto *o = Object::self(c);
+                
+                int32_t target = (int32_t)FloatRound(dir ? offset_target : -offset_target);
+                int32_t delta = target - o->offset;
+                if (delta == 0 || t.bitsValue() < 2) {
+                    // Too short to carry the change, it will be made up in the next phase.
+                    if (decel) {
+                        return TheCommon::gen_stepper_command(c, dir, x, t, -a_abs);
+                    } else {
+                        return TheCommon::gen_stepper_command(c, dir, x, t, a_abs);
+                    }
+                }
+                o->offset = target;
+                
+                FpType sign = dir ? 1.0f : -1.0f;
+                FpType tf = t.bitsValue();
+                FpType xf = x.bitsValue();
+                FpType af = decel ? -(FpType)a_abs.bitsValue() : (FpType)a_abs.bitsValue();
+                FpType v = sign * (xf - af) / tf;
+                FpType accel = sign * FloatLdexp(af, 1) / (tf * tf);
+                
+                auto ts_bits = MinValue(t.bitsValue() / 2, TimeFixedType::importFpSaturatedRound(APRINTER_CFG(Config, CAdvanceSmoothTicks, c)).bitsValue());
+                FpType ts = ts_bits;
+                FpType bump_v = delta / (tf - ts);
+                FpType bump_accel = bump_v / ts;
+                
+                PieceState st;
+                st.pos = 0.0f;
+                st.pos_steps = 0;
+                st.end_steps = (dir ? (int32_t)x.bitsValue() : -(int32_t)x.bitsValue()) + delta;
+                st.splits_left = 2;
+                gen_piece(c, &st, &v, accel + bump_accel, TimeFixedType::importBits(ts_bits), false);
+                gen_piece(c, &st, &v, accel, TimeFixedType::importBits(t.bitsValue() - 2 * ts_bits), false);
+                gen_piece(c, &st, &v, accel - bump_accel, TimeFixedType::importBits(ts_bits), true);
+            }
+            
+            struct PieceState {
+                FpType pos;
+                int32_t pos_steps;
+                int32_t end_steps;
+                int splits_left;
+            };
+            
+            // Pieces where the velocity changes sign are split, giving commands in the
+            // opposite direction. At the ends of the phase the velocity has the direction
+            // of the phase, so this happens at most twice.
+            template <typename TimeFixedType>
+            static void gen_piece (Context c, PieceState *st, FpType *v, FpType accel, TimeFixedType d, bool last)
+            {
+                if (d.bitsValue() == 0) {
+                    return;
+                }
+                if (st->splits_left > 0 && accel != 0.0f) {
+                    FpType t_zero = FloatRound(-*v / accel);
+                    if (t_zero > 0.0f && t_zero < (FpType)d.bitsValue()) {
+                        st->splits_left--;
+                        auto d1 = TimeFixedType::importFpSaturatedRound(t_zero);
+                        gen_piece_command(c, st, v, accel, d1, false);
+                        d.m_bits.m_int -= d1.bitsValue();
+                    }
+                }
+                gen_piece_command(c, st, v, accel, d, last);
+            }
+            
+            template <typename TimeFixedType>
+            static void gen_piece_command (Context c, PieceState *st, FpType *v, FpType accel, TimeFixedType d, bool last)
+            {
+                FpType df = d.bitsValue();
+                FpType half_accel_d2 = 0.5f * accel * df * df;
+                st->pos += *v * df + half_accel_d2;
+                *v += accel * df;
+                int32_t new_steps = last ? st->end_steps : (int32_t)FloatRound(st->pos);
+                int32_t steps = new_steps - st->pos_steps;
+                st->pos_steps = new_steps;
+                
+                bool cmd_dir = (steps >= 0);
+                auto cmd_x = StepperStepFixedType::importBits(MinValue((uint32_t)(cmd_dir ? steps : -steps), (uint32_t)StepperStepFixedType::maxValue().bitsValue()));
+                FpType cmd_a = cmd_dir ? half_accel_d2 : -half_accel_d2;
+                auto cmd_a_abs = FixedMin(cmd_x, StepperStepFixedType::importFpSaturatedRound(FloatAbs(cmd_a)));
+                if (cmd_a < 0.0f) {
+                    TheCommon::gen_stepper_command(c, cmd_dir, cmd_x, d, -cmd_a_abs);
+                } else {
+                    TheCommon::gen_stepper_command(c, cmd_dir, cmd_x, d, cmd_a_abs);
+                }
+            }
+            
+            using Zero = APRINTER_FP_CONST_EXPR(0.0);
+            using One = APRINTER_FP_CONST_EXPR(1.0);
+            using Two = APRINTER_FP_CONST_EXPR(2.0);
+            using Four = APRINTER_FP_CONST_EXPR(4.0);
+            
+            using KTicks = decltype(ExprFmax(Zero(), AdvanceSpec::K::e()) * typename Constants::TimeConversion());
+            using SmoothTicks = decltype(ExprFmax(One(), AdvanceSpec::SmoothTime::e() * typename Constants::TimeConversion()));
+            
+            // The smoothed offset change adds up to 2*K/Ts times the planned acceleration,
+            // and the acceleration is limited so that the added velocity is at most half
+            // of the maximum speed.
+            using AdvanceMaxAccelRec = decltype(ExprFmax(AxisSpec::MaxAccelRec::e() * (One() + Two() * KTicks() / SmoothTicks()), Four() * KTicks() * AxisSpec::MaxSpeedRec::e()));
+            
+            using CAdvanceEnabled = decltype(ExprCast<bool>(KTicks() > Zero()));
+            using CAdvanceK = decltype(ExprCast<FpType>(KTicks()));
+            using CAdvanceSmoothTicks = decltype(ExprCast<FpType>(SmoothTicks()));
+            using CAdvanceMaxAccelRec = decltype(ExprCast<FpType>(AdvanceMaxAccelRec()));
+            
+            using ConfigExprs = MakeTypeList<CAdvanceEnabled, CAdvanceK, CAdvanceSmoothTicks, CAdvanceMaxAccelRec>;
+            
+            struct Object : public ObjBase<PressureAdvanceFeature, typename Axis::Object, EmptyTypeList> {
+                int32_t offset;
+                int32_t staging_offset;
+            };
+        } AMBRO_STRUCT_ELSE(PressureAdvanceFeature) {
+            static void start_plan (Context c) {}
+            static void save_staging (Context c) {}
+            static void reset_staging (Context c) {}
+            static bool is_active (Context c) { return false; }
+            static FpType get_max_accel_rec (Context c) { return APRINTER_CFG(Config, CMaxAccelRec, c); }
+            static FpType limit_speed (FpType accum, Context c, FpType x, FpType rel_max_accel_rec) { return accum; }
+            template <typename... Args>
+            static void gen_commands (Args...) {}
+            using ConfigExprs = EmptyTypeList;
+            struct Object {};
+        };
+        
         static void start_stepping_impl (Context c, TimeType start_time, StepperCommand *cmd)
         {
             TheAxisDriver::template start<TheAxisDriverConsumer<AxisIndex>>(c, start_time, cmd);
@@ -658,10 +1116,13 @@ public:
                 StepperStepFixedType cmd_steps = TheAxisDriver::getAbortedCmdSteps(c, &dir);
                 add_steps(&steps, cmd_steps, dir);
             }
-            for (StepperCommitBufferSizeType i = co->m_commit_start; i != co->m_commit_end; i = TheCommon::commit_inc(i)) {
+            // If the latest extent was not yet adopted, none of its backup commands were used.
+            auto *published = TheCommon::published_extent(c);
+            auto *backup_ext = (m->m_commit_fresh & TheCommon::CommitMask) ? published : &co->m_extent;
+            for (typename TheCommon::StepperCommitBufferSizeType i = co->m_commit_start; i != published->commit_end; i = TheCommon::commit_inc(i)) {
                 add_command_steps(c, &steps, &co->m_commit_buffer[i]);
             }
-            for (StepperBackupBufferSizeType i = co->m_backup_start; i < co->m_backup_end; i++) {
+            for (typename TheCommon::StepperBackupBufferSizeType i = backup_ext->backup_start; i < backup_ext->backup_end; i++) {
                 add_command_steps(c, &steps, &co->m_backup_buffer[i]);
             }
             for (SegmentBufferSizeType i = m->m_segments_staging_length; i < m->m_segments_length; i++) {
@@ -695,16 +1156,31 @@ public:
         
         using SyncMinStepTime = decltype(typename Constants::TimeConversion() * (MinSecondsPerStep() + DriverSyncMinStepTime()));
         
+        // Upper bound of the squared speed in planner units for segments where this axis determines the distance.
+        using MaxV = decltype(AxisSpec::DistanceFactor::e() / AxisSpec::MaxSpeedRec::e());
+        using MaxVSquared = decltype(MaxV() * MaxV());
+        
         using CDistanceFactor = decltype(ExprCast<FpType>(AxisSpec::DistanceFactor::e()));
         using CCorneringSpeedComputationFactor = decltype(ExprCast<FpType>(AxisSpec::MaxAccelRec::e() / (AxisSpec::CorneringDistance::e() * AxisSpec::DistanceFactor::e())));
         using CMaxSpeedRec = decltype(ExprCast<FpType>(AxisSpec::MaxSpeedRec::e()));
         using CMaxAccelRec = decltype(ExprCast<FpType>(AxisSpec::MaxAccelRec::e()));
         using CSyncMinStepTime = decltype(ExprCast<FpType>(SyncMinStepTime()));
         using CAsyncMinStepTime = decltype(ExprCast<FpType>(SyncMinStepTime() + typename Constants::TimeConversion() * DriverAsyncMinStepTime()));
-        
-        using ConfigExprs = MakeTypeList<CDistanceFactor, CCorneringSpeedComputationFactor, CMaxSpeedRec, CMaxAccelRec, CSyncMinStepTime, CAsyncMinStepTime>;
-        
-        struct Object : public ObjBase<Axis, typename TheCommon::Object, EmptyTypeList> {
+        using CMaxJerkRec = decltype(ExprCast<FpType>(AxisSpec::MaxJerkRec::e()));
+        using CUnitsPerStep = decltype(ExprCast<FpType>(ExprRec(AxisSpec::StepsPerUnit::e())));
+        using CJunctionAccelRec = decltype(ExprCast<FpType>(AxisSpec::MaxAccelRec::e() * AxisSpec::StepsPerUnit::e()));
+        
+        using ConfigExprs = JoinTypeLists<
+            MakeTypeList<CDistanceFactor, CCorneringSpeedComputationFactor, CMaxSpeedRec, CMaxAccelRec, CSyncMinStepTime, CAsyncMinStepTime>,
+            If<JerkLimitEnabled, MakeTypeList<CMaxJerkRec>, EmptyTypeList>,
+            If<JunctionDeviationParams::Enabled, MakeTypeList<CUnitsPerStep, CJunctionAccelRec>, EmptyTypeList>,
+            typename InputShaperFeature::ConfigExprs,
+            typename PressureAdvanceFeature::ConfigExprs
+        >;
+        
+        struct Object : public ObjBase<Axis, typename TheCommon::Object, MakeTypeList<
+            PressureAdvanceFeature
+        >> {
             FpType last_x_by_distance;
         };
     };
@@ -722,9 +1198,10 @@ public:
         APRINTER_MAKE_INSTANCE(TheLaserDriver, (LaserSpec::TheLaserDriverService::template Driver<Context, Object, FpType, typename LaserSpec::PowerInterface, StepperCommandCallback>))
         
     public: // private, workaround gcc bug
-        using TheCommon = AxisCommon<Laser>;
+        using TheCommon = AxisCommon<Laser, 3>;
         using TheStepper = TheLaserDriver;
         static bool const IsFirst = false;
+        static int const CommonIndex = NumAxes + LaserIndex;
         using TheLaserSegment = LaserSegment<LaserIndex>;
         static TimeType const AdjustmentIntervalTicks = LaserSpec::TheLaserDriverService::AdjustmentInterval::value() / Clock::time_unit;
         
@@ -874,7 +1351,7 @@ public:
     public: // private, workaround gcc bug
         static_assert(ChannelSpec::BufferSize - LookaheadCommitCount > 1, "");
         static const size_t ChannelCommitBufferSize = ChannelSpec::BufferSize;
-        static const size_t ChannelBackupBufferSize = LookaheadBufferSize - LookaheadCommitCount;
+        static const size_t ChannelBackupBufferSize = LookaheadBufferSize - MinLookaheadCommitCount;
         using ChannelCommitBufferSizeType = ChooseIntForMax<ChannelCommitBufferSize, false>;
         using ChannelBackupBufferSizeType = ChooseIntForMax<2 * ChannelBackupBufferSize, false>;
         using LookaheadSizeType = ChooseIntForMax<LookaheadBufferSize, false>;
@@ -885,6 +1362,8 @@ public:
             o->m_commit_start = 0;
             o->m_commit_end = 0;
             o->m_busy = false;
+            o->m_lookahead_count = 0;
+            o->m_staging_count = 0;
             TheTimer::init(c);
         }
         
@@ -900,15 +1379,20 @@ public:
         
         static void write_segment (Context c, Segment *entry)
         {
+            auto *o = Object::self(c);
             auto *m = MotionPlanner::Object::self(c);
             TheChannelSegment *channel_entry = UnionGetElem<ChannelIndex>(&entry->channels);
             channel_entry->payload = *UnionGetElem<ChannelIndex>(&m->m_split_buffer.channel_payload);
+            o->m_lookahead_count++;
         }
         
+        // A commit only needs space for the commands of this channel which are
+        // in the lookahead buffer, so that pending commands (e.g. fan changes at
+        // every layer) never hold back the commit of motion segments.
         static bool have_commit_space (bool accum, Context c)
         {
             auto *o = Object::self(c);
-            return (accum && commit_avail(o->m_commit_start, o->m_commit_end) >= LookaheadCommitCount);
+            return (accum && commit_avail(o->m_commit_start, o->m_commit_end) >= MinValue((SegmentBufferSizeType)o->m_lookahead_count, AdaptiveCommitFeature::get_commit_count(c)));
         }
         
         static void start_commands (Context c)
@@ -944,6 +1428,7 @@ public:
             o->m_commit_end = o->m_new_commit_end;
             o->m_backup_start = m->m_current_backup ? 0 : ChannelBackupBufferSize;
             o->m_backup_end = o->m_new_backup_end;
+            update_lookahead_count(c);
         }
         
         template <typename LockContext>
@@ -954,6 +1439,7 @@ public:
             o->m_commit_end = o->m_new_commit_end;
             o->m_backup_start = m->m_current_backup ? 0 : ChannelBackupBufferSize;
             o->m_backup_end = o->m_new_backup_end;
+            update_lookahead_count(c);
             if (AMBRO_LIKELY(o->m_commit_start != o->m_commit_end || o->m_backup_start != o->m_backup_end)) {
                 o->m_busy = true;
                 o->m_cmd = (o->m_commit_start != o->m_commit_end) ? &o->m_commit_buffer[o->m_commit_start] : &o->m_backup_buffer[o->m_backup_start];
@@ -962,6 +1448,25 @@ public:
             }
         }
         
+        // Every entry of the channel in the buffer has been planned, those which
+        // were not committed are the ones in the new backup.
+        template <typename ThisContext>
+        static void update_lookahead_count (ThisContext c)
+        {
+            auto *o = Object::self(c);
+            o->m_lookahead_count = o->m_backup_end - o->m_backup_start;
+            o->m_staging_count = o->m_lookahead_count;
+        }
+        
+        static void reset_staging (Context c)
+        {
+            auto *o = Object::self(c);
+            AMBRO_ASSERT(o->m_staging_count <= o->m_lookahead_count)
+            
+            o->m_lookahead_count -= o->m_staging_count;
+            o->m_staging_count = 0;
+        }
+        
         static void start_stepping (Context c, TimeType start_time)
         {
             auto *o = Object::self(c);
@@ -1042,6 +1547,8 @@ public:
             ChannelBackupBufferSizeType m_backup_end;
             ChannelCommitBufferSizeType m_new_commit_end;
             ChannelBackupBufferSizeType m_new_backup_end;
+            LookaheadSizeType m_lookahead_count;
+            LookaheadSizeType m_staging_count;
             bool m_busy;
             TheChannelCommand m_commit_buffer[ChannelCommitBufferSize];
             TheChannelCommand m_backup_buffer[(size_t)2 * ChannelBackupBufferSize];
@@ -1061,6 +1568,519 @@ private:
     
     struct ComputeStateTuple : public Tuple<MapTypeList<AxisCommonList, GetMemberType_ComputeState>> {};
     
+    struct RampShaper {
+        static int const MaxImpulses = MaxRampImpulses;
+        
+        // Generates a constant-acceleration phase convolved with a sequence of
+        // impulses (amplitudes summing to one, increasing delays starting at zero,
+        // the last one below the phase duration). The phase has been lengthened by
+        // the planner (see RampExtensionFeature), and the acceleration pulse is made
+        // as long as needed for the convolved ramp to cover the distance planned for
+        // the phase with the same end speeds. That distance is planned with the mean
+        // delay at the given offset (zero or negative) from the middle of the
+        // impulses; when the impulses of the axis are less early, the pulse ends
+        // before the phase, which then continues at constant speed. Distances are
+        // scaled to match the phase exactly, which only absorbs rounding.
+        template <typename TheAxis, typename StepFixedType, typename TimeFixedType>
+        static void gen_shaped_ramp (Context c, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel, int num_impulses, FpType const *amplitudes, TimeFixedType const *delays, FpType offset)
+        {
+            AMBRO_ASSERT(num_impulses >= 1 && num_impulses <= MaxImpulses)
+            AMBRO_ASSERT(delays[0].bitsValue() == 0)
+            AMBRO_ASSERT(delays[num_impulses - 1].bitsValue() < t.bitsValue())
+            
+            FpType t_fp = t.template fpValue<FpType>();
+            FpType x_fp = x.template fpValue<FpType>();
+            FpType a_fp = a_abs.template fpValue<FpType>();
+            
+            FpType mean_delay = 0.0f;
+            for (int i = 0; i < num_impulses; i++) {
+                mean_delay += amplitudes[i] * delays[i].bitsValue();
+            }
+            auto max_pulse_len = t.bitsValue() - delays[num_impulses - 1].bitsValue();
+            auto pulse_len = max_pulse_len;
+            FpType pulse_len_fp = t_fp + FloatLdexp(offset - mean_delay, 1);
+            if (pulse_len_fp < max_pulse_len) {
+                pulse_len = (pulse_len_fp >= 1.0f) ? (decltype(pulse_len))FloatRound(pulse_len_fp) : 1;
+            }
+            
+            // Sorted times where the acceleration level changes.
+            decltype(pulse_len) times[2 * MaxImpulses + 1];
+            int num_times = 0;
+            auto add_time = [&](decltype(pulse_len) time) {
+                int j = num_times++;
+                while (j > 0 && times[j - 1] > time) {
+                    times[j] = times[j - 1];
+                    j--;
+                }
+                times[j] = time;
+            };
+            for (int i = 0; i < num_impulses; i++) {
+                add_time(delays[i].bitsValue());
+                add_time(delays[i].bitsValue() + pulse_len);
+            }
+            add_time(t.bitsValue());
+            
+            // Speeds in steps per tick; the quadratic terms are symmetric for
+            // acceleration and deceleration, only the start speed differs.
+            FpType speed_change = (2.0f * a_fp) / t_fp;
+            FpType v = (x_fp + (decel ? (a_fp - speed_change * offset) : (speed_change * offset - a_fp))) / t_fp;
+            FpType accel = speed_change / pulse_len;
+            
+            TimeFixedType piece_t[2 * MaxImpulses];
+            FpType piece_end[2 * MaxImpulses];
+            FpType piece_q[2 * MaxImpulses];
+            int num_pieces = 0;
+            FpType dist = 0.0f;
+            
+            for (int k = 0; k + 1 < num_times; k++) {
+                if (times[k + 1] == times[k]) {
+                    continue;
+                }
+                FpType level = 0.0f;
+                for (int i = 0; i < num_impulses; i++) {
+                    if (delays[i].bitsValue() <= times[k] && times[k] < delays[i].bitsValue() + pulse_len) {
+                        level += amplitudes[i];
+                    }
+                }
+                FpType d = times[k + 1] - times[k];
+                FpType q = 0.5f * accel * level * d * d;
+                dist += v * d + (decel ? -q : q);
+                v += (decel ? -accel : accel) * level * d;
+                piece_t[num_pieces] = TimeFixedType::importBits(times[k + 1] - times[k]);
+                piece_end[num_pieces] = dist;
+                piece_q[num_pieces] = q;
+                num_pieces++;
+            }
+            
+            FpType scale = x_fp / dist;
+            StepFixedType x_prev = StepFixedType::importBits(0);
+            
+            for (int k = 0; k < num_pieces; k++) {
+                StepFixedType x_end = (k == num_pieces - 1) ? x : FixedMax(x_prev, FixedMin(x, StepFixedType::importFpSaturatedRound(piece_end[k] * scale)));
+                StepFixedType xk = StepFixedType::importBits(x_end.bitsValue() - x_prev.bitsValue());
+                gen_ramp_piece<TheAxis>(c, dir, xk, piece_t[k], FixedMin(xk, StepFixedType::importFpSaturatedRound(piece_q[k] * scale)), decel);
+                x_prev = x_end;
+            }
+        }
+        
+        // Generates an unshaped phase, which only needs to be split if the
+        // planned distance is offset (see gen_shaped_ramp).
+        template <typename TheAxis, typename StepFixedType, typename TimeFixedType>
+        static void gen_plain_ramp (Context c, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel, FpType offset)
+        {
+            if (AMBRO_UNLIKELY(offset <= -0.5f && t.bitsValue() >= 2)) {
+                FpType amplitudes[1] = {1.0f};
+                TimeFixedType delays[1] = {TimeFixedType::importBits(0)};
+                return gen_shaped_ramp<TheAxis>(c, dir, x, t, a_abs, decel, 1, amplitudes, delays, offset);
+            }
+            gen_ramp_piece<TheAxis>(c, dir, x, t, a_abs, decel);
+        }
+        
+        template <typename TheAxis, typename StepFixedType, typename TimeFixedType>
+        static void gen_ramp_piece (Context c, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel)
+        {
+            if (decel) {
+                TheAxis::TheCommon::gen_stepper_command(c, dir, x, t, -a_abs);
+            } else {
+                TheAxis::TheCommon::gen_stepper_command(c, dir, x, t, a_abs);
+            }
+        }
+    };
+    
+    AMBRO_STRUCT_IF(JerkFeature, JerkLimitEnabled) {
+        // Time needed to ramp up to the maximum acceleration of the segment
+        // without exceeding the jerk limit of any axis.
+        static FpType get_jerk_time (Context c, ComputeStateTuple const *cst, FpType rel_max_accel_rec)
+        {
+            FpType rel_max_jerk_rec = ListForFold<AxesList>(FloatIdentity(), [&] APRINTER_TLA(axis, (auto accum), return axis::compute_segment_buffer_entry_jerk(accum, c, cst)));
+            return AMBRO_LIKELY(rel_max_accel_rec > 0.0f) ? (rel_max_jerk_rec / rel_max_accel_rec) : 0.0f;
+        }
+        
+        // Generates a phase lengthened by RampExtensionFeature as the constant-acceleration
+        // pulse convolved with three equal impulses spread over the rise time, which
+        // approximates the linear rises of the acceleration with steps of a third.
+        template <typename TheAxis, typename StepFixedType, typename TimeFixedType>
+        static void gen_ramp_commands (Context c, Segment *entry, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel)
+        {
+            FpType offset = RampExtensionFeature::get_offset(c, decel);
+            TimeFixedType tr = FixedMin(TimeFixedType::importBits(t.bitsValue() / 2), TimeFixedType::importFpSaturatedRound(RampExtensionFeature::get_rise_time(c, decel)));
+            if (AMBRO_LIKELY(tr.bitsValue() >= 2)) {
+                FpType amplitudes[3] = {1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f};
+                TimeFixedType delays[3] = {TimeFixedType::importBits(0), TimeFixedType::importBits(tr.bitsValue() / 2), tr};
+                return RampShaper::template gen_shaped_ramp<TheAxis>(c, dir, x, t, a_abs, decel, 3, amplitudes, delays, offset);
+            }
+            
+            RampShaper::template gen_plain_ramp<TheAxis>(c, dir, x, t, a_abs, decel, offset);
+        }
+    } AMBRO_STRUCT_ELSE(JerkFeature) {
+        static FpType get_jerk_time (Context c, ComputeStateTuple const *cst, FpType rel_max_accel_rec)
+        {
+            return 0.0f;
+        }
+        
+        template <typename TheAxis, typename StepFixedType, typename TimeFixedType>
+        static void gen_ramp_commands (Context c, Segment *entry, bool dir, StepFixedType x, TimeFixedType t, StepFixedType a_abs, bool decel)
+        {
+            RampShaper::template gen_plain_ramp<TheAxis>(c, dir, x, t, a_abs, decel, RampExtensionFeature::get_offset(c, decel));
+        }
+    };
+    
+    // Lengthens the acceleration and deceleration phases for the jerk limit and
+    // the input shapers, which both spread the speed change of a phase over a
+    // longer time so as to keep the acceleration within the maximum.
+    AMBRO_STRUCT_IF(RampExtensionFeature, RampExtensionEnabled) {
+        struct Object;
+        
+        static void write_segment_ramp_times (Context c, Segment *entry, ComputeStateTuple const *cst, FpType rel_max_accel_rec, FpType distance_rec)
+        {
+            entry->axes.jerk_time = JerkFeature::get_jerk_time(c, cst, rel_max_accel_rec);
+            entry->axes.shaper_time = ListForFold<AxesList>(FpType(0.0f), [&] APRINTER_TLA(axis, (auto accum), return axis::compute_segment_buffer_entry_shaper_time(accum, c, cst)));
+            entry->axes.shaper_offset = ListForFold<AxesList>(FpType(0.0f), [&] APRINTER_TLA(axis, (auto accum), return axis::compute_segment_buffer_entry_shaper_offset(accum, c, cst)));
+            entry->axes.distance_rec = distance_rec;
+        }
+        
+        // Each ramp takes up to the longest extension of the axes longer than at
+        // constant acceleration (see extend_ramps), covering at most the distance
+        // traveled at the maximum speed of the segment in that time. The lookahead
+        // is only allowed the speed change which leaves that distance at constant
+        // speed for both ramps, but at least half of the full one, beyond which
+        // the ramps get steeper instead.
+        static void limit_speed_change (Context c, Segment *entry)
+        {
+            FpType max_extension = FloatMax(entry->axes.jerk_time, entry->axes.shaper_time) - FloatLdexp(entry->axes.shaper_offset, 1);
+            FpType reserve = FloatLdexp(max_extension / entry->axes.rel_max_speed_rec, 1);
+            TheLinearPlanner::limitSpeedChange(&entry->axes.lp_seg, FixedPlanningFeature::import_frac(FloatMax(FpType(0.5f), 1.0f - reserve)));
+        }
+        
+        // Extra time of a ramp with a trapezoidal acceleration profile whose rises
+        // last the jerk time, or a triangular one peaking below the maximum
+        // acceleration when the ramp at constant acceleration would be shorter.
+        // A shaped ramp is the constant-acceleration one convolved with the
+        // shaper, which takes twice its mean delay longer if the impulses are
+        // centered within the phase. All axes need to cover the same part of the
+        // segment in the phase though, which is planned as if the impulses were
+        // offset like those of the earliest shaper; the others are given that
+        // much more time to keep their pulses long enough.
+        static FpType ramp_extension (FpType t, Segment *entry)
+        {
+            if (t <= 0.0f) {
+                return 0.0f;
+            }
+            FpType jerk_time = entry->axes.jerk_time;
+            FpType jerk_extension = (t >= jerk_time) ? jerk_time : (2.0f * FloatSqrt(t * jerk_time) - t);
+            return FloatMax(jerk_extension, entry->axes.shaper_time) - FloatLdexp(entry->axes.shaper_offset, 1);
+        }
+        
+        // Lengthens the acceleration and deceleration phases planned at constant
+        // acceleration into ramps with the same speed change. The extra distance
+        // is taken from the constant-speed phase; if that is too short, the
+        // extensions are reduced along with the shapers, which makes the rises
+        // steeper but still keeps the peak acceleration within the maximum.
+        // ramp0/ramp2 are set to the squared speed change which gives the
+        // quadratic term of the longer phases.
+        static void extend_ramps (Context c, Segment *entry, FpType *const_start, FpType *const_end, FpType v_start, FpType v_end, FpType v_const, FpType *t0, FpType *t2, FpType *t1, FpType *ramp0, FpType *ramp2)
+        {
+            auto *o = Object::self(c);
+            
+            FpType offset = entry->axes.shaper_offset;
+            FpType e0 = ramp_extension(*t0, entry);
+            FpType e2 = ramp_extension(*t2, entry);
+            FpType d0 = (FloatLdexp((v_start + v_const) * e0, -1) - (v_const - v_start) * offset) * entry->axes.distance_rec;
+            FpType d2 = (FloatLdexp((v_end + v_const) * e2, -1) + (v_const - v_end) * offset) * entry->axes.distance_rec;
+            FpType frac1 = FloatMakePosOrPosZero(1.0f - *const_start - *const_end);
+            FpType scale = 1.0f;
+            if (AMBRO_UNLIKELY(d0 + d2 > frac1)) {
+                scale = frac1 / (d0 + d2);
+                e0 *= scale;
+                e2 *= scale;
+                d0 *= scale;
+                d2 *= scale;
+                offset *= scale;
+            }
+            o->time_scale = scale;
+            o->offset[0] = (e0 > 0.0f) ? offset : 0.0f;
+            o->offset[1] = (e2 > 0.0f) ? offset : 0.0f;
+            
+            // The peak acceleration is the speed change over (t - rise_time),
+            // which is at least the time of the ramp at constant acceleration.
+            FpType s0 = e0 + FloatLdexp(o->offset[0], 1);
+            FpType s2 = e2 + FloatLdexp(o->offset[1], 1);
+            o->rise_time[0] = FloatMin(s0, FloatLdexp(*t0 + s0, -1));
+            o->rise_time[1] = FloatMin(s2, FloatLdexp(*t2 + s2, -1));
+            
+            FpType max_accel = 1.0f / entry->axes.max_accel_rec;
+            *t0 += e0;
+            *t2 += e2;
+            *ramp0 = (v_const - v_start) * *t0 * max_accel;
+            *ramp2 = (v_const - v_end) * *t2 * max_accel;
+            *const_start += d0;
+            *const_end += d2;
+            
+            FpType rest1 = FloatMakePosOrPosZero(frac1 - d0 - d2);
+            *t1 = (rest1 > 0.0f) ? (rest1 / (v_const * entry->axes.distance_rec)) : 0.0f;
+        }
+        
+        static FpType get_time_scale (Context c)
+        {
+            auto *o = Object::self(c);
+            return o->time_scale;
+        }
+        
+        static FpType get_offset (Context c, bool decel)
+        {
+            auto *o = Object::self(c);
+            return o->offset[decel];
+        }
+        
+        static FpType get_rise_time (Context c, bool decel)
+        {
+            auto *o = Object::self(c);
+            return o->rise_time[decel];
+        }
+        
+        struct Object : public ObjBase<RampExtensionFeature, typename MotionPlanner::Object, EmptyTypeList> {
+            FpType time_scale;
+            FpType offset[2];
+            FpType rise_time[2];
+        };
+    } AMBRO_STRUCT_ELSE(RampExtensionFeature) {
+        static void write_segment_ramp_times (Context c, Segment *entry, ComputeStateTuple const *cst, FpType rel_max_accel_rec, FpType distance_rec) {}
+        static void limit_speed_change (Context c, Segment *entry) {}
+        
+        static void extend_ramps (Context c, Segment *entry, FpType *const_start, FpType *const_end, FpType v_start, FpType v_end, FpType v_const, FpType *t0, FpType *t2, FpType *t1, FpType *ramp0, FpType *ramp2)
+        {
+            *t1 = (1.0f - *const_start - *const_end) * entry->axes.rel_max_speed_rec;
+        }
+        
+        static FpType get_time_scale (Context c)
+        {
+            return 1.0f;
+        }
+        
+        static FpType get_offset (Context c, bool decel)
+        {
+            return 0.0f;
+        }
+        
+        static FpType get_rise_time (Context c, bool decel)
+        {
+            return 0.0f;
+        }
+        
+        struct Object {};
+    };
+    
+    // Adjusts the number of segments committed by each plan() between
+    // MinLookaheadCommitCount and LookaheadCommitCount. Each plan() goes
+    // through the whole lookahead buffer, so committing fewer segments keeps
+    // more lookahead behind the committed ones but costs more CPU per segment.
+    // The commit count is increased quickly when planning takes a significant
+    // part of the motion time it produces, or when the motion already in the
+    // stepper buffers would not outlast a few more plans, and decreased one at
+    // a time when planning is cheap.
+    AMBRO_STRUCT_IF(AdaptiveCommitFeature, (MinLookaheadCommitCount < LookaheadCommitCount)) {
+        struct Object;
+        
+        static int const HighLoadFactor = 4;
+        static int const LowLoadFactor = 16;
+        static int const LowSlackFactor = 8;
+        static int const HighSlackFactor = 32;
+        
+        static void init (Context c)
+        {
+            auto *o = Object::self(c);
+            o->commit_count = LookaheadCommitCount;
+        }
+        
+        static SegmentBufferSizeType get_commit_count (Context c)
+        {
+            auto *o = Object::self(c);
+            return o->commit_count;
+        }
+        
+        static void start_plan (Context c)
+        {
+            auto *o = Object::self(c);
+            auto *m = MotionPlanner::Object::self(c);
+            o->plan_start_time = Clock::getTime(c);
+            o->plan_start_staging_time = m->m_staging_time;
+        }
+        
+        static void finish_plan (Context c)
+        {
+            auto *o = Object::self(c);
+            auto *m = MotionPlanner::Object::self(c);
+            AMBRO_ASSERT(m->m_state == STATE_STEPPING)
+            
+            TimeType now = Clock::getTime(c);
+            TimeType plan_time = now - o->plan_start_time;
+            TimeType committed_time = m->m_staging_time - o->plan_start_staging_time;
+            TimeType slack = m->m_staging_time - now;
+            if (AMBRO_UNLIKELY(slack > TimeType(-1) / 2)) {
+                slack = 0;
+            }
+            
+            if (plan_time > committed_time / HighLoadFactor || plan_time > slack / LowSlackFactor) {
+                o->commit_count = MinValue((SegmentBufferSizeType)(2 * o->commit_count), (SegmentBufferSizeType)LookaheadCommitCount);
+            }
+            else if (o->commit_count > MinLookaheadCommitCount && plan_time < committed_time / LowLoadFactor && plan_time < slack / HighSlackFactor) {
+                o->commit_count--;
+            }
+        }
+        
+        static void underrun (Context c)
+        {
+            auto *o = Object::self(c);
+            o->commit_count = LookaheadCommitCount;
+        }
+        
+        struct Object : public ObjBase<AdaptiveCommitFeature, typename MotionPlanner::Object, EmptyTypeList> {
+            SegmentBufferSizeType commit_count;
+            TimeType plan_start_time;
+            TimeType plan_start_staging_time;
+        };
+    } AMBRO_STRUCT_ELSE(AdaptiveCommitFeature) {
+        static void init (Context c) {}
+        static SegmentBufferSizeType get_commit_count (Context c) { return LookaheadCommitCount; }
+        static void start_plan (Context c) {}
+        static void finish_plan (Context c) {}
+        static void underrun (Context c) {}
+        struct Object {};
+    };
+    
+    // Junction deviation cornering model. The junction speed is that of
+    // the circular arc tangent to both segments which deviates at most by
+    // the configured distance from the corner, with the centripetal
+    // acceleration being the largest allowed by the axes in the direction
+    // of the velocity change. The unit vectors are computed in physical
+    // units of the planner axes in CartesianAxesMask only, so these must
+    // be the cartesian axes driven directly (not extruders, and not the
+    // steppers of a nonlinear transform). Segments which move none of them
+    // stop at the junction. When the deviation is configured as zero the
+    // CorneringDistance model is used instead.
+    AMBRO_STRUCT_IF(JunctionDeviationFeature, JunctionDeviationParams::Enabled) {
+        static_assert(NumAxes <= 32, "Too many axes for CartesianAxesMask");
+        
+        struct Object;
+        
+        static void init (Context c)
+        {
+            auto *o = Object::self(c);
+            o->have_last = false;
+        }
+        
+        template <typename TheComputeStateTuple>
+        static FpType limit_start_v (Context c, Segment const *entry, TheComputeStateTuple const *cst, FpType distance, bool degenerate, FpType cornering_max_start_v)
+        {
+            auto *o = Object::self(c);
+            
+            FpType unit[NumAxes];
+            FpType length_squared = ListForFold<AxesList>(0.0f, [&] APRINTER_TLA(axis, (FpType accum), return axis::junction_unit_vector(accum, c, entry, cst, unit)));
+            if (AMBRO_UNLIKELY(degenerate || !(length_squared > 0.0f))) {
+                o->have_last = false;
+                return 0.0f;
+            }
+            FpType length_rec = 1.0f / FloatSqrt(length_squared);
+            
+            FpType cos_theta = 0.0f;
+            FpType junction[NumAxes];
+            FpType junction_squared = 0.0f;
+            for (int i = 0; i < NumAxes; i++) {
+                unit[i] *= length_rec;
+                cos_theta -= unit[i] * o->last_unit[i];
+                junction[i] = unit[i] - o->last_unit[i];
+                junction_squared += junction[i] * junction[i];
+                o->last_unit[i] = unit[i];
+            }
+            bool have_last = o->have_last;
+            o->have_last = true;
+            
+            FpType deviation = APRINTER_CFG(Config, CJunctionDeviation, c);
+            if (!(deviation > 0.0f)) {
+                return cornering_max_start_v;
+            }
+            if (!have_last || cos_theta > 0.999999f) {
+                return 0.0f;
+            }
+            if (cos_theta < -0.999999f) {
+                return INFINITY;
+            }
+            
+            FpType accel_rec = ListForFold<AxesList>(0.0f, [&] APRINTER_TLA(axis, (FpType accum), return axis::junction_accel_rec(accum, c, junction))) / FloatSqrt(junction_squared);
+            FpType sin_theta_d2 = FloatSqrt(0.5f * (1.0f - cos_theta));
+            FpType v_squared = (deviation * sin_theta_d2) / ((1.0f - sin_theta_d2) * accel_rec);
+            
+            // Convert from physical units to the distance units of the planner.
+            return v_squared * (distance * distance) * (length_rec * length_rec);
+        }
+        
+        using CJunctionDeviation = decltype(ExprCast<FpType>(JunctionDeviationParams::Deviation::e()));
+        
+        using ConfigExprs = MakeTypeList<CJunctionDeviation>;
+        
+        struct Object : public ObjBase<JunctionDeviationFeature, typename MotionPlanner::Object, EmptyTypeList> {
+            FpType last_unit[NumAxes];
+            bool have_last;
+        };
+    } AMBRO_STRUCT_ELSE(JunctionDeviationFeature) {
+        static void init (Context c) {}
+        template <typename TheComputeStateTuple>
+        static FpType limit_start_v (Context c, Segment const *entry, TheComputeStateTuple const *cst, FpType distance, bool degenerate, FpType cornering_max_start_v) { return cornering_max_start_v; }
+        struct Object {};
+    };
+    
+    template <typename TheAxis, typename AccumType>
+    using MaxVSquaredHelper = decltype(ExprFmax(AccumType(), typename TheAxis::MaxVSquared()));
+    
+    // With a fixed-point PlannerFpType, the linear planner works with squared speeds
+    // normalized to the highest speed any segment can have (the distance of a segment
+    // is that of one axis and its time is at least that of every axis), so that they
+    // are at most one. Speeds are converted when a segment is added and when it is planned.
+    AMBRO_STRUCT_IF(FixedPlanningFeature, (!TypesAreEqual<PlannerFpType, FpType>::Value)) {
+        using Zero = APRINTER_FP_CONST_EXPR(0.0);
+        using MaxVSquared = TypeListFold<AxesList, Zero, MaxVSquaredHelper>;
+        
+        using CVSquaredScale = decltype(ExprCast<FpType>(ExprRec(MaxVSquared())));
+        using CVSquaredUnscale = decltype(ExprCast<FpType>(MaxVSquared()));
+        using CVUnscale = decltype(ExprCast<FpType>(ExprSqrt(MaxVSquared())));
+        
+        static PlannerFpType import_v_squared (Context c, FpType v_squared)
+        {
+            return PlannerFpType::importFp(v_squared * APRINTER_CFG(Config, CVSquaredScale, c));
+        }
+        
+        static FpType export_v (Context c, PlannerFpType v_squared)
+        {
+            return FloatSqrt(v_squared).template fpValue<FpType>() * APRINTER_CFG(Config, CVUnscale, c);
+        }
+        
+        static FpType export_v_squared_rec (Context c, PlannerFpType v_squared_rec)
+        {
+            return v_squared_rec.template fpValue<FpType>() * APRINTER_CFG(Config, CVSquaredScale, c);
+        }
+        
+        static FpType export_frac (PlannerFpType frac)
+        {
+            return frac.template fpValue<FpType>();
+        }
+        
+        static PlannerFpType import_frac (FpType frac)
+        {
+            return PlannerFpType::importFp(frac);
+        }
+        
+        using ConfigExprs = MakeTypeList<CVSquaredScale, CVSquaredUnscale, CVUnscale>;
+        
+        struct Object : public ObjBase<FixedPlanningFeature, typename MotionPlanner::Object, EmptyTypeList> {};
+    } AMBRO_STRUCT_ELSE(FixedPlanningFeature) {
+        static FpType import_v_squared (Context c, FpType v_squared) { return v_squared; }
+        static FpType export_v (Context c, FpType v_squared) { return FloatSqrt(v_squared); }
+        static FpType export_v_squared_rec (Context c, FpType v_squared_rec) { return v_squared_rec; }
+        static FpType export_frac (FpType frac) { return frac; }
+        static FpType import_frac (FpType frac) { return frac; }
+        struct Object {};
+    };
+    
 public:
     static void init (Context c, bool prestep_callback_enabled)
     {
@@ -1076,16 +2096,20 @@ public:
         o->m_staging_v = 0.0f;
         o->m_last_max_v = 0.0f;
         o->m_last_dir_and_type = 0;
+        o->m_replan_pending = false;
         o->m_split_buffer.type = 0xFF;
         o->m_state = STATE_BUFFERING;
         o->m_waiting = false;
         o->m_aborted = false;
         o->m_syncing = false;
         o->m_current_backup = false;
+        o->m_commit_fresh = 0;
 #ifdef AMBROLIB_ASSERTIONS
         o->m_pulling = false;
         o->m_planned = false;
 #endif
+        AdaptiveCommitFeature::init(c);
+        JunctionDeviationFeature::init(c);
         ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::init(c, prestep_callback_enabled)));
         ListFor<ChannelsList>([&] APRINTER_TL(channel, channel::init(c)));
         Context::EventLoop::template triggerFastEvent<CallbackFastEvent>(c);
@@ -1171,6 +2195,60 @@ public:
         Context::EventLoop::template triggerFastEvent<StepperFastEvent>(c);
     }
     
+    // Multiplies the feedrate-derived time of the segments which have not been
+    // committed yet (and of the pending split buffer) by the given factor, as for
+    // a speed ratio change. The limits of the axes still apply. A segment which
+    // can no longer be slowed down that much due to the deceleration from the
+    // committed speed keeps its previous speed. The new speeds are used by the
+    // next plan, which is done as soon as possible.
+    static void scaleFeedTime (Context c, FpType time_factor)
+    {
+        auto *o = Object::self(c);
+        AMBRO_ASSERT(FloatIsPosOrPosZero(time_factor))
+        
+        if (AMBRO_UNLIKELY(o->m_state == STATE_ABORTED)) {
+            return;
+        }
+        
+        if (o->m_split_buffer.type == 0 && !ListForFold<AxesList>(true, [&] APRINTER_TLA(axis, (bool accum), return accum && axis::check_icmd_zero_impl(c)))) {
+            o->m_split_buffer.axes.rel_max_v_rec *= time_factor;
+        }
+        
+        PlannerFpType floor_v = o->m_staging_v_squared;
+        PlannerFpType prev_max_v;
+        bool have_prev = false;
+        for (SegmentBufferSizeType i = 0; i < o->m_segments_length; i++) {
+            Segment *entry = &o->m_segments[segments_add(o->m_segments_start, i)];
+            if ((entry->dir_and_type & TypeMask) != 0) {
+                continue;
+            }
+            if (!have_prev) {
+                // The start speed of the first segment was limited by the committed one.
+                prev_max_v = entry->axes.lp_seg.max_start_v;
+                have_prev = true;
+            }
+            entry->axes.feed_rel_max_speed_rec *= time_factor;
+            FpType rel_max_speed_rec = FloatMax(entry->axes.limit_rel_max_speed_rec, entry->axes.feed_rel_max_speed_rec);
+            PlannerFpType max_v = FixedPlanningFeature::import_v_squared(c, entry->axes.distance_squared / (rel_max_speed_rec * rel_max_speed_rec));
+            if (AMBRO_UNLIKELY(max_v < floor_v)) {
+                rel_max_speed_rec = entry->axes.rel_max_speed_rec;
+                max_v = entry->axes.lp_seg.max_v;
+            }
+            entry->axes.rel_max_speed_rec = rel_max_speed_rec;
+            TheLinearPlanner::changeMaxV(&entry->axes.lp_seg, prev_max_v, entry->axes.junction_max_start_v, max_v);
+            prev_max_v = max_v;
+            floor_v = (floor_v > entry->axes.lp_seg.a_x) ? (floor_v - entry->axes.lp_seg.a_x) : PlannerFpType(0.0f);
+        }
+        
+        if (have_prev) {
+            o->m_last_max_v = prev_max_v;
+        }
+        if (o->m_segments_length > 0) {
+            o->m_replan_pending = true;
+            Context::EventLoop::template triggerFastEvent<StepperFastEvent>(c);
+        }
+    }
+    
     template <int AxisIndex, typename StepsType>
     static StepsType countAbortedRemSteps (Context c)
     {
@@ -1180,6 +2258,25 @@ public:
         return Axis<AxisIndex>::template axis_count_aborted_rem_steps<StepsType>(c);
     }
     
+    // Returns the duration of the motion which has been committed but not
+    // executed yet. Segments still in the lookahead buffer are not included.
+    static TimeType getCommittedTimeAhead (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        if (o->m_state == STATE_BUFFERING) {
+            return o->m_staging_time;
+        }
+        if (o->m_state != STATE_STEPPING) {
+            return 0;
+        }
+        TimeType ahead = o->m_staging_time - Clock::getTime(c);
+        if (AMBRO_UNLIKELY(ahead > TimeType(-1) / 2)) {
+            ahead = 0;
+        }
+        return ahead;
+    }
+    
 #ifdef AXISDRIVER_DETECT_OVERLOAD
     static bool axisOverloadOccurred (Context c)
     {
@@ -1190,6 +2287,58 @@ public:
     }
 #endif
     
+#ifdef MOTIONPLANNER_METRICS
+    // Planner statistics since the last reset. They are not touched by init()
+    // and deinit(), the owner resets them once at startup and on request, so
+    // they span all planner sessions. Plan times are in clock ticks
+    // and include the commit. The minimum fill is the lowest number of buffered
+    // segments seen by plan(), it being much lower than the buffer size means
+    // that planning mostly happens on partial lookahead (e.g. at waitFinished).
+    struct Metrics {
+        uint32_t plan_count;
+        TimeType plan_time_min;
+        TimeType plan_time_max;
+        uint64_t plan_time_sum;
+        uint32_t commit_count;
+        uint32_t commit_fail_count;
+        uint32_t underrun_count;
+        uint32_t split_count;
+        SegmentBufferSizeType min_fill;
+    };
+    
+    static Metrics const * getMetrics (Context c)
+    {
+        auto *o = Object::self(c);
+        return &o->m_metrics;
+    }
+    
+    // Only valid while the planner is initialized.
+    static SegmentBufferSizeType getBufferFill (Context c)
+    {
+        auto *o = Object::self(c);
+        return o->m_segments_length;
+    }
+    
+    static SegmentBufferSizeType getCommitCount (Context c)
+    {
+        return AdaptiveCommitFeature::get_commit_count(c);
+    }
+    
+    static void resetMetrics (Context c)
+    {
+        auto *o = Object::self(c);
+        o->m_metrics.plan_count = 0;
+        o->m_metrics.plan_time_min = (TimeType)-1;
+        o->m_metrics.plan_time_max = 0;
+        o->m_metrics.plan_time_sum = 0;
+        o->m_metrics.commit_count = 0;
+        o->m_metrics.commit_fail_count = 0;
+        o->m_metrics.underrun_count = 0;
+        o->m_metrics.split_count = 0;
+        o->m_metrics.min_fill = LookaheadBufferSize;
+    }
+#endif
+    
     template <int ChannelIndex>
     using GetChannelTimer = typename Channel<ChannelIndex>::TheTimer;
     
@@ -1221,17 +2370,26 @@ private:
 #endif
     }
     
-    static bool plan (Context c)
+    // With keep_last, the last segment is not committed, so that all committed
+    // segments have final end speeds (the last one is planned to end at zero).
+    static bool plan (Context c, bool keep_last=false)
     {
         auto *o = Object::self(c);
         AMBRO_ASSERT(o->m_state != STATE_ABORTED)
-        AMBRO_ASSERT(o->m_segments_staging_length != o->m_segments_length)
+        AMBRO_ASSERT(o->m_segments_staging_length != o->m_segments_length || o->m_replan_pending)
+        AMBRO_ASSERT(o->m_segments_length > keep_last)
 #ifdef AMBROLIB_ASSERTIONS
         AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) { AMBRO_ASSERT(planner_have_commit_space(c)) }
 #endif
+#ifdef MOTIONPLANNER_METRICS
+        TimeType plan_start_time = Clock::getTime(c);
+        o->m_metrics.min_fill = MinValue(o->m_metrics.min_fill, o->m_segments_length);
+#endif
+        AdaptiveCommitFeature::start_plan(c);
+        o->m_replan_pending = false;
         
         SegmentBufferSizeType i = o->m_segments_length;
-        FpType v = 0.0f;
+        PlannerFpType v = 0.0f;
         do {
             i--;
             Segment *entry = &o->m_segments[segments_add(o->m_segments_start, i)];
@@ -1240,10 +2398,11 @@ private:
             }
         } while (i != 0);
         
-        SegmentBufferSizeType commit_count = MinValue(o->m_segments_length, (SegmentBufferSizeType)LookaheadCommitCount);
+        SegmentBufferSizeType commit_count = MinValue((SegmentBufferSizeType)(o->m_segments_length - keep_last), AdaptiveCommitFeature::get_commit_count(c));
         
         o->m_new_to_backup = false;
         ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::start_commands(c)));
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::start_plan(c)));
         ListFor<ChannelsList>([&] APRINTER_TL(channel, channel::start_commands(c)));
         
         TimeType time = o->m_staging_time;
@@ -1255,15 +2414,20 @@ private:
             if (AMBRO_LIKELY((entry->dir_and_type & TypeMask) == 0)) {
                 typename TheLinearPlanner::SegmentResult result;
                 v = TheLinearPlanner::pull(&entry->axes.lp_seg, &o->m_segment_state[i], v, &result);
-                FpType v_end = FloatSqrt(v);
-                FpType v_const = FloatSqrt(result.const_v);
+                FpType v_end = FixedPlanningFeature::export_v(c, v);
+                FpType v_const = FixedPlanningFeature::export_v(c, result.const_v);
+                FpType const_start = FixedPlanningFeature::export_frac(result.const_start);
+                FpType const_end = FixedPlanningFeature::export_frac(result.const_end);
                 FpType vdiff0 = v_const - v_start;
                 FpType vdiff2 = v_const - v_end;
                 FpType t0_double = vdiff0 * entry->axes.max_accel_rec;
-                MinTimeType t0 = MinTimeType::importFpSaturatedRound(t0_double);
                 FpType t2_double = vdiff2 * entry->axes.max_accel_rec;
+                FpType t1_double;
+                FpType ramp0 = vdiff0 * vdiff0;
+                FpType ramp2 = vdiff2 * vdiff2;
+                RampExtensionFeature::extend_ramps(c, entry, &const_start, &const_end, v_start, v_end, v_const, &t0_double, &t2_double, &t1_double, &ramp0, &ramp2);
+                MinTimeType t0 = MinTimeType::importFpSaturatedRound(t0_double);
                 MinTimeType t2 = MinTimeType::importFpSaturatedRound(t2_double);
-                FpType t1_double = (1.0f - result.const_start - result.const_end) * entry->axes.rel_max_speed_rec;
                 MinTimeType t1 = MinTimeType::importFpSaturatedRound(t1_double);
                 auto t_sum = t0 + t2 + t1;
                 if (AMBRO_UNLIKELY(t_sum > MinTimeType::maxValue())) {
@@ -1276,8 +2440,8 @@ private:
                 }
                 time += t_sum.bitsValue();
                 ListFor<AxesList>([&] APRINTER_TL(axis, axis::gen_segment_stepper_commands(c, entry,
-                                    result.const_start, result.const_end, t0, t2, t1,
-                                    vdiff0 * vdiff0, vdiff2 * vdiff2)));
+                                    const_start, const_end, t0, t2, t1,
+                                    ramp0, ramp2, v_end, v_const)));
                 ListFor<LasersList>([&] APRINTER_TL(laser, laser::gen_segment_stepper_commands(c, entry,
                     t0, t2, t1, v_start, v_end, v_const)));
                 v_start = v_end;
@@ -1293,24 +2457,29 @@ private:
                 o->m_staging_time = time;
                 o->m_staging_v_squared = v;
                 o->m_staging_v = v_start;
+                ListFor<AxesList>([&] APRINTER_TL(axis, axis::save_staging(c)));
             }
         } while (i != o->m_segments_length);
         
         bool ok;
+        ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::do_commit(c)));
         if (AMBRO_UNLIKELY(o->m_state == STATE_BUFFERING)) {
             ok = true;
-            ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::do_commit(c)));
+            o->m_commit_fresh = (CommitMaskType)-1;
             ListFor<ChannelsList>([&] APRINTER_TL(channel, channel::do_commit_cold(c)));
             o->m_current_backup = !o->m_current_backup;
         } else {
             AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
                 ok = o->m_syncing;
                 if (AMBRO_LIKELY(ok)) {
-                    ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::do_commit(c)));
+                    o->m_commit_fresh = (CommitMaskType)-1;
                     ListFor<ChannelsList>([&] APRINTER_TL(channel, channel::do_commit_hot(lock_c)));
                     o->m_current_backup = !o->m_current_backup;
                 }
             }
+            if (AMBRO_LIKELY(ok)) {
+                AdaptiveCommitFeature::finish_plan(c);
+            }
         }
         
         if (AMBRO_LIKELY(ok)) {
@@ -1321,6 +2490,18 @@ private:
             o->m_planned = true;
 #endif
         }
+#ifdef MOTIONPLANNER_METRICS
+        TimeType plan_time = Clock::getTime(c) - plan_start_time;
+        o->m_metrics.plan_count++;
+        o->m_metrics.plan_time_min = MinValue(o->m_metrics.plan_time_min, plan_time);
+        o->m_metrics.plan_time_max = MaxValue(o->m_metrics.plan_time_max, plan_time);
+        o->m_metrics.plan_time_sum += plan_time;
+        if (AMBRO_LIKELY(ok)) {
+            o->m_metrics.commit_count += commit_count;
+        } else {
+            o->m_metrics.commit_fail_count++;
+        }
+#endif
         return ok;
     }
     
@@ -1334,6 +2515,7 @@ private:
         o->m_state = STATE_STEPPING;
         TimeType start_time = Clock::getTime(c) + (TimeType)(0.05 * Context::Clock::time_freq);
         o->m_staging_time += start_time;
+        o->m_commit_fresh = 0;
         ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::start_stepping(c, start_time)));
         ListFor<ChannelsList>([&] APRINTER_TL(channel, channel::start_stepping(c, start_time)));
     }
@@ -1404,11 +2586,11 @@ private:
                     Context::EventLoop::template triggerFastEvent<CallbackFastEvent>(c);
                     return;
                 }
-                if (o->m_segments_staging_length != o->m_segments_length && planner_have_commit_space(c)) {
+                if ((o->m_segments_staging_length != o->m_segments_length || o->m_replan_pending) && planner_have_commit_space(c)) {
                     plan(c);
                 }
                 planner_start_stepping(c);
-            } else if (o->m_segments_staging_length != o->m_segments_length) {
+            } else if (o->m_segments_staging_length != o->m_segments_length || o->m_replan_pending) {
                 bool cleared;
                 AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
                     cleared = o->m_syncing && planner_have_commit_space(c);
@@ -1440,6 +2622,16 @@ private:
                 if (AMBRO_UNLIKELY(!ok)) {
                     return;
                 }
+            } else if (AMBRO_UNLIKELY(o->m_replan_pending) && o->m_state == STATE_STEPPING && o->m_segments_length > 1) {
+                // Apply a speed change without waiting for the buffer to fill up.
+                // The last segment is kept so as not to commit a stop at the end.
+                bool cleared;
+                AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+                    cleared = o->m_syncing && planner_have_commit_space(c);
+                }
+                if (cleared && !plan(c, true)) {
+                    return;
+                }
             }
             
             if (AMBRO_LIKELY(o->m_split_buffer.type == 0xFF)) {
@@ -1476,9 +2668,15 @@ private:
         o->m_staging_time = 0;
         o->m_staging_v_squared = 0.0f;
         o->m_staging_v = 0.0f;
+        ListFor<AxesList>([&] APRINTER_TL(axis, axis::reset_staging(c)));
+        ListFor<ChannelsList>([&] APRINTER_TL(channel, channel::reset_staging(c)));
 #ifdef AMBROLIB_ASSERTIONS
         o->m_planned = false;
 #endif
+#ifdef MOTIONPLANNER_METRICS
+        o->m_metrics.underrun_count++;
+#endif
+        AdaptiveCommitFeature::underrun(c);
         UnderrunCallback::call(c);
     }
     
@@ -1493,6 +2691,11 @@ private:
         entry->dir_and_type = o->m_split_buffer.type;
         
         if (AMBRO_LIKELY(o->m_split_buffer.type == 0)) {
+#ifdef MOTIONPLANNER_METRICS
+            if (o->m_split_buffer.axes.split_pos > 0) {
+                o->m_metrics.split_count++;
+            }
+#endif
             o->m_split_buffer.axes.split_pos++;
             ListFor<AxesList>([&] APRINTER_TL(axis, axis::write_segment_buffer_entry(c, entry)));
             
@@ -1502,13 +2705,17 @@ private:
             FpType sync_steps_time = 0.0f;
             FpType async_steps_time = APRINTER_CFG(Config, CMinSegmentTime, c); // ensure a minimum duration even in absence of any axes
             ListFor<AxisCommonList>([&] APRINTER_TL(axis, axis::compute_steps_time(c, entry, &cst, &sync_steps_time, &async_steps_time)));
-            FpType base_rel_max_speed = FloatMax(o->m_split_buffer.axes.rel_max_v_rec, FloatMax(sync_steps_time, async_steps_time));
-            entry->axes.rel_max_speed_rec = ListForFold<AxisCommonList>(base_rel_max_speed, [&] APRINTER_TLA(axis, (FpType accum), return axis::compute_segment_buffer_entry_speed(accum, c, entry, &cst)));
+            FpType base_rel_max_speed = FloatMax(sync_steps_time, async_steps_time);
+            FpType limit_rel_max_speed = ListForFold<AxisCommonList>(base_rel_max_speed, [&] APRINTER_TLA(axis, (FpType accum), return axis::compute_segment_buffer_entry_speed(accum, c, entry, &cst)));
             
             FpType distance = ListForFold<AxesList>(FloatIdentity(), [&] APRINTER_TLA(axis, (auto accum), return axis::compute_segment_buffer_entry_distance(accum, c, &cst)));
             bool degenerate = (distance == 0.0f);
+            FpType feed_rel_max_speed = o->m_split_buffer.axes.rel_max_v_rec;
             if (degenerate) {
                 distance = 1.0f;
+                // A dwell is not a feedrate, it is not affected by scaleFeedTime.
+                limit_rel_max_speed = FloatMax(limit_rel_max_speed, feed_rel_max_speed);
+                feed_rel_max_speed = 0.0f;
             }
             FpType distance_rec = 1.0f / distance;
             
@@ -1517,17 +2724,27 @@ private:
             FpType rel_max_accel_rec = ListForFold<AxesList>(FloatIdentity(), [&] APRINTER_TLA(axis, (auto accum), return axis::compute_segment_buffer_entry_accel(accum, c, &cst)));
             entry->axes.max_accel_rec = rel_max_accel_rec * distance_rec;
             FpType half_rel_max_accel = 0.5f / rel_max_accel_rec;
+            RampExtensionFeature::write_segment_ramp_times(c, entry, &cst, rel_max_accel_rec, distance_rec);
+            limit_rel_max_speed = ListForFold<AxesList>(limit_rel_max_speed, [&] APRINTER_TLA(axis, (FpType accum), return axis::compute_segment_buffer_entry_advance_speed(accum, c, &cst, rel_max_accel_rec)));
+            entry->axes.feed_rel_max_speed_rec = feed_rel_max_speed;
+            entry->axes.limit_rel_max_speed_rec = limit_rel_max_speed;
+            entry->axes.rel_max_speed_rec = FloatMax(limit_rel_max_speed, feed_rel_max_speed);
             
             FpType distance_rec_for_junction = AMBRO_UNLIKELY(degenerate) ? NAN : distance_rec;
             FpType junction_max_v_rec = ListForFold<AxesList>(FloatIdentity(), [&] APRINTER_TLA(axis, (auto accum), return axis::do_junction_limit(accum, c, entry, distance_rec_for_junction, &cst)));
             FpType junction_max_start_v = AMBRO_UNLIKELY(FloatIsNan(junction_max_v_rec)) ? 0.0f : (1.0f / junction_max_v_rec);
+            junction_max_start_v = JunctionDeviationFeature::limit_start_v(c, entry, &cst, distance, degenerate, junction_max_start_v);
             o->m_last_dir_and_type = entry->dir_and_type;
             
             FpType distance_squared = distance * distance;
             FpType max_v = distance_squared / (entry->axes.rel_max_speed_rec * entry->axes.rel_max_speed_rec);
             FpType a_x = FloatLdexp(half_rel_max_accel * distance_squared, 2);
-            TheLinearPlanner::initSegment(&entry->axes.lp_seg, o->m_last_max_v, junction_max_start_v, max_v, a_x);
-            o->m_last_max_v = max_v;
+            PlannerFpType planner_max_v = FixedPlanningFeature::import_v_squared(c, max_v);
+            entry->axes.distance_squared = distance_squared;
+            entry->axes.junction_max_start_v = FixedPlanningFeature::import_v_squared(c, junction_max_start_v);
+            TheLinearPlanner::initSegment(&entry->axes.lp_seg, o->m_last_max_v, entry->axes.junction_max_start_v, planner_max_v, FixedPlanningFeature::import_v_squared(c, a_x));
+            RampExtensionFeature::limit_speed_change(c, entry);
+            o->m_last_max_v = planner_max_v;
             
             if (AMBRO_LIKELY(o->m_split_buffer.axes.split_pos == o->m_split_buffer.axes.split_count)) {
                 o->m_split_buffer.type = 0xFF;
@@ -1556,25 +2773,31 @@ private:
 public:
     struct Object : public ObjBase<MotionPlanner, ParentObject, JoinTypeLists<
         AxisCommonList,
-        ChannelsList
+        ChannelsList,
+        MakeTypeList<AdaptiveCommitFeature, JunctionDeviationFeature, RampExtensionFeature, FixedPlanningFeature>
     >> {
         SegmentBufferSizeType m_segments_start;
         SegmentBufferSizeType m_segments_staging_length;
         SegmentBufferSizeType m_segments_length;
         TimeType m_staging_time;
-        FpType m_staging_v_squared;
+        PlannerFpType m_staging_v_squared;
         FpType m_staging_v;
-        FpType m_last_max_v;
+        PlannerFpType m_last_max_v;
         AxisMaskType m_last_dir_and_type;
         uint8_t m_state;
+        bool m_replan_pending;
         bool m_waiting;
         bool m_aborted;
         bool m_syncing;
         bool m_current_backup;
         bool m_new_to_backup;
+        CommitMaskType m_commit_fresh;
 #ifdef AMBROLIB_ASSERTIONS
         bool m_pulling;
         bool m_planned;
+#endif
+#ifdef MOTIONPLANNER_METRICS
+        Metrics m_metrics;
 #endif
         SplitBuffer m_split_buffer;
         Segment m_segments[LookaheadBufferSize];
@@ -1590,14 +2813,18 @@ APRINTER_ALIAS_STRUCT_EXT(MotionPlannerArg, (
     APRINTER_AS_VALUE(int, StepperSegmentBufferSize),
     APRINTER_AS_VALUE(int, LookaheadBufferSize),
     APRINTER_AS_VALUE(int, LookaheadCommitCount),
+    APRINTER_AS_VALUE(int, MinLookaheadCommitCount),
     APRINTER_AS_TYPE(FpType),
+    APRINTER_AS_TYPE(PlannerFpType),
     APRINTER_AS_TYPE(MaxStepsPerCycle),
     APRINTER_AS_TYPE(PullHandler),
     APRINTER_AS_TYPE(FinishedHandler),
     APRINTER_AS_TYPE(AbortedHandler),
     APRINTER_AS_TYPE(UnderrunCallback),
     APRINTER_AS_TYPE(ParamsChannelsList),
-    APRINTER_AS_TYPE(ParamsLasersList)
+    APRINTER_AS_TYPE(ParamsLasersList),
+    APRINTER_AS_VALUE(bool, JerkLimitEnabled),
+    APRINTER_AS_TYPE(JunctionDeviationParams)
 ), (
     APRINTER_DEF_INSTANCE(MotionPlannerArg, MotionPlanner)
 ))
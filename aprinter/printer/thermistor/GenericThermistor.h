@@ -44,6 +44,8 @@ class GenericThermistor {
     
     using RInf = decltype(Config::e(Params::ThermistorR0::i()) * ExprExp(-Config::e(Params::ThermistorBeta::i()) / RoomTemp()));
     
+    using LogRByRInf = decltype(ExprLog(Config::e(Params::ResistorR::i()) / RInf()));
+    
     template <typename Temp>
     static auto FracThermistor (Temp) -> decltype((RInf() * ExprExp(Config::e(Params::ThermistorBeta::i()) / (Temp() + ZeroCelsiusTemp()))) / Config::e(Params::ResistorR::i()));
     
@@ -53,6 +55,13 @@ public:
     template <typename Temp>
     static auto TempToAdc (Temp) -> decltype(FracThermistor(Temp()) / (One() + FracThermistor(Temp())));
     
+    template <typename Adc>
+    static auto AdcToTemp (Adc) -> decltype(Config::e(Params::ThermistorBeta::i()) / (ExprLog(Adc() / (One() - Adc())) + LogRByRInf()) - ZeroCelsiusTemp());
+    
+    // The range of ADC values where the formula is considered reliable.
+    using MinAdc = decltype(TempToAdc(Config::e(Params::MaxTemp::i())));
+    using MaxAdc = decltype(TempToAdc(Config::e(Params::MinTemp::i())));
+    
     static FpType adcToTemp (Context c, FpType adc)
     {
         if (!(adc >= APRINTER_CFG(Config, CAdcMaxTemp, c))) {
@@ -66,10 +75,10 @@ public:
     }
     
 private:
-    using CAdcMinTemp = decltype(ExprCast<FpType>(TempToAdc(Config::e(Params::MinTemp::i()))));
-    using CAdcMaxTemp = decltype(ExprCast<FpType>(TempToAdc(Config::e(Params::MaxTemp::i()))));
+    using CAdcMinTemp = decltype(ExprCast<FpType>(MaxAdc()));
+    using CAdcMaxTemp = decltype(ExprCast<FpType>(MinAdc()));
     using CThermistorBeta = decltype(ExprCast<FpType>(Config::e(Params::ThermistorBeta::i())));
-    using CLogRByRInf = decltype(ExprCast<FpType>(ExprLog(Config::e(Params::ResistorR::i()) / RInf())));
+    using CLogRByRInf = decltype(ExprCast<FpType>(LogRByRInf()));
     
 public:
     struct Object {};
@@ -60,6 +60,12 @@ public:
     
     // Convert ADC value to temperature
     static FpType adcToTemp (Context, FpType adc)
+    {
+        return adcToTempLookup(adc);
+    }
+    
+private:
+    static FpType adcToTempLookup (FpType adc)
     {
         if (AMBRO_UNLIKELY(FloatIsNan(adc))) {
             return adc;
@@ -98,8 +104,7 @@ public:
         
         return interpolate(adc, adc_i, adc_j, temp_i, temp_j);
     }
-
-private:
+    
     static constexpr FpType interpolate (FpType x, FpType x1, FpType x2, FpType y1, FpType y2)
     {
         FpType frac = (x - x1) / (x2 - x1);
@@ -199,6 +204,49 @@ private:
         using Result = typename StaticTempToAdcBisect<IndexI, IndexJ, Temp>::Result;
     };
     
+    // The same for compile-time mapping from ADC values to temperature,
+    // used for generating derived tables (UniformTableThermistor).
+    template <int IndexI, int IndexJ, typename Adc>
+    struct StaticAdcToTempBisect {
+        static_assert(IndexI >= 0 && IndexJ < TableLength, "");
+        static_assert(IndexJ > IndexI, "");
+        
+        static constexpr double AdcI = AdcArray::template ReadAt<IndexI>::value();
+        static constexpr double AdcJ = AdcArray::template ReadAt<IndexJ>::value();
+        
+        AMBRO_STRUCT_IF(CheckEnd, IndexJ == IndexI + 1) {
+            static constexpr double TempI = TempArray::template ReadAt<IndexI>::value();
+            static constexpr double TempJ = TempArray::template ReadAt<IndexJ>::value();
+            
+            using Result = AMBRO_WRAP_DOUBLE(
+                interpolate(Adc::value(), AdcI, AdcJ, TempI, TempJ));
+        }
+        AMBRO_STRUCT_ELSE(CheckEnd) {
+            static int const IndexK = (IndexI + IndexJ) / 2;
+            static constexpr double AdcK = AdcArray::template ReadAt<IndexK>::value();
+            static bool const LeftOfK = Adc::value() < AdcK;
+            
+            using Result = typename StaticAdcToTempBisect<
+                (LeftOfK ? IndexI : IndexK),
+                (LeftOfK ? IndexK : IndexJ),
+                Adc
+            >::Result;
+        };
+        
+        using Result = typename CheckEnd::Result;
+    };
+    
+    template <typename Adc>
+    struct StaticAdcToTempStart {
+        static int const IndexI = 0;
+        static int const IndexJ = TableLength - 1;
+        
+        static_assert(Adc::value() >= AdcArray::template ReadAt<IndexI>::value(), "");
+        static_assert(Adc::value() <= AdcArray::template ReadAt<IndexJ>::value(), "");
+        
+        using Result = typename StaticAdcToTempBisect<IndexI, IndexJ, Adc>::Result;
+    };
+    
     // And almost exactly the same thing for runtime use. Fun!
     static FpType tempToAdc (FpType temp)
     {
@@ -257,6 +305,22 @@ public:
     template <typename Temp>
     static auto TempToAdc (Temp) -> NaryExpr<ExprFunc__TempToAdc, Temp>;
     
+private:
+    APRINTER_DEFINE_UNARY_EXPR_FUNC_CLASS(AdcToTemp,
+        StaticAdcToTempStart<Op1>::Result::value(),
+        adcToTempLookup(arg1)
+    )
+    
+public:
+    // Expr function to convert ADC value to temperature, for
+    // compile-time evaluation within [MinAdc, MaxAdc].
+    template <typename Adc>
+    static auto AdcToTemp (Adc) -> NaryExpr<ExprFunc__AdcToTemp, Adc>;
+    
+    // The range of ADC values covered by the table.
+    using MinAdc = DoubleConstantExpr<typename AdcArray::template ReadAt<0>>;
+    using MaxAdc = DoubleConstantExpr<typename AdcArray::template ReadAt<TableLength - 1>>;
+    
 public:
     struct Object {};
 };
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_UNIFORM_TABLE_THERMISTOR_H
+#define APRINTER_UNIFORM_TABLE_THERMISTOR_H
+
+#include <math.h>
+
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/StaticArray.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/meta/ChooseInt.h>
+#include <aprinter/meta/MinMax.h>
+#include <aprinter/base/Hints.h>
+#include <aprinter/math/FloatTools.h>
+
+namespace APrinter {
+    
+/*
+ * Wraps another formula (InterpolationTableThermistor, GenericThermistor)
+ * and converts ADC values to temperatures using a table of TableSize
+ * temperatures at uniformly spaced ADC values, generated at compile time
+ * from the formula. A conversion is then a single index computation and
+ * linear interpolation, instead of a table search or logarithm.
+ *
+ * The wrapped formula must provide the AdcToTemp expression function
+ * and the MinAdc/MaxAdc expressions, and its configuration must be
+ * constant. Temperature to ADC conversion is forwarded to the formula.
+ */
+template <typename Arg>
+class UniformTableThermistor {
+    APRINTER_USE_TYPES1(Arg, (Context, Config, FpType, Params))
+    
+public:
+    struct Object;
+    
+private:
+    APRINTER_MAKE_INSTANCE(TheFormula, (Params::InnerFormula::template Formula<Context, Object, Config, FpType>))
+    
+    static int const TableSize = Params::TableSize;
+    static_assert(TableSize >= 2, "");
+    
+    // Integer type sufficient to point to a table entry
+    using IndexType = ChooseIntForMax<TableSize, false>;
+    
+    // Floating point type for table entries
+    using TableFpType = float;
+    
+    using MinAdc = typename TheFormula::MinAdc;
+    using MaxAdc = typename TheFormula::MaxAdc;
+    static_assert(MinAdc::IsConstexpr && MaxAdc::IsConstexpr,
+                  "UniformTableThermistor requires constant formula configuration.");
+    static_assert(MinAdc::value() < MaxAdc::value(), "");
+    
+    static constexpr double AdcStart = MinAdc::value();
+    static constexpr double AdcStep = (MaxAdc::value() - MinAdc::value()) / (TableSize - 1);
+    
+    // This is given to StaticArray to get the value of each TempArray element.
+    template <int EntryIndex>
+    class GetTempArrayEntry {
+        // The last entry uses MaxAdc directly so that rounding does
+        // not take it out of the range of the formula.
+        using EntryAdc = APRINTER_FP_CONST_EXPR((EntryIndex == TableSize - 1) ? MaxAdc::value() : (AdcStart + EntryIndex * AdcStep));
+        using EntryTemp = decltype(TheFormula::AdcToTemp(EntryAdc()));
+        static_assert(EntryTemp::IsConstexpr, "");
+        
+        static constexpr double StaticValue = EntryTemp::value();
+        
+    public:
+        static constexpr TableFpType value ()
+        {
+            return StaticValue;
+        }
+    };
+    
+    using TempArray = StaticArray<TableFpType, TableSize, GetTempArrayEntry>;
+    
+public:
+    // Whether the conversion has positive or negative slope
+    static bool const NegativeSlope = TheFormula::NegativeSlope;
+    
+    // Convert ADC value to temperature
+    static FpType adcToTemp (Context, FpType adc)
+    {
+        if (AMBRO_UNLIKELY(FloatIsNan(adc))) {
+            return adc;
+        }
+        
+        FpType pos = (adc - (FpType)AdcStart) * (FpType)(1.0 / AdcStep);
+        
+        if (AMBRO_UNLIKELY(!(pos >= 0.0f))) {
+            return NegativeSlope ? INFINITY : -INFINITY;
+        }
+        if (AMBRO_UNLIKELY(!(pos <= (FpType)(TableSize - 1)))) {
+            return NegativeSlope ? -INFINITY : INFINITY;
+        }
+        
+        IndexType i = MinValue((IndexType)pos, (IndexType)(TableSize - 2));
+        FpType frac = pos - i;
+        
+        FpType temp_i = TempArray::readAt(i);
+        FpType temp_j = TempArray::readAt(i + 1);
+        
+        return temp_i + frac * (temp_j - temp_i);
+    }
+    
+    // Expr function to convert temperature to ADC value.
+    template <typename Temp>
+    static auto TempToAdc (Temp) -> decltype(TheFormula::TempToAdc(Temp()));
+    
+public:
+    struct Object {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(UniformTableThermistorService, (
+    APRINTER_AS_TYPE(InnerFormula),
+    APRINTER_AS_VALUE(int, TableSize)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Formula, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Config),
+        APRINTER_AS_TYPE(FpType)
+    ), (
+        using Params = UniformTableThermistorService;
+        APRINTER_DEF_INSTANCE(Formula, UniformTableThermistor)
+    ))
+))
+
+}
+
+#endif
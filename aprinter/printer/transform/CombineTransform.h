@@ -54,6 +54,12 @@ public:
         return ListForBreak<HelpersList>([&] APRINTER_TL(helper, return helper::virt_to_phys(c, virt, out_phys)));
     }
     
+    template <typename Batch>
+    static int virtToPhysBatch (Context c, Batch batch, int count)
+    {
+        return ListForFold<HelpersList>(count, [&] APRINTER_TLA(helper, (int accum), return helper::virt_to_phys_batch(c, batch, accum)));
+    }
+    
     template <typename Src, typename Dst>
     static void physToVirt (Context c, Src phys, Dst out_virt)
     {
@@ -77,6 +83,12 @@ private:
             return TheTransform::virtToPhys(c, OffsetSrc<Src>{virt}, OffsetDst<Dst>{out_phys});
         }
         
+        template <typename Batch>
+        static int virt_to_phys_batch (Context c, Batch batch, int count)
+        {
+            return TheTransform::virtToPhysBatch(c, OffsetBatch<Batch>{batch}, count);
+        }
+        
         template <typename Src, typename Dst>
         static void phys_to_virt (Context c, Src phys, Dst out_virt)
         {
@@ -95,6 +107,13 @@ private:
             template <int Index> void set (FpType x) { dst.template set<(AxisStartIndex+Index)>(x); }
         };
         
+        template <typename Batch>
+        struct OffsetBatch {
+            Batch &batch;
+            template <int Index> FpType const * virt () { return batch.template virt<(AxisStartIndex+Index)>(); }
+            template <int Index> FpType * phys () { return batch.template phys<(AxisStartIndex+Index)>(); }
+        };
+        
         struct Object : public ObjBase<Helper, typename CombineTransform::Object, MakeTypeList<
             TheTransform
         >> {};
@@ -44,6 +44,20 @@ public:
         return true;
     }
     
+    template <typename Batch>
+    static int virtToPhysBatch (Context c, Batch batch, int count)
+    {
+        auto const *x = batch.template virt<0>();
+        auto const *y = batch.template virt<1>();
+        auto *a = batch.template phys<0>();
+        auto *b = batch.template phys<1>();
+        for (int i = 0; i < count; i++) {
+            a[i] = x[i] + y[i];
+            b[i] = x[i] - y[i];
+        }
+        return count;
+    }
+    
     template <typename Src, typename Dst>
     static void physToVirt (Context c, Src phys, Dst out_virt)
     {
@@ -33,6 +33,7 @@
 #include <aprinter/math/Vector3.h>
 #include <aprinter/math/FloatTools.h>
 #include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/transform/TransformBatch.h>
 
 namespace APrinter {
 
@@ -67,6 +68,28 @@ public:
         return true;
     }
     
+    template <typename Batch>
+    static int virtToPhysBatch (Context c, Batch batch, int count)
+    {
+        FpType const *x = batch.template virt<0>();
+        FpType const *y = batch.template virt<1>();
+        FpType const *z = batch.template virt<2>();
+        FpType limit_radius2 = APRINTER_CFG(Config, CLimitRadius2, c);
+        
+        for (int i = 0; i < count; i++) {
+            if (!(x[i]*x[i] + y[i]*y[i] <= limit_radius2)) {
+                count = i;
+                break;
+            }
+        }
+        
+        FpType diagonal_rod2 = APRINTER_CFG(Config, CDiagonalRod2, c);
+        tower_batch(diagonal_rod2, APRINTER_CFG(Config, CTower1X, c), APRINTER_CFG(Config, CTower1Y, c), x, y, z, batch.template phys<0>(), count);
+        tower_batch(diagonal_rod2, APRINTER_CFG(Config, CTower2X, c), APRINTER_CFG(Config, CTower2Y, c), x, y, z, batch.template phys<1>(), count);
+        tower_batch(diagonal_rod2, APRINTER_CFG(Config, CTower3X, c), APRINTER_CFG(Config, CTower3Y, c), x, y, z, batch.template phys<2>(), count);
+        return count;
+    }
+    
     template <typename Src, typename Dst>
     static void physToVirt (Context c, Src phys, Dst out_virt)
     {
@@ -89,6 +112,14 @@ public:
     }
     
 private:
+    // Branch-free so that the compiler can vectorize it.
+    static void tower_batch (FpType diagonal_rod2, FpType tower_x, FpType tower_y, FpType const *x, FpType const *y, FpType const *z, FpType *out, int count)
+    {
+        for (int i = 0; i < count; i++) {
+            out[i] = FloatSqrt(diagonal_rod2 - FloatSquare(tower_x - x[i]) - FloatSquare(tower_y - y[i])) + z[i];
+        }
+    }
+    
     using DiagonalRod = decltype(Config::e(Params::DiagonalRod::i()));
     using Radius = decltype(Config::e(Params::SmoothRodOffset::i()) - Config::e(Params::EffectorOffset::i()) - Config::e(Params::CarriageOffset::i()));
     using LimitRadius = decltype(Config::e(Params::LimitRadius::i()));
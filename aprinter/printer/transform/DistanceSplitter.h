@@ -52,12 +52,23 @@ private:
     using CMinSplitLengthRec = decltype(ExprCast<FpType>(ExprRec(Config::e(Params::MinSplitLength::i()))));
     using CMaxSplitLengthRec = decltype(ExprCast<FpType>(ExprRec(Config::e(Params::MaxSplitLength::i()))));
     using CSegmentsPerSecondTimeUnit = decltype(ExprCast<FpType>(Config::e(Params::SegmentsPerSecond::i()) * ClockTimeUnit()));
+    using CMaxDeviation = decltype(ExprCast<FpType>(Config::e(Params::MaxDeviation::i())));
     
 public:
     class Splitter {
     public:
         void start (Context c, FpType distance, FpType base_max_v_rec, FpType time_freq_by_max_speed)
         {
+            if (APRINTER_CFG(Config, CMaxDeviation, c) > 0.0f) {
+                m_count = 0;
+                m_frac = 0.0f;
+                m_min_step = FloatMin(FpType(1.0f), FpType(1.0f) / (distance * APRINTER_CFG(Config, CMinSplitLengthRec, c)));
+                m_max_step = FloatMin(FpType(1.0f), FpType(1.0f) / (distance * APRINTER_CFG(Config, CMaxSplitLengthRec, c)));
+                m_step = m_max_step;
+                m_max_v_rec = base_max_v_rec;
+                return;
+            }
+            
             FpType base_segments_by_distance = APRINTER_CFG(Config, CSegmentsPerSecondTimeUnit, c) * time_freq_by_max_speed;
             FpType fpcount = distance * FloatMin(APRINTER_CFG(Config, CMinSplitLengthRec, c), FloatMax(APRINTER_CFG(Config, CMaxSplitLengthRec, c), base_segments_by_distance));
             if (fpcount >= FloatLdexp(FpType(1.0f), 31)) {
@@ -69,8 +80,13 @@ public:
             m_max_v_rec = base_max_v_rec / m_count;
         }
         
-        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac)
+        template <typename DeviationFunc>
+        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac, DeviationFunc deviation)
         {
+            if (m_count == 0) {
+                return pull_adaptive(c, out_rel_max_v_rec, out_frac, deviation);
+            }
+            
             *out_rel_max_v_rec = m_max_v_rec;
             if (m_pos == m_count) {
                 return false;
@@ -80,14 +96,71 @@ public:
             return true;
         }
         
+        // Fractions of the pieces after the last pulled one, excluding the
+        // final piece, so that they can be transformed in advance.
+        int peek (Context c, FpType *out_fracs, int max_count)
+        {
+            int count = 0;
+            for (uint32_t pos = m_pos; count < max_count && m_count != 0 && pos < m_count; pos++) {
+                out_fracs[count++] = (FpType)pos / m_count;
+            }
+            return count;
+        }
+        
+    private:
+        // Error-bounded splitting, used when MaxDeviation is positive.
+        // The deviation function gives the distance between the transformed
+        // midpoint of a piece and the midpoint of its linear approximation
+        // in physical coordinates. The piece is halved until this is within
+        // MaxDeviation, and the next piece is tried with double the length
+        // when the deviation was well below the limit. This is checked for
+        // every piece, also at the minimum length, so that the length grows
+        // back where the path gets straighter. Piece lengths stay between
+        // MinSplitLength and MaxSplitLength, SegmentsPerSecond is not used.
+        template <typename DeviationFunc>
+        bool pull_adaptive (Context c, FpType *out_rel_max_v_rec, FpType *out_frac, DeviationFunc deviation)
+        {
+            FpType max_deviation = APRINTER_CFG(Config, CMaxDeviation, c);
+            FpType rem = 1.0f - m_frac;
+            FpType step = FloatMin(m_step, rem);
+            
+            while (true) {
+                FpType end = (step < rem) ? (m_frac + step) : FpType(1.0f);
+                FpType dev = deviation(m_frac, end);
+                if (dev <= max_deviation) {
+                    if (dev <= 0.25f * max_deviation) {
+                        m_step = FloatMin(m_max_step, 2.0f * step);
+                    }
+                    break;
+                }
+                if (!(step > m_min_step)) {
+                    break;
+                }
+                step = FloatMax(m_min_step, 0.5f * step);
+                m_step = step;
+            }
+            
+            *out_rel_max_v_rec = m_max_v_rec * FloatMin(step, rem);
+            if (!(step < rem)) {
+                return false;
+            }
+            m_frac += step;
+            *out_frac = m_frac;
+            return true;
+        }
+        
     private:
         uint32_t m_count;
         uint32_t m_pos;
         FpType m_max_v_rec;
+        FpType m_frac;
+        FpType m_step;
+        FpType m_min_step;
+        FpType m_max_step;
     };
     
 public:
-    using ConfigExprs = MakeTypeList<CMinSplitLengthRec, CMaxSplitLengthRec, CSegmentsPerSecondTimeUnit>;
+    using ConfigExprs = MakeTypeList<CMinSplitLengthRec, CMaxSplitLengthRec, CSegmentsPerSecondTimeUnit, CMaxDeviation>;
     
     struct Object : public ObjBase<DistanceSplitter, ParentObject, EmptyTypeList> {};
 };
@@ -95,7 +168,8 @@ public:
 APRINTER_ALIAS_STRUCT_EXT(DistanceSplitterService, (
     APRINTER_AS_TYPE(MinSplitLength),
     APRINTER_AS_TYPE(MaxSplitLength),
-    APRINTER_AS_TYPE(SegmentsPerSecond)
+    APRINTER_AS_TYPE(SegmentsPerSecond),
+    APRINTER_AS_TYPE(MaxDeviation)
 ), (
     APRINTER_ALIAS_STRUCT_EXT(Splitter, (
         APRINTER_AS_TYPE(Context),
@@ -46,6 +46,13 @@ public:
         return true;
     }
     
+    template <typename Batch>
+    static int virtToPhysBatch (Context c, Batch batch, int count)
+    {
+        ListFor<HelperList>([&] APRINTER_TL(helper, helper::copy_batch(batch, count)));
+        return count;
+    }
+    
     template <typename Src, typename Dst>
     static void physToVirt (Context c, Src phys, Dst out_virt)
     {
@@ -60,6 +67,16 @@ private:
         {
             dst.template set<AxisIndex>(src.template get<AxisIndex>());
         }
+        
+        template <typename Batch>
+        static void copy_batch (Batch batch, int count)
+        {
+            auto const *src = batch.template virt<AxisIndex>();
+            auto *dst = batch.template phys<AxisIndex>();
+            for (int i = 0; i < count; i++) {
+                dst[i] = src[i];
+            }
+        }
     };
     using HelperList = IndexElemListCount<NumAxes, Helper>;
     
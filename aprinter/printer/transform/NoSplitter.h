@@ -42,12 +42,18 @@ public:
             m_max_v_rec = base_max_v_rec;
         }
         
-        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac)
+        template <typename DeviationFunc>
+        bool pull (Context c, FpType *out_rel_max_v_rec, FpType *out_frac, DeviationFunc deviation)
         {
             *out_rel_max_v_rec = m_max_v_rec;
             return false;
         }
         
+        int peek (Context c, FpType *out_fracs, int max_count)
+        {
+            return 0;
+        }
+        
     private:
         FpType m_max_v_rec;
     };
@@ -32,6 +32,7 @@
 #include <aprinter/math/Vector3.h>
 #include <aprinter/math/FloatTools.h>
 #include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/transform/TransformBatch.h>
 
 namespace APrinter {
 
@@ -110,6 +111,12 @@ public:
         return true;
     }
     
+    template <typename Batch>
+    static int virtToPhysBatch (Context c, Batch batch, int count)
+    {
+        return TransformBatchPointwise<RotationalDeltaTransform, FpType>(c, batch, count);
+    }
+    
     template <typename Src, typename Dst>
     static void physToVirt (Context c, Src phys, Dst out_virt)
     {
@@ -33,6 +33,7 @@
 #include <aprinter/math/Vector3.h>
 #include <aprinter/math/FloatTools.h>
 #include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/transform/TransformBatch.h>
 #include <aprinter/printer/Console.h>
 
 namespace APrinter {
@@ -97,6 +98,12 @@ public:
         return true;
     }
 
+    template <typename Batch>
+    static int virtToPhysBatch (Context c, Batch batch, int count)
+    {
+        return TransformBatchPointwise<SCARATransform, FpType>(c, batch, count);
+    }
+
     template <typename Src, typename Dst>
     static void physToVirt (Context c, Src phys, Dst out_virt)
     {
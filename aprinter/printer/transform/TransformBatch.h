@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef APRINTER_TRANSFORM_BATCH_H
+#define APRINTER_TRANSFORM_BATCH_H
+
+namespace APrinter {
+
+/*
+ * Support for batched inverse kinematics.
+ * 
+ * A transform provides virtToPhysBatch(c, batch, count), which converts
+ * the first count points of a batch from virtual to physical coordinates.
+ * The batch is accessed through the member functions virt<Index>() and
+ * phys<Index>(), returning the arrays of virtual respectively physical
+ * coordinates of the axis Index. Conversion stops at the first point
+ * which cannot be transformed, and the number of points which have been
+ * converted is returned.
+ * 
+ * Transforms whose computation does not fit a per-axis loop use
+ * TransformBatchPointwise, which calls virtToPhys for each point.
+ */
+
+template <typename FpType, typename Batch>
+struct TransformBatchPointSrc {
+    Batch &batch;
+    int i;
+    template <int Index> FpType get () { return batch.template virt<Index>()[i]; }
+};
+
+template <typename FpType, typename Batch>
+struct TransformBatchPointDst {
+    Batch &batch;
+    int i;
+    template <int Index> void set (FpType x) { batch.template phys<Index>()[i] = x; }
+};
+
+template <typename Transform, typename FpType, typename Context, typename Batch>
+int TransformBatchPointwise (Context c, Batch batch, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (!Transform::virtToPhys(c, TransformBatchPointSrc<FpType, Batch>{batch, i}, TransformBatchPointDst<FpType, Batch>{batch, i})) {
+            return i;
+        }
+    }
+    return count;
+}
+
+}
+
+#endif
@@ -118,10 +118,12 @@ private:
     using PlannerMaxAccelRec = decltype(ExprRec(MaxAccel() * AccelConversion()));
     using PlannerDistanceFactor = APRINTER_FP_CONST_EXPR(1.0);
     using PlannerCorneringDistance = APRINTER_FP_CONST_EXPR(1.0);
+    using PlannerMaxJerkRec = APRINTER_FP_CONST_EXPR(0.0);
+    using PlannerStepsPerUnit = APRINTER_FP_CONST_EXPR(1.0);
     
-    struct PlannerAxisSpec : public MotionPlannerAxisSpec<TheAxisDriver, PlannerStepBits, PlannerDistanceFactor, PlannerCorneringDistance, PlannerMaxSpeedRec, PlannerMaxAccelRec, PlannerPrestepCallback> {};
+    struct PlannerAxisSpec : public MotionPlannerAxisSpec<TheAxisDriver, PlannerStepBits, PlannerDistanceFactor, PlannerCorneringDistance, PlannerMaxSpeedRec, PlannerMaxAccelRec, PlannerMaxJerkRec, PlannerStepsPerUnit, MotionPlannerNoInputShaper, MotionPlannerNoPressureAdvance, PlannerPrestepCallback> {};
     using PlannerAxes = MakeTypeList<PlannerAxisSpec>;
-    APRINTER_MAKE_INSTANCE(Planner, (MotionPlannerArg<Context, Object, Config, PlannerAxes, StepperSegmentBufferSize, LookaheadBufferSize, LookaheadCommitCount, FpType, MaxStepsPerCycle, PlannerPullHandler, PlannerFinishedHandler, PlannerAbortedHandler, PlannerUnderrunCallback, EmptyTypeList, EmptyTypeList>))
+    APRINTER_MAKE_INSTANCE(Planner, (MotionPlannerArg<Context, Object, Config, PlannerAxes, StepperSegmentBufferSize, LookaheadBufferSize, LookaheadCommitCount, LookaheadCommitCount, FpType, MaxStepsPerCycle, PlannerPullHandler, PlannerFinishedHandler, PlannerAbortedHandler, PlannerUnderrunCallback, EmptyTypeList, EmptyTypeList, false, MotionPlannerNoJunctionDeviation>))
     using PlannerCommand = typename Planner::SplitBuffer;
     
     using TheDebugObject = DebugObject<Context, Object>;
@@ -39,6 +39,28 @@
 
 namespace APrinter {
 
+/*
+ * Parser for binary G-code as produced by aprinter_encode.py.
+ * 
+ * Each command starts with a header byte, the command type in the high
+ * nibble. For G0, G1 and G92 (types 1-3) and any other command (type 15,
+ * followed by two bytes with the letter and number) the low nibble is the
+ * number of parts. Then come the index bytes of the parts, each with
+ * the data type in the high three bits and the letter in the low five,
+ * and finally the part payloads. Type 14 is the end of file.
+ * 
+ * The second version of the format adds delta coding of positions.
+ * A delta setup packet (type 4, low nibble the number of slots n) is
+ * followed by n times a letter byte and a little endian float scale.
+ * It assigns these letters to delta slots and resets their values to
+ * zero. A part with data type 6 (DATA_TYPE_DELTA) has a slot letter and
+ * its payload is a zigzag LEB128 varint, which is added to the value of
+ * the slot. The value of the part is then the slot value times the scale.
+ * Packed moves (type 5 for G0, 6 for G1) have no index bytes, the low
+ * nibble is instead a mask of the first four slots present in the move,
+ * and the payload is a varint delta for each of these in slot order.
+ * The delta setup packet results in an empty command.
+ */
 template <typename Context, typename TBufferSizeType, typename FpType, typename Params>
 class BinaryGcodeParser
 : public GcodeCommand<Context, FpType>,
@@ -50,6 +72,9 @@ class BinaryGcodeParser
         CMD_TYPE_G0 = 1,
         CMD_TYPE_G1 = 2,
         CMD_TYPE_G92 = 3,
+        CMD_TYPE_DELTA_SETUP = 4,
+        CMD_TYPE_G0_PACKED = 5,
+        CMD_TYPE_G1_PACKED = 6,
         CMD_TYPE_EOF = 14,
         CMD_TYPE_LONG = 15,
     };
@@ -59,9 +84,14 @@ class BinaryGcodeParser
         DATA_TYPE_DOUBLE = 2,
         DATA_TYPE_UINT32 = 3,
         DATA_TYPE_UINT64 = 4,
-        DATA_TYPE_VOID = 5
+        DATA_TYPE_VOID = 5,
+        DATA_TYPE_DELTA = 6
     };
     
+    static int const MaxDeltaSlots = 8;
+    static int const PackedSlots = 4;
+    static int const MaxVarintSize = 5;
+    
 public:
     using BufferSizeType = TBufferSizeType;
     using PartsSizeType = int8_t;
@@ -73,13 +103,22 @@ private:
         uint8_t data_type;
         char code;
         uint8_t data_size;
+        uint8_t slot;
         uint8_t *data;
+        float delta_value;
+    };
+    
+    struct DeltaSlot {
+        char code;
+        float scale;
+        uint32_t value;
     };
     
 public:
     void init (Context c)
     {
         m_state = STATE_NOCMD;
+        m_num_slots = 0;
         
         this->debugInit(c);
     }
@@ -126,13 +165,17 @@ public:
                         return false;
                     }
                     m_length = 1;
-                    m_num_parts = m_buffer[0] & 0x0f;
-                    if (m_num_parts > Params::MaxParts) {
-                        m_num_parts = GCODE_ERROR_TOO_MANY_PARTS;
-                        goto finish;
+                    uint8_t cmd_type = m_buffer[0] >> 4;
+                    m_num_parts = 0;
+                    if (!is_packed(cmd_type) && cmd_type != CMD_TYPE_DELTA_SETUP) {
+                        m_num_parts = m_buffer[0] & 0x0f;
+                        if (m_num_parts > Params::MaxParts) {
+                            m_num_parts = GCODE_ERROR_TOO_MANY_PARTS;
+                            goto finish;
+                        }
                     }
                     m_state = STATE_INDEX;
-                    switch (m_buffer[0] >> 4) {
+                    switch (cmd_type) {
                         case CMD_TYPE_G0: {
                             m_cmd_code = 'G';
                             m_cmd_num = 0;
@@ -145,6 +188,28 @@ public:
                             m_cmd_code = 'G';
                             m_cmd_num = 92;
                         } break;
+                        case CMD_TYPE_DELTA_SETUP: {
+                            m_state = STATE_DELTA_SETUP;
+                        } break;
+                        case CMD_TYPE_G0_PACKED:
+                        case CMD_TYPE_G1_PACKED: {
+                            m_cmd_code = 'G';
+                            m_cmd_num = (cmd_type == CMD_TYPE_G0_PACKED) ? 0 : 1;
+                            for (auto slot : LoopRange<uint8_t>(PackedSlots)) {
+                                if ((m_buffer[0] & (1 << slot))) {
+                                    if (slot >= m_num_slots) {
+                                        m_num_parts = GCODE_ERROR_INVALID_PART;
+                                        goto finish;
+                                    }
+                                    if (m_num_parts == Params::MaxParts) {
+                                        m_num_parts = GCODE_ERROR_TOO_MANY_PARTS;
+                                        goto finish;
+                                    }
+                                    init_delta_part(&m_parts[m_num_parts++], slot);
+                                }
+                            }
+                            m_state = STATE_PAYLOAD;
+                        } break;
                         case CMD_TYPE_EOF: {
                             m_num_parts = GCODE_ERROR_EOF;
                             goto finish;
@@ -155,6 +220,32 @@ public:
                     }
                 } break;
                 
+                case STATE_DELTA_SETUP: {
+                    AMBRO_ASSERT(m_length == 1)
+                    uint8_t num_slots = m_buffer[0] & 0x0f;
+                    if (num_slots > MaxDeltaSlots) {
+                        m_num_parts = GCODE_ERROR_INVALID_PART;
+                        goto finish;
+                    }
+                    if (avail - m_length < 5 * num_slots) {
+                        return false;
+                    }
+                    for (auto slot : LoopRange<uint8_t>(num_slots)) {
+                        uint8_t const *slot_data = m_buffer + (m_length + 5 * slot);
+                        if (slot_data[0] >= 26) {
+                            m_num_parts = GCODE_ERROR_INVALID_PART;
+                            goto finish;
+                        }
+                        m_slots[slot].code = 'A' + slot_data[0];
+                        memcpy(&m_slots[slot].scale, slot_data + 1, sizeof(float));
+                        m_slots[slot].value = 0;
+                    }
+                    m_num_slots = num_slots;
+                    m_length += 5 * num_slots;
+                    m_num_parts = GCODE_ERROR_NO_PARTS;
+                    goto finish;
+                } break;
+                
                 case STATE_HEADER_LONG: {
                     AMBRO_ASSERT(m_length == 1)
                     if (avail < 3) {
@@ -173,9 +264,9 @@ public:
                     }
                     BufferSizeType index_offset = m_length;
                     m_length += m_num_parts;
-                    m_total_size = m_length;
                     for (auto i : LoopRange<PartsSizeType>(m_num_parts)) {
                         uint8_t index_byte = m_buffer[index_offset + i];
+                        char code = 'A' + (index_byte & 0x1f);
                         BufferSizeType data_size;
                         switch (index_byte >> 5) {
                             case DATA_TYPE_FLOAT:
@@ -185,28 +276,62 @@ public:
                             case DATA_TYPE_VOID:
                                 data_size = 0;
                                 break;
+                            case DATA_TYPE_DELTA: {
+                                uint8_t slot = find_slot(code);
+                                if (slot == m_num_slots) {
+                                    m_num_parts = GCODE_ERROR_INVALID_PART;
+                                    goto finish;
+                                }
+                                init_delta_part(&m_parts[i], slot);
+                                continue;
+                            } break;
                             default:
                                 m_num_parts = GCODE_ERROR_INVALID_PART;
                                 goto finish;
                         }
                         m_parts[i].data_type = index_byte >> 5;
-                        m_parts[i].code = 'A' + (index_byte & 0x1f);
+                        m_parts[i].code = code;
                         m_parts[i].data_size = data_size;
-                        m_total_size += data_size;
                     }
                     m_state = STATE_PAYLOAD;
                 } break;
                 
                 case STATE_PAYLOAD: {
-                    if (avail < m_total_size) {
-                        return false;
-                    }
+                    // Find the payloads, determining the sizes of varints
+                    // on the way, which requires starting over whenever
+                    // the payload is not yet complete.
                     BufferSizeType offset = m_length;
                     for (auto i : LoopRange<PartsSizeType>(m_num_parts)) {
-                        m_parts[i].data = m_buffer + offset;
-                        offset += m_parts[i].data_size;
+                        Part *part = &m_parts[i];
+                        part->data = m_buffer + offset;
+                        if (part->data_type == DATA_TYPE_DELTA) {
+                            uint8_t size = 0;
+                            do {
+                                if (size == MaxVarintSize) {
+                                    m_num_parts = GCODE_ERROR_INVALID_PART;
+                                    goto finish;
+                                }
+                                if (avail - offset <= size) {
+                                    return false;
+                                }
+                            } while ((part->data[size++] & 0x80));
+                            part->data_size = size;
+                        }
+                        if (avail - offset < part->data_size) {
+                            return false;
+                        }
+                        offset += part->data_size;
+                    }
+                    // The command is complete, apply the deltas.
+                    for (auto i : LoopRange<PartsSizeType>(m_num_parts)) {
+                        Part *part = &m_parts[i];
+                        if (part->data_type == DATA_TYPE_DELTA) {
+                            DeltaSlot *slot = &m_slots[part->slot];
+                            slot->value += decode_delta(part->data, part->data_size);
+                            part->delta_value = (int32_t)slot->value * slot->scale;
+                        }
                     }
-                    m_length = m_total_size;
+                    m_length = offset;
                     goto finish;
                 } break;
             }
@@ -300,6 +425,10 @@ public:
                 return val;
             } break;
             
+            case DATA_TYPE_DELTA: {
+                return cast_part_ref(part)->delta_value;
+            } break;
+            
             default:
                 return 0.0f;
         }
@@ -334,26 +463,59 @@ public:
     }
     
 private:
-    enum {STATE_NOCMD, STATE_HEADER, STATE_HEADER_LONG, STATE_INDEX, STATE_PAYLOAD};
+    enum {STATE_NOCMD, STATE_HEADER, STATE_HEADER_LONG, STATE_DELTA_SETUP, STATE_INDEX, STATE_PAYLOAD};
     
     static Part * cast_part_ref (PartRef part_ref)
     {
         return (Part *)part_ref.ptr;
     }
     
+    static bool is_packed (uint8_t cmd_type)
+    {
+        return (cmd_type == CMD_TYPE_G0_PACKED || cmd_type == CMD_TYPE_G1_PACKED);
+    }
+    
+    uint8_t find_slot (char code)
+    {
+        uint8_t slot = 0;
+        while (slot < m_num_slots && m_slots[slot].code != code) {
+            slot++;
+        }
+        return slot;
+    }
+    
+    void init_delta_part (Part *part, uint8_t slot)
+    {
+        part->data_type = DATA_TYPE_DELTA;
+        part->code = m_slots[slot].code;
+        part->slot = slot;
+    }
+    
+    static uint32_t decode_delta (uint8_t const *data, uint8_t size)
+    {
+        uint32_t zigzag = 0;
+        for (auto i : LoopRange<uint8_t>(size)) {
+            zigzag |= (uint32_t)(data[i] & 0x7f) << (7 * i);
+        }
+        return (zigzag >> 1) ^ -(zigzag & 1);
+    }
+    
     uint8_t m_state;
     uint8_t *m_buffer;
     BufferSizeType m_length;
     uint8_t m_cmd_code;
     uint16_t m_cmd_num;
     PartsSizeType m_num_parts;
-    BufferSizeType m_total_size;
+    uint8_t m_num_slots;
     Part m_parts[Params::MaxParts];
+    DeltaSlot m_slots[MaxDeltaSlots];
 };
 
 APRINTER_ALIAS_STRUCT_EXT(BinaryGcodeParserService, (
     APRINTER_AS_VALUE(int, MaxParts)
 ), (
+    static bool const TextFormat = false;
+    
     template <typename Context, typename TBufferSizeType, typename FpType>
     using Parser = BinaryGcodeParser<Context, TBufferSizeType, FpType, BinaryGcodeParserService>;
 ))
@@ -28,6 +28,16 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+
+// The SWAR fallback of the fast scanning path relies on little endian byte order.
+#if !defined(GCODEPARSER_NO_FAST_SCAN) && !defined(__SSE2__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#define GCODEPARSER_NO_FAST_SCAN
+#endif
+
+#if !defined(GCODEPARSER_NO_FAST_SCAN) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <aprinter/meta/ServiceUtils.h>
 #include <aprinter/math/FloatTools.h>
@@ -41,6 +51,135 @@ namespace APrinter {
 struct GcodeParserTypeSerial {};
 struct GcodeParserTypeFile {};
 
+#ifndef GCODEPARSER_NO_FAST_SCAN
+
+/*
+ * Primitives for the fast path of GcodeParser::extendCommand, which
+ * checks a whole block of characters at once. With SSE2 a block is
+ * 16 characters, otherwise it is a machine word handled with SWAR
+ * (SIMD within a register). The match functions return a mask from
+ * which it can be determined whether any character matched and the
+ * position of the first match. With SWAR, the mask may mark characters
+ * after the first match incorrectly, which is why only these two
+ * queries are offered.
+ */
+struct GcodeParserScan {
+#ifdef __SSE2__
+    using Block = __m128i;
+    static size_t const BlockSize = 16;
+    
+    static Block load (char const *data)
+    {
+        return _mm_loadu_si128((__m128i const *)data);
+    }
+    
+    static Block matchEqual (Block block, char ch)
+    {
+        return _mm_cmpeq_epi8(block, _mm_set1_epi8(ch));
+    }
+    
+    static Block matchAtMost (Block block, uint8_t limit)
+    {
+        return _mm_cmpeq_epi8(_mm_min_epu8(block, _mm_set1_epi8(limit)), block);
+    }
+    
+    static Block combine (Block mask1, Block mask2)
+    {
+        return _mm_or_si128(mask1, mask2);
+    }
+    
+    static bool any (Block mask)
+    {
+        return _mm_movemask_epi8(mask) != 0;
+    }
+    
+    static size_t firstMatch (Block mask)
+    {
+        return __builtin_ctz(_mm_movemask_epi8(mask));
+    }
+    
+    static Block keepPrefix (Block block, size_t count)
+    {
+        Block indices = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        return _mm_and_si128(block, _mm_cmpgt_epi8(_mm_set1_epi8(count), indices));
+    }
+    
+    static uint8_t xorBytes (Block block)
+    {
+        block = _mm_xor_si128(block, _mm_srli_si128(block, 8));
+        block = _mm_xor_si128(block, _mm_srli_si128(block, 4));
+        return xor_word_bytes((uint32_t)_mm_cvtsi128_si32(block));
+    }
+    
+#else
+#if UINTPTR_MAX > UINT32_MAX
+    using Block = uint64_t;
+#else
+    using Block = uint32_t;
+#endif
+    static size_t const BlockSize = sizeof(Block);
+    
+    static constexpr Block Ones = (Block)-1 / 255;
+    static constexpr Block Highs = Ones * 0x80;
+    
+    static Block load (char const *data)
+    {
+        Block block;
+        memcpy(&block, data, sizeof(block));
+        return block;
+    }
+    
+    static Block matchEqual (Block block, char ch)
+    {
+        Block x = block ^ (Ones * (uint8_t)ch);
+        return (x - Ones) & ~x & Highs;
+    }
+    
+    // This is exact only for limit < 128.
+    static Block matchAtMost (Block block, uint8_t limit)
+    {
+        return (block - Ones * (uint8_t)(limit + 1)) & ~block & Highs;
+    }
+    
+    static Block combine (Block mask1, Block mask2)
+    {
+        return mask1 | mask2;
+    }
+    
+    static bool any (Block mask)
+    {
+        return mask != 0;
+    }
+    
+    static size_t firstMatch (Block mask)
+    {
+        return __builtin_ctzll(mask) / 8;
+    }
+    
+    static Block keepPrefix (Block block, size_t count)
+    {
+        return (count == 0) ? 0 : (block & ((Block)-1 >> (8 * (BlockSize - count))));
+    }
+    
+    static uint8_t xorBytes (Block block)
+    {
+        return xor_word_bytes(block);
+    }
+    
+#endif
+private:
+    template <typename Word>
+    static uint8_t xor_word_bytes (Word word)
+    {
+        for (int shift = 4 * sizeof(Word); shift >= 8; shift /= 2) {
+            word ^= word >> shift;
+        }
+        return word;
+    }
+};
+
+#endif
+
 template <typename TheParserType>
 struct GcodeParserExtraMembers {
     bool m_continuing_comment_line;
@@ -128,6 +267,12 @@ public:
         AMBRO_ASSERT(avail >= m_command.length)
         
         for (; m_command.length < avail; m_command.length++) {
+#ifndef GCODEPARSER_NO_FAST_SCAN
+            m_command.length = fast_scan(c, avail);
+            if (AMBRO_UNLIKELY(m_command.length == avail)) {
+                break;
+            }
+#endif
             char ch = m_buffer[m_command.length];
             
             if (AMBRO_UNLIKELY(ch == '\n')) {
@@ -355,6 +500,13 @@ private:
             o->m_checksum ^= (unsigned char)ch;
         }
         
+#ifndef GCODEPARSER_NO_FAST_SCAN
+        static void checksum_add_block_hook (Context c, GcodeParser *o, GcodeParserScan::Block block)
+        {
+            o->m_checksum ^= GcodeParserScan::xorBytes(block);
+        }
+#endif
+        
         static void checksum_check_hook (Context c, GcodeParser *o)
         {
             AMBRO_ASSERT(o->m_command.num_parts >= 0)
@@ -405,6 +557,12 @@ private:
         {
         }
         
+#ifndef GCODEPARSER_NO_FAST_SCAN
+        static void checksum_add_block_hook (Context c, GcodeParser *o, GcodeParserScan::Block block)
+        {
+        }
+#endif
+        
         static void checksum_check_hook (Context c, GcodeParser *o)
         {
         }
@@ -461,6 +619,60 @@ private:
         return (received_len == 0);
     }
     
+#ifndef GCODEPARSER_NO_FAST_SCAN
+    // Skips over characters which need no processing other than the
+    // checksum, returning the position of the next character which needs
+    // to be processed individually by extendCommand.
+    BufferSizeType fast_scan (Context c, BufferSizeType avail)
+    {
+        using Scan = GcodeParserScan;
+        
+        BufferSizeType pos = m_command.length;
+        
+        if (m_command.num_parts < 0 ||
+            (TheTypeHelper::ChecksumEnabled && m_state == STATE_CHECKSUM) ||
+            (TheTypeHelper::CommentsEnabled && m_state == STATE_COMMENT))
+        {
+            // Only the newline matters here.
+            while (avail - pos >= Scan::BlockSize) {
+                Scan::Block mask = Scan::matchEqual(Scan::load(m_buffer + pos), '\n');
+                if (Scan::any(mask)) {
+                    pos += Scan::firstMatch(mask);
+                    break;
+                }
+                pos += Scan::BlockSize;
+            }
+        }
+        else if (m_state == STATE_INSIDE) {
+            while (avail - pos >= Scan::BlockSize) {
+                Scan::Block block = Scan::load(m_buffer + pos);
+                
+                // A part ends at whitespace or a newline (here any control
+                // character, which is only conservative), or at the start
+                // of the checksum or a comment.
+                Scan::Block mask = Scan::matchAtMost(block, ' ');
+                if (TheTypeHelper::ChecksumEnabled) {
+                    mask = Scan::combine(mask, Scan::matchEqual(block, '*'));
+                }
+                if (TheTypeHelper::CommentsEnabled) {
+                    mask = Scan::combine(mask, Scan::matchEqual(block, ';'));
+                }
+                if (Scan::any(mask)) {
+                    size_t count = Scan::firstMatch(mask);
+                    TheTypeHelper::checksum_add_block_hook(c, this, Scan::keepPrefix(block, count));
+                    pos += count;
+                    break;
+                }
+                
+                TheTypeHelper::checksum_add_block_hook(c, this, block);
+                pos += Scan::BlockSize;
+            }
+        }
+        
+        return pos;
+    }
+#endif
+    
     void finish_part (Context c)
     {
         AMBRO_ASSERT(m_command.num_parts >= 0)
@@ -474,7 +686,15 @@ private:
         
         char code = m_buffer[m_temp];
         
-        BufferSizeType in_pos = m_temp + 1;
+        // Unescaping leaves the part unchanged up to the first escape,
+        // and escapes are not recognized in the first part.
+        BufferSizeType in_pos = m_command.length;
+        if (m_command.num_parts > 0) {
+            in_pos = m_temp + 1;
+            while (in_pos < m_command.length && m_buffer[in_pos] != '\\') {
+                in_pos++;
+            }
+        }
         BufferSizeType out_pos = in_pos;
         
         while (in_pos < m_command.length) {
@@ -527,6 +747,8 @@ private:
 APRINTER_ALIAS_STRUCT_EXT(SerialGcodeParserService, (
     APRINTER_AS_VALUE(int, MaxParts)
 ), (
+    static bool const TextFormat = true;
+    
     template <typename Context, typename TBufferSizeType, typename FpType>
     using Parser = GcodeParser<Context, TBufferSizeType, FpType, GcodeParserTypeSerial, SerialGcodeParserService>;
 ))
@@ -534,6 +756,8 @@ APRINTER_ALIAS_STRUCT_EXT(SerialGcodeParserService, (
 APRINTER_ALIAS_STRUCT_EXT(FileGcodeParserService, (
     APRINTER_AS_VALUE(int, MaxParts)
 ), (
+    static bool const TextFormat = true;
+    
     template <typename Context, typename TBufferSizeType, typename FpType>
     using Parser = GcodeParser<Context, TBufferSizeType, FpType, GcodeParserTypeFile, FileGcodeParserService>;
 ))
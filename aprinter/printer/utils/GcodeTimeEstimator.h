@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef APRINTER_GCODE_TIME_ESTIMATOR_H
+#define APRINTER_GCODE_TIME_ESTIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <aprinter/math/FloatTools.h>
+
+namespace APrinter {
+
+/*
+ * Streaming estimator of the duration and layer count of G-code. It is fed
+ * either with arbitrary pieces of G-code text, or with already parsed
+ * commands part by part (addPart for the command code and each parameter,
+ * followed by endCommand).
+ * 
+ * Moves (G0/G1 and arcs G2/G3) are timed at their nominal feed rate without
+ * acceleration and dwells (G4) are added, so the result is only useful in relation to
+ * another estimate done the same way (e.g. of the already executed part of
+ * a file). A layer is counted at an extruding move above the height of the
+ * previous layer, so that Z-hops on travel moves are not counted.
+ * 
+ * When fed with text, the state at the start of the line on which each layer
+ * started can be obtained (see LayerStart), and the estimation can later be
+ * continued from there using restore.
+ */
+template <typename FpType>
+class GcodeTimeEstimator {
+    enum {STATE_NORMAL, STATE_NUMBER, STATE_COMMENT, STATE_PAREN};
+    enum {AXIS_X, AXIS_Y, AXIS_Z, AXIS_E, PARAM_F, PARAM_P, PARAM_S, PARAM_I, PARAM_J, PARAM_R, NumParams};
+    static int const NumAxes = PARAM_F;
+    
+    static uint32_t const MantissaLimit = UINT32_C(100000000);
+    
+public:
+    struct LayerStart {
+        // The layer started, counting from 1.
+        uint32_t layer;
+        // Byte offset and number (from 0) of the line in the fed text.
+        uint32_t offset;
+        uint32_t line;
+        // The state before the line was processed, pos being X, Y, Z, E
+        // and speed being in units per second.
+        FpType time;
+        FpType prev_layer_z;
+        FpType pos[NumAxes];
+        FpType speed;
+        bool relative;
+        bool relative_e;
+    };
+    
+    void init ()
+    {
+        m_time = 0.0f;
+        m_layer = 0;
+        m_layer_z = 0.0f;
+        for (int i = 0; i < NumAxes; i++) {
+            m_pos[i] = 0.0f;
+        }
+        m_speed = 0.0f;
+        m_relative = false;
+        m_relative_e = false;
+        m_offset = 0;
+        m_line_offset = 0;
+        m_line = 0;
+        m_layer_started = false;
+        m_state = STATE_NORMAL;
+        reset_line();
+    }
+    
+    void restore (LayerStart const &layer_start)
+    {
+        m_time = layer_start.time;
+        m_layer = layer_start.layer - 1;
+        m_layer_z = layer_start.prev_layer_z;
+        for (int i = 0; i < NumAxes; i++) {
+            m_pos[i] = layer_start.pos[i];
+        }
+        m_speed = layer_start.speed;
+        m_relative = layer_start.relative;
+        m_relative_e = layer_start.relative_e;
+        m_offset = layer_start.offset;
+        m_line_offset = layer_start.offset;
+        m_line = layer_start.line;
+        m_layer_started = false;
+        m_state = STATE_NORMAL;
+        reset_line();
+    }
+    
+    void feed (char const *data, size_t length)
+    {
+        for (size_t i = 0; i < length; i++) {
+            feed_char(data[i]);
+        }
+    }
+    
+    // Like feed, additionally calling layer_handler(LayerStart const &)
+    // for each layer started.
+    template <typename LayerHandler>
+    void feed (char const *data, size_t length, LayerHandler layer_handler)
+    {
+        for (size_t i = 0; i < length; i++) {
+            feed_char(data[i]);
+            if (m_layer_started) {
+                m_layer_started = false;
+                layer_handler(m_layer_start);
+            }
+        }
+    }
+    
+    void addPart (char code, FpType value)
+    {
+        if (code >= 'a' && code <= 'z') {
+            code -= 'a' - 'A';
+        }
+        
+        switch (code) {
+            case 'G':
+            case 'M': {
+                if (m_code_letter == 0 && value >= 0.0f) {
+                    m_code_letter = code;
+                    m_code = value;
+                }
+            } break;
+            case 'X': set_param(AXIS_X, value); break;
+            case 'Y': set_param(AXIS_Y, value); break;
+            case 'Z': set_param(AXIS_Z, value); break;
+            case 'E': set_param(AXIS_E, value); break;
+            case 'F': set_param(PARAM_F, value); break;
+            case 'P': set_param(PARAM_P, value); break;
+            case 'S': set_param(PARAM_S, value); break;
+            case 'I': set_param(PARAM_I, value); break;
+            case 'J': set_param(PARAM_J, value); break;
+            case 'R': set_param(PARAM_R, value); break;
+        }
+    }
+    
+    void endCommand ()
+    {
+        if (m_code_letter == 'G') {
+            switch (m_code) {
+                case 0:
+                case 1: {
+                    do_move(false, false);
+                } break;
+                
+                case 2:
+                case 3: {
+                    do_move(true, (m_code == 2));
+                } break;
+                
+                case 4: {
+                    if (have_param(PARAM_P)) {
+                        m_time += m_params[PARAM_P] / 1000.0f;
+                    } else if (have_param(PARAM_S)) {
+                        m_time += m_params[PARAM_S];
+                    }
+                } break;
+                
+                case 28: {
+                    bool all = !(m_have & ((1 << AXIS_X) | (1 << AXIS_Y) | (1 << AXIS_Z)));
+                    for (int i = AXIS_X; i <= AXIS_Z; i++) {
+                        if (all || have_param(i)) {
+                            m_pos[i] = 0.0f;
+                        }
+                    }
+                } break;
+                
+                case 90:
+                case 91: {
+                    m_relative = (m_code == 91);
+                    m_relative_e = m_relative;
+                } break;
+                
+                case 92: {
+                    for (int i = 0; i < NumAxes; i++) {
+                        if (have_param(i)) {
+                            m_pos[i] = m_params[i];
+                        }
+                    }
+                } break;
+            }
+        }
+        else if (m_code_letter == 'M') {
+            if (m_code == 82 || m_code == 83) {
+                m_relative_e = (m_code == 83);
+            }
+        }
+        
+        reset_line();
+    }
+    
+    // Estimated duration in seconds.
+    FpType getTime ()
+    {
+        return m_time;
+    }
+    
+    // Number of layers started.
+    uint32_t getLayer ()
+    {
+        return m_layer;
+    }
+    
+private:
+    void reset_line ()
+    {
+        m_code_letter = 0;
+        m_have = 0;
+    }
+    
+    void feed_char (char ch)
+    {
+        m_offset++;
+        
+        if (ch == '\n' || ch == '\r') {
+            finish_word();
+            endCommand();
+            m_state = STATE_NORMAL;
+            if (ch == '\n') {
+                m_line++;
+            }
+            m_line_offset = m_offset;
+            return;
+        }
+        
+        if (m_state == STATE_COMMENT) {
+            return;
+        }
+        if (m_state == STATE_PAREN) {
+            if (ch == ')') {
+                m_state = STATE_NORMAL;
+            }
+            return;
+        }
+        
+        if (m_state == STATE_NUMBER) {
+            if (ch >= '0' && ch <= '9') {
+                if (m_mantissa < MantissaLimit) {
+                    m_mantissa = 10 * m_mantissa + (ch - '0');
+                    if (m_fraction) {
+                        m_scale *= 0.1f;
+                    }
+                }
+                return;
+            }
+            if (ch == '.' && !m_fraction) {
+                m_fraction = true;
+                return;
+            }
+            if ((ch == '-' || ch == '+') && m_mantissa == 0 && !m_fraction) {
+                m_negative = (ch == '-');
+                return;
+            }
+            finish_word();
+        }
+        
+        if (ch == ';' || ch == '*') {
+            m_state = STATE_COMMENT;
+        }
+        else if (ch == '(') {
+            m_state = STATE_PAREN;
+        }
+        else if ((ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z')) {
+            m_letter = ch;
+            m_mantissa = 0;
+            m_scale = 1.0f;
+            m_fraction = false;
+            m_negative = false;
+            m_state = STATE_NUMBER;
+        }
+    }
+    
+    void finish_word ()
+    {
+        if (m_state != STATE_NUMBER) {
+            return;
+        }
+        m_state = STATE_NORMAL;
+        
+        FpType value = (FpType)m_mantissa * m_scale;
+        if (m_negative) {
+            value = -value;
+        }
+        addPart(m_letter, value);
+    }
+    
+    // Length in the XY plane of an arc from the current position to the
+    // position offset by (dx, dy), with the center given by I/J or R like
+    // for the arc moves of the firmware. Zero if the arc is invalid.
+    FpType arc_xy_length (FpType dx, FpType dy, bool clockwise)
+    {
+        FpType offset_i = have_param(PARAM_I) ? m_params[PARAM_I] : 0.0f;
+        FpType offset_j = have_param(PARAM_J) ? m_params[PARAM_J] : 0.0f;
+        
+        if (!have_param(PARAM_I) && !have_param(PARAM_J)) {
+            FpType chord_squared = dx * dx + dy * dy;
+            if (!have_param(PARAM_R) || chord_squared == 0.0f) {
+                return 0.0f;
+            }
+            FpType radius = m_params[PARAM_R];
+            FpType h = FloatSqrt(FloatMakePosOrPosZero((4.0f * radius * radius) / chord_squared - 1.0f));
+            if (clockwise != (radius < 0.0f)) {
+                h = -h;
+            }
+            offset_i = 0.5f * (dx - dy * h);
+            offset_j = 0.5f * (dy + dx * h);
+        }
+        
+        FpType radius = FloatSqrt(offset_i * offset_i + offset_j * offset_j);
+        FpType sweep = FloatAtan2(dy - offset_j, dx - offset_i) - FloatAtan2(-offset_j, -offset_i);
+        if (clockwise) {
+            if (sweep >= 0.0f) {
+                sweep -= (FpType)(2.0 * M_PI);
+            }
+        } else {
+            if (sweep <= 0.0f) {
+                sweep += (FpType)(2.0 * M_PI);
+            }
+        }
+        return radius * FloatAbs(sweep);
+    }
+    
+    void set_param (int index, FpType value)
+    {
+        m_have |= 1 << index;
+        m_params[index] = value;
+    }
+    
+    bool have_param (int index)
+    {
+        return (m_have & (1 << index));
+    }
+    
+    void do_move (bool arc, bool clockwise)
+    {
+        FpType prev_time = m_time;
+        FpType prev_speed = m_speed;
+        
+        if (have_param(PARAM_F) && m_params[PARAM_F] > 0.0f) {
+            m_speed = m_params[PARAM_F] / 60.0f;
+        }
+        
+        FpType delta[NumAxes];
+        for (int i = 0; i < NumAxes; i++) {
+            delta[i] = 0.0f;
+            if (have_param(i)) {
+                bool relative = (i == AXIS_E) ? m_relative_e : m_relative;
+                delta[i] = relative ? m_params[i] : (m_params[i] - m_pos[i]);
+                m_pos[i] += delta[i];
+            }
+        }
+        
+        FpType distance = FloatSqrt(delta[AXIS_X] * delta[AXIS_X] + delta[AXIS_Y] * delta[AXIS_Y] + delta[AXIS_Z] * delta[AXIS_Z]);
+        if (arc) {
+            FpType arc_length = arc_xy_length(delta[AXIS_X], delta[AXIS_Y], clockwise);
+            if (arc_length > 0.0f) {
+                distance = FloatSqrt(arc_length * arc_length + delta[AXIS_Z] * delta[AXIS_Z]);
+            }
+        }
+        if (distance == 0.0f) {
+            distance = FloatAbs(delta[AXIS_E]);
+        }
+        if (m_speed > 0.0f) {
+            m_time += distance / m_speed;
+        }
+        
+        if (delta[AXIS_E] > 0.0f && (m_layer == 0 || m_pos[AXIS_Z] > m_layer_z + 0.001f)) {
+            m_layer_started = true;
+            m_layer_start.layer = m_layer + 1;
+            m_layer_start.offset = m_line_offset;
+            m_layer_start.line = m_line;
+            m_layer_start.time = prev_time;
+            m_layer_start.prev_layer_z = m_layer_z;
+            for (int i = 0; i < NumAxes; i++) {
+                m_layer_start.pos[i] = m_pos[i] - delta[i];
+            }
+            m_layer_start.speed = prev_speed;
+            m_layer_start.relative = m_relative;
+            m_layer_start.relative_e = m_relative_e;
+            
+            m_layer++;
+            m_layer_z = m_pos[AXIS_Z];
+        }
+    }
+    
+private:
+    FpType m_time;
+    uint32_t m_layer;
+    FpType m_layer_z;
+    FpType m_pos[NumAxes];
+    FpType m_speed;
+    uint32_t m_offset;
+    uint32_t m_line_offset;
+    uint32_t m_line;
+    LayerStart m_layer_start;
+    FpType m_params[NumParams];
+    FpType m_scale;
+    uint32_t m_mantissa;
+    uint32_t m_code;
+    uint16_t m_have;
+    char m_code_letter;
+    char m_letter;
+    uint8_t m_state : 2;
+    uint8_t m_fraction : 1;
+    uint8_t m_negative : 1;
+    uint8_t m_relative : 1;
+    uint8_t m_relative_e : 1;
+    uint8_t m_layer_started : 1;
+};
+
+}
+
+#endif
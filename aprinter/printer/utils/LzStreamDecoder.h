@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef APRINTER_LZ_STREAM_DECODER_H
+#define APRINTER_LZ_STREAM_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace APrinter {
+
+/*
+ * Streaming decoder of the LZ format produced by aprinter_compress.py.
+ * 
+ * The data starts with a header of HeaderSize bytes: the magic "APLZ", the
+ * number of bits of the window size and the size of the decompressed data
+ * (little endian, 32 bits). Then come sequences like in LZ4: a token byte
+ * with the literal count in the high nibble and the match length minus 4
+ * in the low nibble, where 15 in either is continued by additional bytes
+ * added to it until one is not 255; the literals; and, unless the end of the
+ * data has been reached, the match offset (little endian, 16 bits), followed
+ * by the additional match length bytes. The offset is at most the window
+ * size, so only that much history needs to be kept.
+ * 
+ * The decoder can be suspended at any byte of the input or output.
+ */
+template <int WindowBits>
+class LzStreamDecoder {
+    static_assert(WindowBits >= 8 && WindowBits <= 16, "");
+    
+    enum {STATE_TOKEN, STATE_LITERAL_EXT, STATE_LITERALS, STATE_OFFSET_LOW, STATE_OFFSET_HIGH, STATE_MATCH_EXT, STATE_MATCH, STATE_DONE, STATE_ERROR};
+    
+    static uint32_t const WindowSize = (uint32_t)1 << WindowBits;
+    static uint32_t const WindowMask = WindowSize - 1;
+    static uint8_t const MinMatch = 4;
+    
+public:
+    static size_t const HeaderSize = 9;
+    
+    // Checks the header, returning the window bits and decompressed size.
+    static bool parseHeader (uint8_t const *data, size_t length, uint8_t *out_window_bits, uint32_t *out_size)
+    {
+        if (length < HeaderSize || data[0] != 'A' || data[1] != 'P' || data[2] != 'L' || data[3] != 'Z') {
+            return false;
+        }
+        *out_window_bits = data[4];
+        *out_size = (uint32_t)data[5] | ((uint32_t)data[6] << 8) | ((uint32_t)data[7] << 16) | ((uint32_t)data[8] << 24);
+        return true;
+    }
+    
+    // Whether the header parameters can be handled by this decoder.
+    static bool headerSupported (uint8_t window_bits)
+    {
+        return (window_bits <= WindowBits);
+    }
+    
+    void init (uint32_t size)
+    {
+        m_state = (size == 0) ? STATE_DONE : STATE_TOKEN;
+        m_remaining = size;
+        m_pos = 0;
+        m_history = 0;
+    }
+    
+    bool isDone ()
+    {
+        return (m_state == STATE_DONE);
+    }
+    
+    // Decodes until the input is used up, the output is full or the data
+    // is complete. Returns false if the data is found to be corrupt.
+    bool decode (uint8_t const *in, size_t in_len, size_t *in_used, uint8_t *out, size_t out_len, size_t *out_used)
+    {
+        uint8_t const *in_start = in;
+        uint8_t const *in_end = in + in_len;
+        uint8_t *out_start = out;
+        uint8_t *out_end = out + out_len;
+        
+        while (m_state != STATE_DONE && m_state != STATE_ERROR) {
+            if (m_state == STATE_LITERALS) {
+                // Literals need both input and output.
+                if (in == in_end || out == out_end) {
+                    break;
+                }
+                size_t count = m_count;
+                if (count > (size_t)(in_end - in)) {
+                    count = in_end - in;
+                }
+                if (count > (size_t)(out_end - out)) {
+                    count = out_end - out;
+                }
+                m_count -= count;
+                m_remaining -= count;
+                add_history(count);
+                while (count-- > 0) {
+                    uint8_t byte = *in++;
+                    m_window[m_pos++ & WindowMask] = byte;
+                    *out++ = byte;
+                }
+                if (m_count == 0) {
+                    m_state = (m_remaining == 0) ? STATE_DONE : STATE_OFFSET_LOW;
+                }
+                continue;
+            }
+            
+            if (m_state == STATE_MATCH) {
+                if (out == out_end) {
+                    break;
+                }
+                size_t count = m_count;
+                if (count > (size_t)(out_end - out)) {
+                    count = out_end - out;
+                }
+                m_count -= count;
+                m_remaining -= count;
+                add_history(count);
+                while (count-- > 0) {
+                    uint8_t byte = m_window[(m_pos - m_offset) & WindowMask];
+                    m_window[m_pos++ & WindowMask] = byte;
+                    *out++ = byte;
+                }
+                if (m_count == 0) {
+                    m_state = (m_remaining == 0) ? STATE_DONE : STATE_TOKEN;
+                }
+                continue;
+            }
+            
+            // The remaining states consume one byte of input.
+            if (in == in_end) {
+                break;
+            }
+            uint8_t byte = *in++;
+            
+            switch (m_state) {
+                case STATE_TOKEN: {
+                    m_count = byte >> 4;
+                    m_match_nibble = byte & 0xF;
+                    m_state = (m_count == 15) ? STATE_LITERAL_EXT : STATE_LITERALS;
+                    check_count();
+                } break;
+                
+                case STATE_LITERAL_EXT: {
+                    m_count += byte;
+                    if (byte != 255) {
+                        m_state = STATE_LITERALS;
+                    }
+                    check_count();
+                } break;
+                
+                case STATE_OFFSET_LOW: {
+                    m_offset = byte;
+                    m_state = STATE_OFFSET_HIGH;
+                } break;
+                
+                case STATE_OFFSET_HIGH: {
+                    m_offset |= (uint32_t)byte << 8;
+                    m_count = MinMatch + m_match_nibble;
+                    m_state = (m_match_nibble == 15) ? STATE_MATCH_EXT : STATE_MATCH;
+                    if (m_offset == 0 || m_offset > m_history) {
+                        m_state = STATE_ERROR;
+                    }
+                    check_count();
+                } break;
+                
+                case STATE_MATCH_EXT: {
+                    m_count += byte;
+                    if (byte != 255) {
+                        m_state = STATE_MATCH;
+                    }
+                    check_count();
+                } break;
+            }
+            
+            // A sequence without literals goes straight to the match.
+            if (m_state == STATE_LITERALS && m_count == 0) {
+                m_state = STATE_OFFSET_LOW;
+            }
+        }
+        
+        *in_used = in - in_start;
+        *out_used = out - out_start;
+        return (m_state != STATE_ERROR);
+    }
+    
+private:
+    // The count may not go beyond the end of the data, which also
+    // prevents it from overflowing with additional length bytes.
+    void check_count ()
+    {
+        if (m_count > m_remaining) {
+            m_state = STATE_ERROR;
+        }
+    }
+    
+    void add_history (size_t count)
+    {
+        m_history = (count >= WindowSize - m_history) ? WindowSize : (m_history + count);
+    }
+    
+    uint8_t m_state;
+    uint8_t m_match_nibble;
+    uint32_t m_remaining;
+    uint32_t m_count;
+    uint32_t m_offset;
+    uint32_t m_pos;
+    uint32_t m_history;
+    uint8_t m_window[WindowSize];
+};
+
+}
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef APRINTER_INTERRUPT_TIMER_MUX_H
+#define APRINTER_INTERRUPT_TIMER_MUX_H
+
+#include <stdint.h>
+
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/WrapFunction.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/base/Accessor.h>
+#include <aprinter/base/LoopUtils.h>
+#include <aprinter/structure/LinkModel.h>
+#include <aprinter/structure/TreeCompare.h>
+#include <aprinter/structure/LinkedHeap.h>
+#include <aprinter/system/InterruptLock.h>
+#include <aprinter/misc/ClockUtils.h>
+
+namespace APrinter {
+
+/*
+ * Multiplexes a number of virtual interrupt timers onto a single hardware
+ * interrupt timer, for boards which have fewer compare channels than there
+ * are steppers and lasers.
+ * 
+ * The pending virtual timers are kept in a heap ordered by their set time,
+ * and the hardware timer is always programmed for the earliest one. When it
+ * fires, the handler of the earliest timer is called, the heap is fixed up
+ * according to the time it has set using setNext(), and any further timers
+ * which are already due are dispatched from the same interrupt (at most
+ * MaxTimers handler calls, so that a late timer cannot starve the others).
+ * 
+ * The virtual timers implement the usual interrupt timer interface
+ * (see InterruptTimerMuxTimerService). ExtraClearance is not supported
+ * per virtual timer; the clearance of the hardware timer applies.
+ */
+
+template <typename>
+class InterruptTimerMuxTimer;
+
+template <typename Arg>
+class InterruptTimerMux {
+    APRINTER_USE_TYPE1(Arg, Context)
+    APRINTER_USE_TYPE1(Arg, ParentObject)
+    APRINTER_USE_TYPE1(Arg, Params)
+    
+    APRINTER_USE_TYPE1(Params, HwTimerService)
+    APRINTER_USE_VAL(Params, MaxTimers)
+    
+    static_assert(MaxTimers > 0 && MaxTimers <= 64, "");
+    
+    template <typename> friend class InterruptTimerMuxTimer;
+    
+    struct HwTimerHandler;
+    
+public:
+    struct Object;
+    APRINTER_USE_TYPE1(Context, Clock)
+    APRINTER_USE_TYPE1(Clock, TimeType)
+    APRINTER_MAKE_INSTANCE(HwTimer, (HwTimerService::template InterruptTimer<Context, Object, HwTimerHandler>))
+    using HandlerContext = typename HwTimer::HandlerContext;
+    
+private:
+    using TheDebugObject = DebugObject<Context, Object>;
+    using TheClockUtils = ClockUtils<Context>;
+    using HandlerFunc = bool (*) (HandlerContext);
+    
+    struct Entry;
+    using LinkModel = PointerLinkModel<Entry>;
+    
+    struct Entry {
+        LinkedHeapNode<LinkModel> heap_node;
+        TimeType time;
+        HandlerFunc handler;
+        bool active;
+    };
+    
+    // Times compare relative to each other, which is correct as long as all
+    // pending times are within the working time span of the clock.
+    struct KeyFuncs {
+        static TimeType GetKeyOfEntry (Entry const &e)
+        {
+            return e.time;
+        }
+        
+        static int CompareKeys (TimeType t1, TimeType t2)
+        {
+            TimeType diff = TheClockUtils::timeDifference(t1, t2);
+            return (diff == 0) ? 0 : TheClockUtils::differenceIsNegative(diff) ? -1 : 1;
+        }
+    };
+    
+    using Heap = LinkedHeap<APRINTER_MEMBER_ACCESSOR_TN(&Entry::heap_node), TreeCompare<LinkModel, KeyFuncs>, LinkModel, uint8_t>;
+    
+public:
+    static void init (Context c)
+    {
+        auto *o = Object::self(c);
+        
+        o->heap.init();
+        o->dispatching = false;
+        for (auto i : LoopRangeAuto(MaxTimers)) {
+            o->entries[i].handler = nullptr;
+            o->entries[i].active = false;
+        }
+        
+        HwTimer::init(c);
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+        
+        HwTimer::deinit(c);
+    }
+    
+private:
+    static void timer_init (Context c, int index, HandlerFunc handler)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        Entry *e = &o->entries[index];
+        AMBRO_ASSERT(!e->handler)
+        
+        e->handler = handler;
+    }
+    
+    static void timer_deinit (Context c, int index)
+    {
+        auto *o = Object::self(c);
+        
+        timer_unset(c, index);
+        o->entries[index].handler = nullptr;
+    }
+    
+    template <typename ThisContext>
+    static void timer_set_first (ThisContext c, int index, TimeType time)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        Entry *e = &o->entries[index];
+        AMBRO_ASSERT(e->handler)
+        AMBRO_ASSERT(!e->active)
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            bool was_empty = o->heap.isEmpty();
+            e->time = time;
+            e->active = true;
+            o->heap.insert(*e);
+            
+            // While dispatching, the hardware timer is set when the handler returns.
+            if (!o->dispatching && &*o->heap.first() == e) {
+                if (!was_empty) {
+                    HwTimer::unset(lock_c);
+                }
+                HwTimer::setFirst(lock_c, time);
+            }
+        }
+    }
+    
+    static void timer_set_next (HandlerContext c, int index, TimeType time)
+    {
+        auto *o = Object::self(c);
+        Entry *e = &o->entries[index];
+        AMBRO_ASSERT(o->dispatching)
+        AMBRO_ASSERT(e->active)
+        
+        // The heap is fixed up by the dispatcher after the handler returns.
+        e->time = time;
+    }
+    
+    template <typename ThisContext>
+    static void timer_unset (ThisContext c, int index)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        Entry *e = &o->entries[index];
+        
+        AMBRO_LOCK_T(InterruptTempLock(), c, lock_c) {
+            if (e->active) {
+                bool was_first = (&*o->heap.first() == e);
+                o->heap.remove(*e);
+                e->active = false;
+                
+                if (!o->dispatching && was_first) {
+                    HwTimer::unset(lock_c);
+                    if (!o->heap.isEmpty()) {
+                        HwTimer::setFirst(lock_c, (*o->heap.first()).time);
+                    }
+                }
+            }
+        }
+    }
+    
+    template <typename ThisContext>
+    static TimeType timer_get_last_set_time (ThisContext c, int index)
+    {
+        auto *o = Object::self(c);
+        
+        return o->entries[index].time;
+    }
+    
+    static bool hw_timer_handler (HandlerContext c)
+    {
+        auto *o = Object::self(c);
+        TheDebugObject::access(c);
+        AMBRO_ASSERT(!o->dispatching)
+        AMBRO_ASSERT(!o->heap.isEmpty())
+        
+        o->dispatching = true;
+        
+        Entry *e = &*o->heap.first();
+        uint8_t count = 0;
+        
+        while (true) {
+            bool keep = e->handler(c);
+            
+            // The handler may have unset its own timer, then it is already removed.
+            if (e->active) {
+                if (keep) {
+                    o->heap.fixup(*e);
+                } else {
+                    o->heap.remove(*e);
+                    e->active = false;
+                }
+            }
+            
+            if (o->heap.isEmpty()) {
+                o->dispatching = false;
+                return false;
+            }
+            
+            e = &*o->heap.first();
+            
+            if (++count == MaxTimers || !TheClockUtils::timeGreaterOrEqual(Clock::getTime(c), e->time)) {
+                break;
+            }
+        }
+        
+        o->dispatching = false;
+        
+        HwTimer::setNext(c, e->time);
+        return true;
+    }
+    
+    struct HwTimerHandler : public AMBRO_WFUNC_TD(&InterruptTimerMux::hw_timer_handler) {};
+    
+public:
+    struct Object : public ObjBase<InterruptTimerMux, ParentObject, MakeTypeList<
+        TheDebugObject,
+        HwTimer
+    >> {
+        Heap heap;
+        bool dispatching;
+        Entry entries[MaxTimers];
+    };
+};
+
+APRINTER_ALIAS_STRUCT_EXT(InterruptTimerMuxService, (
+    APRINTER_AS_TYPE(HwTimerService),
+    APRINTER_AS_VALUE(int, MaxTimers)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(Mux, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject)
+    ), (
+        using Params = InterruptTimerMuxService;
+        APRINTER_DEF_INSTANCE(Mux, InterruptTimerMux)
+    ))
+))
+
+template <typename Arg>
+class InterruptTimerMuxTimer {
+    APRINTER_USE_TYPE1(Arg, Context)
+    APRINTER_USE_TYPE1(Arg, ParentObject)
+    APRINTER_USE_TYPE1(Arg, Handler)
+    APRINTER_USE_TYPE1(Arg, Params)
+    
+    APRINTER_USE_TYPE1(Params, TheMux)
+    APRINTER_USE_VAL(Params, Index)
+    
+public:
+    struct Object;
+    APRINTER_USE_TYPE1(Context, Clock)
+    APRINTER_USE_TYPE1(Clock, TimeType)
+    using HandlerContext = typename TheMux::HandlerContext;
+    
+private:
+    static_assert(Index >= 0 && Index < TheMux::MaxTimers, "");
+    
+    using TheDebugObject = DebugObject<Context, Object>;
+    
+public:
+    static void init (Context c)
+    {
+        TheMux::timer_init(c, Index, InterruptTimerMuxTimer::timer_handler);
+        
+        TheDebugObject::init(c);
+    }
+    
+    static void deinit (Context c)
+    {
+        TheDebugObject::deinit(c);
+        
+        TheMux::timer_deinit(c, Index);
+    }
+    
+    template <typename ThisContext>
+    static void setFirst (ThisContext c, TimeType time)
+    {
+        TheDebugObject::access(c);
+        
+        TheMux::timer_set_first(c, Index, time);
+    }
+    
+    static void setNext (HandlerContext c, TimeType time)
+    {
+        TheMux::timer_set_next(c, Index, time);
+    }
+    
+    template <typename ThisContext>
+    static void unset (ThisContext c)
+    {
+        TheDebugObject::access(c);
+        
+        TheMux::timer_unset(c, Index);
+    }
+    
+    template <typename ThisContext>
+    static TimeType getLastSetTime (ThisContext c)
+    {
+        return TheMux::timer_get_last_set_time(c, Index);
+    }
+    
+private:
+    static bool timer_handler (HandlerContext c)
+    {
+        return Handler::call(c);
+    }
+    
+public:
+    struct Object : public ObjBase<InterruptTimerMuxTimer, ParentObject, MakeTypeList<TheDebugObject>> {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(InterruptTimerMuxTimerService, (
+    APRINTER_AS_TYPE(TheMux),
+    APRINTER_AS_VALUE(int, Index)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(InterruptTimer, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Handler)
+    ), (
+        using Params = InterruptTimerMuxTimerService;
+        APRINTER_DEF_INSTANCE(InterruptTimer, InterruptTimerMuxTimer)
+    ))
+))
+
+}
+
+#endif
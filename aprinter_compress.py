@@ -0,0 +1,142 @@
+#!/usr/bin/env python2.7
+# Copyright (c) 2016 Ambroz Bizjak
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Compresses a file (usually G-code) into the LZ format that the firmware
+# can decompress while printing from the SD card, see LzStreamDecoder.h.
+
+from __future__ import print_function
+from __future__ import with_statement
+import struct
+
+MinMatch = 4
+DefaultMaxSearches = 2
+HeaderMagic = b'APLZ'
+
+class CompressError(Exception):
+    pass
+
+# The candidate for a match is the last position with the same first
+# MinMatch bytes, which is looked up in a table only updated at the positions
+# where matching was attempted and near the ends of matches (like LZ4), so
+# that most of the input is skipped over by matches without work in Python.
+# A longer match is then searched for further back in the window using rfind,
+# at most max_searches times.
+def compress(data, window_bits, max_searches=DefaultMaxSearches):
+    if not (8 <= window_bits <= 16):
+        raise CompressError('window bits must be between 8 and 16')
+    data = bytes(data)
+    n = len(data)
+    if n >= 2**32:
+        raise CompressError('input too large')
+    max_offset = min(1 << window_bits, 0xFFFF)
+    
+    out = bytearray(HeaderMagic)
+    out += bytearray(struct.pack('<BI', window_bits, n))
+    
+    last_pos = {}
+    
+    def match_length(cand, pos):
+        length = 0
+        step = 64
+        while pos + length < n:
+            chunk = min(step, n - (pos + length))
+            if data[cand + length:cand + length + chunk] == data[pos + length:pos + length + chunk]:
+                length += chunk
+                continue
+            if chunk == 1:
+                break
+            step = chunk // 2
+        return length
+    
+    pos = 0
+    literal_start = 0
+    while pos + MinMatch <= n:
+        key = data[pos:pos + MinMatch]
+        cand = last_pos.get(key, -1)
+        last_pos[key] = pos
+        window_start = max(0, pos - max_offset)
+        if cand < window_start:
+            pos += 1
+            continue
+        
+        best_length = match_length(cand, pos)
+        best_offset = pos - cand
+        searches = max_searches
+        while searches > 0 and pos + best_length < n:
+            length = best_length + 1
+            cand = data.rfind(data[pos:pos + length], window_start, pos + length - 1)
+            if cand < 0:
+                break
+            best_length = match_length(cand, pos)
+            best_offset = pos - cand
+            searches -= 1
+        
+        _emit_sequence(out, data[literal_start:pos], best_offset, best_length)
+        pos += best_length
+        literal_start = pos
+        if pos - 2 + MinMatch <= n:
+            last_pos[data[pos - 2:pos - 2 + MinMatch]] = pos - 2
+    
+    if literal_start < n:
+        _emit_sequence(out, data[literal_start:n], 0, 0)
+    
+    return out
+
+def _emit_sequence(out, literals, offset, match_length):
+    literal_count = len(literals)
+    match_extra = (match_length - MinMatch) if offset != 0 else 0
+    out.append((min(literal_count, 15) << 4) | min(match_extra, 15))
+    if literal_count >= 15:
+        _emit_length(out, literal_count - 15)
+    out += bytearray(literals)
+    if offset != 0:
+        out += bytearray(struct.pack('<H', offset))
+        if match_extra >= 15:
+            _emit_length(out, match_extra - 15)
+
+def _emit_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+def main():
+    import argparse
+    parser = argparse.ArgumentParser(description='Compress G-code for printing from SD card with APrinter.')
+    parser.add_argument('--input', required=True)
+    parser.add_argument('--output', required=True)
+    parser.add_argument('--window-bits', type=int, default=12,
+        help='Log2 of the window size, at most the DecompressWindowBits of the firmware.')
+    parser.add_argument('--max-searches', type=int, default=DefaultMaxSearches,
+        help='Number of searches for longer matches at each match. The compression '
+             'runs at roughly 300 kB/s with the default and 500 kB/s with 0, at the '
+             'cost of a few percent larger output, so large files take minutes.')
+    args = parser.parse_args()
+    with open(args.input, 'rb') as input_file:
+        data = input_file.read()
+    compressed = compress(data, args.window_bits, args.max_searches)
+    with open(args.output, 'wb') as output_file:
+        output_file.write(compressed)
+
+if __name__ == '__main__':
+    main()
@@ -31,16 +31,177 @@ class GcodeSyntaxError(Exception):
 EncodeLineErrors = GcodeSyntaxError
 
 def encode_line(line):
+    command = _parse_line(line)
+    if command is None:
+        return ''
+    if command == 'EOF':
+        return chr(0xE0)
+    cmd_letter, cmd_number, params = command
+    return _encode_command(cmd_letter, cmd_number, [_encode_param(param_letter, param_value) for (param_letter, param_value) in params])
+
+class DeltaEncoder(object):
+    """
+    Encoder for the second version of the format. The values of the
+    delta axes in G0, G1 and G92 are rounded to multiples of their
+    resolution and encoded as varint differences from the previous value
+    of the same axis. G0/G1 moves with only the first four delta axes
+    are packed without index bytes, and F is left out of G0/G1 when it
+    does not change the current feedrate.
+    
+    Positioning modes (G90/G91, M82/M83 for the extruder axes and the
+    R parameter of G0/G1) are tracked, and for relative values the
+    rounding error is carried into the next relative value of the same
+    axis, so that it does not accumulate over the file.
+    """
+    
+    def __init__(self, delta_axes, extruder_axes='E'):
+        if len(delta_axes) > _MaxDeltaSlots:
+            raise GcodeSyntaxError('too many delta axes')
+        self._slots = []
+        for (letter, resolution) in delta_axes:
+            if not _letter_ok(letter) or letter in (slot[0] for slot in self._slots):
+                raise GcodeSyntaxError('invalid delta axis')
+            if not resolution > 0.0:
+                raise GcodeSyntaxError('invalid delta axis resolution')
+            # Round like the setup packet, which is what the decoder scales by.
+            resolution = struct.unpack('<f', struct.pack('<f', resolution))[0]
+            self._slots.append((letter, resolution))
+        self._extruder_axes = extruder_axes
+        self._values = [0] * len(self._slots)
+        self._feedrate = None
+        self._relative = [False] * len(self._slots)
+        self._carry = [0.0] * len(self._slots)
+    
+    def setup_packet(self):
+        packet = chr((_CmdTypeDeltaSetup << 4) + len(self._slots))
+        for (letter, resolution) in self._slots:
+            packet += chr(ord(letter) - ord('A')) + struct.pack('<f', resolution)
+        self._values = [0] * len(self._slots)
+        self._feedrate = None
+        return packet
+    
+    def encode_line(self, line):
+        command = _parse_line(line)
+        if command is None:
+            return ''
+        if command == 'EOF':
+            return chr(0xE0)
+        cmd_letter, cmd_number, params = command
+        is_move = cmd_letter == 'G' and cmd_number in (0, 1)
+        have_r = any(param_letter == 'R' for (param_letter, param_value) in params)
+        
+        if (cmd_letter, cmd_number) in (('G', 90), ('G', 91), ('M', 82), ('M', 83)):
+            self._update_positioning(cmd_letter == 'M', cmd_number in (91, 83))
+        
+        if is_move and not have_r:
+            params = [param for param in params if not self._feedrate_unchanged(param)]
+        if cmd_letter == 'G' and cmd_number in (0, 1, 2, 3):
+            self._update_feedrate(params, have_r)
+        
+        if not (cmd_letter == 'G' and cmd_number in (0, 1, 92)):
+            return _encode_command(cmd_letter, cmd_number, [_encode_param(param_letter, param_value) for (param_letter, param_value) in params])
+        
+        relative = self._relative
+        if cmd_number == 92:
+            relative = [False] * len(self._slots)
+        elif have_r:
+            r_letters = ''.join(param_value for (param_letter, param_value) in params if param_letter == 'R')
+            relative = [slot_letter in r_letters for (slot_letter, resolution) in self._slots]
+        
+        deltas = []
+        encoded_params = []
+        for (param_letter, param_value) in params:
+            slot = self._find_slot(param_letter)
+            real_value = _parse_real(param_value) if slot is not None else None
+            if real_value is None:
+                deltas.append(None)
+                encoded_params.append(_encode_param(param_letter, param_value))
+                continue
+            delta_payload = self._encode_delta(slot, real_value, relative[slot])
+            deltas.append((slot, delta_payload))
+            encoded_params.append((chr((_DataTypeDelta << 5) + (ord(param_letter) - ord('A'))), delta_payload))
+        
+        slots = [delta[0] for delta in deltas if delta is not None]
+        if is_move and None not in deltas and all(slot < _PackedSlots for slot in slots) and len(set(slots)) == len(slots):
+            cmd_type = _CmdTypeG0Packed if cmd_number == 0 else _CmdTypeG1Packed
+            mask = sum(1 << slot for slot in slots)
+            return chr((cmd_type << 4) + mask) + ''.join(payload for (slot, payload) in sorted(deltas))
+        
+        return _encode_command(cmd_letter, cmd_number, encoded_params)
+    
+    def _find_slot(self, letter):
+        for (slot, (slot_letter, resolution)) in enumerate(self._slots):
+            if slot_letter == letter:
+                return slot
+        return None
+    
+    def _feedrate_unchanged(self, param):
+        param_letter, param_value = param
+        return param_letter == 'F' and self._feedrate is not None and _parse_real(param_value) == self._feedrate
+    
+    def _update_feedrate(self, params, have_r):
+        if have_r:
+            # The feedrate may or may not be saved, depending on the R parameter.
+            self._feedrate = None
+            return
+        for (param_letter, param_value) in params:
+            if param_letter == 'F':
+                self._feedrate = _parse_real(param_value)
+    
+    def _update_positioning(self, extruders_only, relative):
+        for (slot, (slot_letter, resolution)) in enumerate(self._slots):
+            if not extruders_only or slot_letter in self._extruder_axes:
+                self._relative[slot] = relative
+    
+    def _encode_delta(self, slot, real_value, relative):
+        resolution = self._slots[slot][1]
+        if relative:
+            real_value += self._carry[slot]
+        value = int(round(real_value / resolution))
+        self._carry[slot] = (real_value - value * resolution) if relative else 0.0
+        if not (value >= -2**31 and value < 2**31):
+            raise GcodeSyntaxError('value out of range for delta axis resolution')
+        delta = ((value - self._values[slot] + 2**31) % 2**32) - 2**31
+        self._values[slot] = value
+        zigzag = (delta << 1) if delta >= 0 else (((-delta) << 1) - 1)
+        payload = ''
+        while zigzag >= 0x80:
+            payload += chr(0x80 | (zigzag & 0x7F))
+            zigzag >>= 7
+        return payload + chr(zigzag)
+
+EncodeFileErrors = (IOError, GcodeSyntaxError)
+
+def encode_file(input_file_name, output_file_name, delta_encoder=None):
+    line_num = 0
+    with open(input_file_name, "r") as input_file:
+        with open(output_file_name, "w") as output_file:
+            if delta_encoder is not None:
+                output_file.write(delta_encoder.setup_packet())
+            for line in input_file:
+                line_num += 1
+                try:
+                    if delta_encoder is not None:
+                        encoded_data = delta_encoder.encode_line(line)
+                    else:
+                        encoded_data = encode_line(line)
+                except GcodeSyntaxError as e:
+                    e.args = ('line {}: {}'.format(line_num, e.args[0]),)
+                    raise
+                output_file.write(encoded_data)
+            output_file.write(chr(0xE0))
+
+def _parse_line(line):
     comment_index = line.find(';')
     if comment_index >= 0:
         line = line[:comment_index]
     line = line.strip()
     if len(line) == 0:
-        return ''
+        return None
     parts = line.split()
     cmd_letter = parts[0][0]
     if cmd_letter == 'E':
-        return chr(0xE0)
+        return 'EOF'
     if not _letter_ok(cmd_letter):
         raise GcodeSyntaxError('invalid command letter')
     try:
@@ -49,70 +210,62 @@ def encode_line(line):
         raise GcodeSyntaxError('invalid command number')
     if not (cmd_number >= 0 and cmd_number < 2048):
         raise GcodeSyntaxError('invalid command number')
-    packet_index = ''
-    packet_payload = ''
-    num_params = len(parts) - 1
-    if num_params > 14:
+    if len(parts) - 1 > 14:
         raise GcodeSyntaxError('too many parameters')
+    params = []
     for part in parts[1:]:
         param_letter = part[0]
         if not _letter_ok(param_letter):
             raise GcodeSyntaxError('invalid parameter letter')
-        param_value = part[1:]
-        if param_value == '':
-            encode_as = 'void'
+        params.append((param_letter, part[1:]))
+    return (cmd_letter, cmd_number, params)
+
+def _parse_real(param_value):
+    try:
+        return float(param_value)
+    except ValueError:
+        return None
+
+def _encode_param(param_letter, param_value):
+    if param_value == '':
+        encode_as = 'void'
+    else:
+        encode_as = 'integer'
+        try:
+            integer_value = int(param_value)
+            if not (integer_value >= 0 and integer_value < 2**64):
+                raise ValueError()
+        except ValueError:
+            encode_as = 'real'
+            real_value = _parse_real(param_value)
+            if real_value is None:
+                raise GcodeSyntaxError('invalid command argument')
+    if encode_as == 'void':
+        type_code = 5
+        param_payload = ''
+    elif encode_as == 'integer':
+        if integer_value < 2**32:
+            type_code = 3
+            param_payload = struct.pack('<I', integer_value)
         else:
-            encode_as = 'integer'
-            try:
-                integer_value = int(param_value)
-                if not (integer_value >= 0 and integer_value < 2**64):
-                    raise ValueError()
-            except ValueError:
-                encode_as = 'real'
-                try:
-                    real_value = float(param_value)
-                except ValueError:
-                    raise GcodeSyntaxError('invalid command argument')
-        if encode_as == 'void':
-            type_code = 5
-            param_payload = ''
-        elif encode_as == 'integer':
-            if integer_value < 2**32:
-                type_code = 3
-                param_payload = struct.pack('<I', integer_value)
-            else:
-                type_code = 4
-                param_payload = struct.pack('<Q', integer_value)
-        elif encode_as == 'real':
-            type_code = 1
-            param_payload = struct.pack('<f', real_value)
-        packet_index += chr((type_code << 5) + (ord(param_letter) - ord('A')))
-        packet_payload += param_payload
+            type_code = 4
+            param_payload = struct.pack('<Q', integer_value)
+    elif encode_as == 'real':
+        type_code = 1
+        param_payload = struct.pack('<f', real_value)
+    return (chr((type_code << 5) + (ord(param_letter) - ord('A'))), param_payload)
+
+def _encode_command(cmd_letter, cmd_number, encoded_params):
+    packet_index = ''.join(index for (index, payload) in encoded_params)
+    packet_payload = ''.join(payload for (index, payload) in encoded_params)
     if (cmd_letter, cmd_number) in _SmallCommands:
         command_type_code = _SmallCommands[(cmd_letter, cmd_number)]
         packet_header_large = ''
     else:
         command_type_code = 15
         packet_header_large = struct.pack('BB', ((ord(cmd_letter) - ord('A')) << 3) + (cmd_number >> 8), (cmd_number & 0xFF))
-    packet_header = struct.pack('B', (command_type_code << 4) + num_params) + packet_header_large
-    packet = packet_header + packet_index + packet_payload
-    return packet
-
-EncodeFileErrors = (IOError, GcodeSyntaxError)
-
-def encode_file(input_file_name, output_file_name):
-    line_num = 0
-    with open(input_file_name, "r") as input_file:
-        with open(output_file_name, "w") as output_file:
-            for line in input_file:
-                line_num += 1
-                try:
-                    encoded_data = encode_line(line)
-                except GcodeSyntaxError as e:
-                    e.args = ('line {}: {}'.format(line_num, e.args[0]),)
-                    raise
-                output_file.write(encoded_data)
-            output_file.write(chr(0xE0))
+    packet_header = struct.pack('B', (command_type_code << 4) + len(encoded_params)) + packet_header_large
+    return packet_header + packet_index + packet_payload
 
 _SmallCommands = {
     ('G', 0) : 1,
@@ -120,16 +273,53 @@ _SmallCommands = {
     ('G', 92) : 3
 }
 
+_CmdTypeDeltaSetup = 4
+_CmdTypeG0Packed = 5
+_CmdTypeG1Packed = 6
+_DataTypeDelta = 6
+_MaxDeltaSlots = 8
+_PackedSlots = 4
+
 def _letter_ok(ch):
     return (ord(ch) >= ord('A') and ord(ch) <= ord('Z'))
 
+def _parse_delta_axes(delta_axes, resolutions):
+    resolution_map = {}
+    for resolution in resolutions:
+        letter, sep, value = resolution.partition('=')
+        if len(letter) != 1 or sep != '=':
+            raise GcodeSyntaxError('invalid resolution: {}'.format(resolution))
+        try:
+            resolution_map[letter] = float(value)
+        except ValueError:
+            raise GcodeSyntaxError('invalid resolution: {}'.format(resolution))
+    for letter in delta_axes:
+        if letter not in resolution_map:
+            raise GcodeSyntaxError('missing resolution for delta axis {}'.format(letter))
+    return [(letter, resolution_map[letter]) for letter in delta_axes]
+
 def main():
     import argparse
     parser = argparse.ArgumentParser(description='G-code packet for APrinter firmware.')
     parser.add_argument('--input', required=True)
     parser.add_argument('--output', required=True)
+    parser.add_argument('--format-version', type=int, choices=[1, 2], default=1,
+        help='Version 2 adds delta coding of axis positions.')
+    parser.add_argument('--delta-axes', default='XYZE',
+        help='Axes to delta code (version 2), the first four in G0/G1 moves are packed.')
+    parser.add_argument('--resolution', action='append', default=[], metavar='AXIS=UNIT',
+        help='Resolution of a delta axis, such as 1/steps-per-unit (required for each delta axis).')
+    parser.add_argument('--extruder-axes', default='E',
+        help='Axes affected by M82/M83 (version 2).')
     args = parser.parse_args()
-    encode_file(args.input, args.output)
+    delta_encoder = None
+    if args.format_version == 2:
+        try:
+            delta_axes = _parse_delta_axes(args.delta_axes, args.resolution)
+        except GcodeSyntaxError as e:
+            parser.error(e.args[0])
+        delta_encoder = DeltaEncoder(delta_axes, args.extruder_axes)
+    encode_file(args.input, args.output, delta_encoder)
 
 if __name__ == '__main__':
     main()
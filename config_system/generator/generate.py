@@ -951,8 +951,50 @@ def use_analog_input (gen, config, key, user):
 def use_interrupt_timer (gen, config, key, user, clearance=0.0):
     clock = gen.get_singleton_object('Clock')
     
-    for it_config in config.enter_config(key):
+    timer_sel = selection.Selection()
+    
+    @timer_sel.option('interrupt_timer')
+    def option(it_config):
         return clock.add_interrupt_timer(it_config.get_string('oc_unit'), user, clearance, it_config.path())
+    
+    @timer_sel.option('mux_timer')
+    def option(it_config):
+        timer_mux = gen.get_singleton_object('TimerMux', allow_none=True)
+        if timer_mux is None:
+            it_config.path().error('A shared timer requires the board timer multiplexer to be configured.')
+        return timer_mux.add_user(user)
+    
+    return config.do_selection(key, timer_sel)
+
+class TimerMux(object):
+    def __init__ (self, gen, config, key):
+        self._gen = gen
+        self._users = []
+        self._hw_timer_expr = use_interrupt_timer(gen, config, key, user='MyTimerMux::HwTimer')
+    
+    def add_user (self, user):
+        self._users.append(user)
+        return TemplateExpr('InterruptTimerMuxTimerService', ['MyTimerMux', len(self._users) - 1])
+    
+    def finalize (self):
+        self._gen.add_aprinter_include('system/InterruptTimerMux.h')
+        service_expr = TemplateExpr('InterruptTimerMuxService', [self._hw_timer_expr, max(1, len(self._users))])
+        service_code = 'using TimerMuxService = {};'.format(service_expr.build(indent=0))
+        mux_expr = TemplateExpr('TimerMuxService::Mux', ['Context', 'Program'])
+        self._gen.add_global_resource(28, 'MyTimerMux', mux_expr, use_instance=True, code_before=service_code)
+
+def setup_timer_mux (gen, config, key):
+    timer_mux_sel = selection.Selection()
+    
+    @timer_mux_sel.option('NoTimerMux')
+    def option(timer_mux_config):
+        pass
+    
+    @timer_mux_sel.option('TimerMux')
+    def option(timer_mux_config):
+        gen.register_singleton_object('TimerMux', TimerMux(gen, timer_mux_config, 'Timer'))
+    
+    config.do_selection(key, timer_mux_sel)
 
 def use_pwm_output (gen, config, key, user, username, hard=False):
     pwm_output = gen.get_object('pwm_output', config, key)
@@ -1558,12 +1600,17 @@ def generate(config_root_data, cfg_name, main_template):
                     optimize_for_size = performance.get_bool('OptimizeForSize')
                     optimize_libc_for_size = performance.get_bool('OptimizeLibcForSize')
                 
+                if board_data.has('timer_mux'):
+                    setup_timer_mux(gen, board_data, 'timer_mux')
+                
                 event_channel_timer_expr = use_interrupt_timer(gen, board_data, 'EventChannelTimer', user='{}::GetEventChannelTimer<>'.format(aux_control_module_user), clearance=event_channel_timer_clearance)
                 
                 for development in board_data.enter_config('development'):
                     assertions_enabled = development.get_bool('AssertionsEnabled')
                     event_loop_benchmark_enabled = development.get_bool('EventLoopBenchmarkEnabled')
+                    planner_metrics_enabled = development.get_bool('PlannerMetricsEnabled') if development.has('PlannerMetricsEnabled') else False
                     detect_overload_enabled = development.get_bool('DetectOverloadEnabled')
+                    step_trace_enabled = development.get_bool('StepTraceEnabled') if development.has('StepTraceEnabled') else False
                     watchdog_debug_mode = development.get_bool('WatchdogDebugMode') if development.has('WatchdogDebugMode') else False
                     build_with_clang = development.get_bool('BuildWithClang')
                     verbose_build = development.get_bool('VerboseBuild')
@@ -1575,9 +1622,18 @@ def generate(config_root_data, cfg_name, main_template):
                     if event_loop_benchmark_enabled:
                         gen.add_define('EVENTLOOP_BENCHMARK')
                     
+                    if planner_metrics_enabled:
+                        gen.add_define('MOTIONPLANNER_METRICS')
+                    
                     if detect_overload_enabled:
                         gen.add_define('AXISDRIVER_DETECT_OVERLOAD')
                     
+                    if step_trace_enabled:
+                        gen.add_define('AXISDRIVER_STEP_TRACE')
+                        gen.add_aprinter_include('printer/modules/StepTraceModule.h')
+                        step_trace_module = gen.add_module()
+                        step_trace_module.set_expr('StepTraceModuleService')
+                    
                     if development.get_bool('EnableBulkOutputTest'):
                         gen.add_aprinter_include('printer/modules/BulkOutputTestModule.h')
                         bulk_output_test_module = gen.add_module()
@@ -1707,11 +1763,28 @@ def generate(config_root_data, cfg_name, main_template):
                             fs_config.get_bool_constant('HaveAccessInterface'),
                         ])
                     
+                    input_expr = sdcard.do_selection('FsType', fs_sel)
+                    
+                    decompress_window_bits = sdcard.get_int('DecompressWindowBits') if sdcard.has('DecompressWindowBits') else 0
+                    if decompress_window_bits != 0:
+                        if not (8 <= decompress_window_bits <= 16):
+                            sdcard.key_path('DecompressWindowBits').error('Bad value.')
+                        gen.add_aprinter_include('printer/input/LzDecompressInput.h')
+                        input_expr = TemplateExpr('LzDecompressInputService', [
+                            input_expr,
+                            decompress_window_bits,
+                        ])
+                    
+                    resume_index_size = sdcard.get_int('ResumeIndexSize') if sdcard.has('ResumeIndexSize') else 0
+                    if not (resume_index_size == 0 or 2 <= resume_index_size <= 1024):
+                        sdcard.key_path('ResumeIndexSize').error('Bad value.')
+                    
                     sdcard_module.set_expr(TemplateExpr('SdCardModuleService', [
-                        sdcard.do_selection('FsType', fs_sel),
+                        input_expr,
                         sdcard.do_selection('GcodeParser', gcode_parser_sel),
                         sdcard.get_int('BufferBaseSize'),
                         sdcard.get_int('MaxCommandSize'),
+                        resume_index_size,
                     ]))
                 
                 board_data.get_config('sdcard_config').do_selection('sdcard', sdcard_sel)
@@ -1912,6 +1985,8 @@ def generate(config_root_data, cfg_name, main_template):
             current_control_channel_list = []
             microstep_axis_list = []
             
+            jerk_limit_enabled = performance.get_bool('JerkLimitEnabled') if performance.has('JerkLimitEnabled') else False
+            
             def stepper_cb(stepper, stepper_index):
                 name = stepper.get_id_char('Name')
                 
@@ -2010,8 +2085,59 @@ def generate(config_root_data, cfg_name, main_template):
                         gen.add_float_constant('{}StepLowTime'.format(name), delay_config.get_float('StepLowTime')),
                     ])
                 
+                burst_sel = selection.Selection()
+                
+                @burst_sel.option('NoBurst')
+                def option(burst_config):
+                    return 'AxisDriverNoBurstParams'
+                
+                @burst_sel.option('Burst')
+                def option(burst_config):
+                    if delay_expr == 'AxisDriverNoDelayParams':
+                        burst_config.path().error('Burst mode requires step signal timing delays (for the minimum step low time).')
+                    max_steps = burst_config.get_int('MaxSteps')
+                    if not 1 <= max_steps <= 255:
+                        burst_config.key_path('MaxSteps').error('Value out of range.')
+                    return TemplateExpr('AxisDriverBurstParams', [
+                        max_steps,
+                        gen.add_float_constant('{}BurstThreshold'.format(name), burst_config.get_float('Threshold')),
+                    ])
+                
+                delay_expr = stepper.do_selection('delay', delay_sel)
+                
+                input_shaper_sel = selection.Selection()
+                
+                @input_shaper_sel.option('NoInputShaper')
+                def option(input_shaper):
+                    return 'PrinterMainNoInputShaperParams'
+                
+                @input_shaper_sel.option('InputShaper')
+                def option(input_shaper):
+                    return TemplateExpr('PrinterMainInputShaperParams', [
+                        gen.add_float_config('{}InputShaperType'.format(name), input_shaper.get_float('Type')),
+                        gen.add_float_config('{}InputShaperFrequency'.format(name), input_shaper.get_float('Frequency')),
+                        gen.add_float_config('{}InputShaperDamping'.format(name), input_shaper.get_float('Damping')),
+                    ])
+                
+                input_shaper_expr = stepper.do_selection('input_shaper', input_shaper_sel) if stepper.has('input_shaper') else 'PrinterMainNoInputShaperParams'
+                
+                pressure_advance_sel = selection.Selection()
+                
+                @pressure_advance_sel.option('NoPressureAdvance')
+                def option(pressure_advance):
+                    return 'PrinterMainNoPressureAdvanceParams'
+                
+                @pressure_advance_sel.option('PressureAdvance')
+                def option(pressure_advance):
+                    return TemplateExpr('PrinterMainPressureAdvanceParams', [
+                        gen.add_float_config('{}PressureAdvanceK'.format(name), pressure_advance.get_float('K')),
+                        gen.add_float_config('{}PressureAdvanceSmoothTime'.format(name), pressure_advance.get_float('SmoothTime')),
+                    ])
+                
+                pressure_advance_expr = stepper.do_selection('pressure_advance', pressure_advance_sel) if stepper.has('pressure_advance') else 'PrinterMainNoPressureAdvanceParams'
+                
                 first_stepper_port = stepper_ports_for_axis[0]
-                if first_stepper_port.get_config('StepperTimer').get_string('_compoundName') != 'interrupt_timer':
+                if first_stepper_port.get_config('StepperTimer').get_string('_compoundName') not in ('interrupt_timer', 'mux_timer'):
                     first_stepper_port.key_path('StepperTimer').error('Stepper port of first stepper in axis must have a timer unit defined.')
                 
                 return TemplateExpr('PrinterMainAxisParams', [
@@ -2021,8 +2147,11 @@ def generate(config_root_data, cfg_name, main_template):
                     gen.add_float_config('{}MaxPos'.format(name), stepper.get_float('MaxPos')),
                     gen.add_float_config('{}MaxSpeed'.format(name), stepper.get_float('MaxSpeed')),
                     gen.add_float_config('{}MaxAccel'.format(name), stepper.get_float('MaxAccel')),
+                    gen.add_float_config('{}MaxJerk'.format(name), stepper.get_float('MaxJerk')) if jerk_limit_enabled else gen.add_float_constant('{}MaxJerk'.format(name), 0.0),
                     gen.add_float_config('{}DistanceFactor'.format(name), stepper.get_float('DistanceFactor')),
                     gen.add_float_config('{}CorneringDistance'.format(name), stepper.get_float('CorneringDistance')),
+                    input_shaper_expr,
+                    pressure_advance_expr,
                     stepper.do_selection('homing', homing_sel),
                     stepper.get_bool('EnableCartesianSpeedLimit'),
                     stepper.get_bool('IsExtruder'),
@@ -2031,7 +2160,8 @@ def generate(config_root_data, cfg_name, main_template):
                         use_interrupt_timer(gen, first_stepper_port, 'StepperTimer', user='MyPrinter::GetAxisTimer<{}>'.format(stepper_index)),
                         'TheAxisDriverPrecisionParams',
                         stepper.get_bool('PreloadCommands'),
-                        stepper.do_selection('delay', delay_sel),
+                        delay_expr,
+                        stepper.do_selection('burst', burst_sel) if stepper.has('burst') else 'AxisDriverNoBurstParams',
                     ]),
                     slave_steppers_expr,
                 ])
@@ -2043,16 +2173,31 @@ def generate(config_root_data, cfg_name, main_template):
                 
                 conversion_sel = selection.Selection()
                 
+                def uniform_table_size(conversion_config):
+                    table_size = conversion_config.get_int('UniformTableSize') if conversion_config.has('UniformTableSize') else 0
+                    if table_size != 0 and not 2 <= table_size <= 1024:
+                        conversion_config.key_path('UniformTableSize').error('Must be 0 or between 2 and 1024.')
+                    return table_size
+                
+                def uniform_table_wrap(formula_expr, table_size):
+                    if table_size == 0:
+                        return formula_expr
+                    gen.add_aprinter_include('printer/thermistor/UniformTableThermistor.h')
+                    return TemplateExpr('UniformTableThermistorService', [formula_expr, table_size])
+                
                 @conversion_sel.option('conversion')
                 def option(conversion_config):
                     gen.add_aprinter_include('printer/thermistor/GenericThermistor.h')
-                    return TemplateExpr('GenericThermistorService', [
-                        gen.add_float_config('{}HeaterTempResistorR'.format(name), conversion_config.get_float('ResistorR')),
-                        gen.add_float_config('{}HeaterTempR0'.format(name), conversion_config.get_float('R0')),
-                        gen.add_float_config('{}HeaterTempBeta'.format(name), conversion_config.get_float('Beta')),
-                        gen.add_float_config('{}HeaterTempMinTemp'.format(name), conversion_config.get_float('MinTemp')),
-                        gen.add_float_config('{}HeaterTempMaxTemp'.format(name), conversion_config.get_float('MaxTemp')),
-                    ])
+                    table_size = uniform_table_size(conversion_config)
+                    # The uniform table is computed at compile time, so the parameters cannot be runtime configurable.
+                    is_constant = table_size != 0
+                    return uniform_table_wrap(TemplateExpr('GenericThermistorService', [
+                        gen.add_float_config('{}HeaterTempResistorR'.format(name), conversion_config.get_float('ResistorR'), is_constant=is_constant),
+                        gen.add_float_config('{}HeaterTempR0'.format(name), conversion_config.get_float('R0'), is_constant=is_constant),
+                        gen.add_float_config('{}HeaterTempBeta'.format(name), conversion_config.get_float('Beta'), is_constant=is_constant),
+                        gen.add_float_config('{}HeaterTempMinTemp'.format(name), conversion_config.get_float('MinTemp'), is_constant=is_constant),
+                        gen.add_float_config('{}HeaterTempMaxTemp'.format(name), conversion_config.get_float('MaxTemp'), is_constant=is_constant),
+                    ]), table_size)
                 
                 @conversion_sel.option('PtRtdFormula')
                 def option(conversion_config):
@@ -2074,7 +2219,7 @@ def generate(config_root_data, cfg_name, main_template):
                 @conversion_sel.option('E3dPt100')
                 def option(conversion_config):
                     gen.add_aprinter_include('printer/thermistor/InterpolationTableThermistor_tables.h')
-                    return TemplateExpr('InterpolationTableThermistorService', ['InterpolationTableE3dPt100'])
+                    return uniform_table_wrap(TemplateExpr('InterpolationTableThermistorService', ['InterpolationTableE3dPt100']), uniform_table_size(conversion_config))
                 
                 conversion = heater.do_selection('conversion', conversion_sel)
                 
@@ -2135,6 +2280,7 @@ def generate(config_root_data, cfg_name, main_template):
             
             transform_sel = selection.Selection()
             transform_axes = []
+            nonlinear_transform = []
             
             @transform_sel.option('NoTransform')
             def option(transform):
@@ -2238,6 +2384,8 @@ def generate(config_root_data, cfg_name, main_template):
                     ]), 'SCARA'
                 
                 transform_type_expr, transform_prefix = transform_type_sel.run(transform_type)
+                if transform_type not in ('Null', 'CoreXY'):
+                    nonlinear_transform.append(transform_type)
                 
                 splitter_sel = selection.Selection()
                 
@@ -2253,6 +2401,7 @@ def generate(config_root_data, cfg_name, main_template):
                         gen.add_float_config('{}MinSplitLength'.format(transform_prefix), splitter.get_float('MinSplitLength')),
                         gen.add_float_config('{}MaxSplitLength'.format(transform_prefix), splitter.get_float('MaxSplitLength')),
                         gen.add_float_config('{}SegmentsPerSecond'.format(transform_prefix), splitter.get_float('SegmentsPerSecond')),
+                        gen.add_float_config('{}MaxSplitDeviation'.format(transform_prefix), splitter.get_float('MaxDeviation') if splitter.has('MaxDeviation') else 0.0),
                     ])
                 
                 splitter_expr = transform.do_selection('Splitter', splitter_sel)
@@ -2334,6 +2483,36 @@ def generate(config_root_data, cfg_name, main_template):
             
             transform_expr = config.do_selection('transform', transform_sel)
             
+            arcs_sel = selection.Selection()
+            
+            @arcs_sel.option('NoArcs')
+            def option(arcs):
+                return 'PrinterMainNoArcParams'
+            
+            @arcs_sel.option('Arcs')
+            def option(arcs):
+                return TemplateExpr('PrinterMainArcParams', [
+                    gen.add_float_config('ArcChordTolerance', arcs.get_float('ChordTolerance')),
+                ])
+            
+            arcs_expr = config.do_selection('arcs', arcs_sel) if config.has('arcs') else 'PrinterMainNoArcParams'
+            
+            junction_deviation_sel = selection.Selection()
+            
+            @junction_deviation_sel.option('NoJunctionDeviation')
+            def option(junction_deviation):
+                return 'PrinterMainNoJunctionDeviationParams'
+            
+            @junction_deviation_sel.option('JunctionDeviation')
+            def option(junction_deviation):
+                if len(nonlinear_transform) > 0:
+                    junction_deviation.path().error('Junction deviation requires cartesian axes, it cannot be used with the {} transform.'.format(nonlinear_transform[0]))
+                return TemplateExpr('PrinterMainJunctionDeviationParams', [
+                    gen.add_float_config('JunctionDeviation', junction_deviation.get_float('Deviation')),
+                ])
+            
+            junction_deviation_expr = config.do_selection('junction_deviation', junction_deviation_sel) if config.has('junction_deviation') else 'PrinterMainNoJunctionDeviationParams'
+            
             probe_sel = selection.Selection()
             
             @probe_sel.option('NoProbe')
@@ -2524,6 +2703,74 @@ def generate(config_root_data, cfg_name, main_template):
             
             config.do_selection('Moves', moves_sel)
             
+            def planner_group_cb(group_config, group_index):
+                group_prefix = 'Group{}'.format(group_index+1)
+                axis_names = set()
+                
+                gen.add_aprinter_include('printer/actuators/AxisDriver.h')
+                group_module = gen.add_module()
+                
+                def group_axis_cb(axis_config, axis_index):
+                    name = axis_config.get_id_char('Name')
+                    if name in ('F', 'S'):
+                        axis_config.key_path('Name').error('Axis name not allowed.')
+                    if name in axis_names:
+                        axis_config.key_path('Name').error('Duplicate axis name in planner group.')
+                    axis_names.add(name)
+                    axis_prefix = '{}{}'.format(group_prefix, name)
+                    
+                    stepper_port = gen.get_object('stepper_port', axis_config, 'stepper_port')
+                    if stepper_port.get_config('StepperTimer').get_string('_compoundName') not in ('interrupt_timer', 'mux_timer'):
+                        stepper_port.key_path('StepperTimer').error('Stepper port of a planner group axis must have a timer unit defined.')
+                    
+                    return TemplateExpr('PlannerGroupAxisParams', [
+                        TemplateChar(name),
+                        gen.add_float_config('{}StepsPerUnit'.format(axis_prefix), axis_config.get_float('StepsPerUnit')),
+                        gen.add_float_config('{}MinPos'.format(axis_prefix), axis_config.get_float('MinPos')),
+                        gen.add_float_config('{}MaxPos'.format(axis_prefix), axis_config.get_float('MaxPos')),
+                        gen.add_float_config('{}MaxSpeed'.format(axis_prefix), axis_config.get_float('MaxSpeed')),
+                        gen.add_float_config('{}MaxAccel'.format(axis_prefix), axis_config.get_float('MaxAccel')),
+                        gen.add_float_config('{}DistanceFactor'.format(axis_prefix), axis_config.get_float('DistanceFactor')),
+                        gen.add_float_config('{}CorneringDistance'.format(axis_prefix), axis_config.get_float('CorneringDistance')),
+                        32,
+                        TemplateExpr('StepperDef', [
+                            get_pin(gen, stepper_port, 'DirPin'),
+                            get_pin(gen, stepper_port, 'StepPin'),
+                            get_pin(gen, stepper_port, 'EnablePin'),
+                            stepper_port.get_bool('StepLevel'),
+                            stepper_port.get_bool('EnableLevel'),
+                            gen.add_bool_config('{}InvertDir'.format(axis_prefix), axis_config.get_bool('InvertDir')),
+                        ]),
+                        TemplateExpr('AxisDriverService', [
+                            use_interrupt_timer(gen, stepper_port, 'StepperTimer', user='MyPrinter::GetModule<{}>::GetAxisTimer<{}>'.format(group_module.index, axis_index)),
+                            'TheAxisDriverPrecisionParams',
+                            axis_config.get_bool('PreloadCommands'),
+                            'AxisDriverNoDelayParams',
+                            'AxisDriverNoBurstParams',
+                        ]),
+                    ])
+                
+                lookahead_buffer_size = group_config.get_int('LookaheadBufferSize')
+                lookahead_commit_count = group_config.get_int('LookaheadCommitCount')
+                if not 1 <= lookahead_commit_count < lookahead_buffer_size:
+                    group_config.key_path('LookaheadCommitCount').error('Must be at least 1 and less than LookaheadBufferSize.')
+                
+                gen.add_aprinter_include('printer/modules/PlannerGroupModule.h')
+                group_module.set_expr(TemplateExpr('PlannerGroupModuleService', [
+                    group_config.get_int('CommandNumber'),
+                    group_config.get_int('StepperSegmentBufferSize'),
+                    lookahead_buffer_size,
+                    lookahead_commit_count,
+                    'MaxStepsPerCycle',
+                    'SpeedLimitMultiply',
+                    'ForceTimeout',
+                    'InactiveTime',
+                    group_config.do_list('axes', group_axis_cb, min_count=1, max_count=6),
+                ]))
+            
+            if config.has('planner_groups'):
+                config.do_list('planner_groups', planner_group_cb, max_count=4)
+            
             if gen._need_millisecond_clock:
                 if not gen._have_hw_millisecond_clock:
                     gen.add_aprinter_include('system/MillisecondClock.h')
@@ -2533,6 +2780,22 @@ def generate(config_root_data, cfg_name, main_template):
                 millisecond_clock_module = gen.add_module()
                 millisecond_clock_module.set_expr('MillisecondClockInfoModuleService')
             
+            lookahead_commit_count = performance.get_int('LookaheadCommitCount')
+            min_lookahead_commit_count = performance.get_int('MinLookaheadCommitCount') if performance.has('MinLookaheadCommitCount') else 0
+            if min_lookahead_commit_count == 0:
+                min_lookahead_commit_count = lookahead_commit_count
+            if not 1 <= min_lookahead_commit_count <= lookahead_commit_count:
+                performance.key_path('MinLookaheadCommitCount').error('Must be between 1 and LookaheadCommitCount, or zero.')
+            
+            planner_fp_type = performance.get_string('PlannerFpType') if performance.has('PlannerFpType') else 'FpType'
+            if planner_fp_type == 'FpType':
+                planner_fp_type_expr = performance.get_identifier('FpType')
+            elif planner_fp_type == 'FixedFpType':
+                gen.add_aprinter_include('math/FixedFpType.h')
+                planner_fp_type_expr = TemplateExpr('FixedFpType', [31, 20])
+            else:
+                performance.key_path('PlannerFpType').error('Invalid value.')
+            
             printer_params = TemplateExpr('PrinterMainParams', [
                 led_pin_expr,
                 'LedBlinkInterval',
@@ -2544,15 +2807,20 @@ def generate(config_root_data, cfg_name, main_template):
                 gen.add_float_config('MaxStepsPerCycle', performance.get_float('MaxStepsPerCycle')),
                 performance.get_int_constant('StepperSegmentBufferSize'),
                 performance.get_int_constant('LookaheadBufferSize'),
-                performance.get_int_constant('LookaheadCommitCount'),
+                lookahead_commit_count,
+                min_lookahead_commit_count,
+                jerk_limit_enabled,
                 'ForceTimeout',
                 performance.get_identifier('FpType', lambda x: x in ('float', 'double')),
+                planner_fp_type_expr,
                 setup_watchdog(gen, platform, 'watchdog', 'MyPrinter::GetWatchdog'),
                 watchdog_debug_mode,
                 config_manager_expr,
                 'ConfigList',
                 steppers_expr,
                 transform_expr,
+                arcs_expr,
+                junction_deviation_expr,
                 lasers_expr,
                 TemplateList(gen._modules_exprs),
             ])
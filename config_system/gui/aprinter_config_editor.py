@@ -30,6 +30,9 @@ def interrupt_timer_choice(**kwargs):
         oc_unit_choice(key='oc_unit'),
     ], **kwargs)
 
+def mux_timer_choice(**kwargs):
+    return ce.Compound('mux_timer', title='Shared (multiplexed) timer', attrs=[], **kwargs)
+
 def pin_choice(**kwargs):
     return ce.String(**kwargs)
 
@@ -382,6 +385,7 @@ def make_transform_type(transform_type, transform_title, stepper_defs, axis_defs
                     ce.Float(key='MinSplitLength', title='Minimum segment length [mm]', default=0.1),
                     ce.Float(key='MaxSplitLength', title='Maximum segment length [mm]', default=4.0),
                     ce.Float(key='SegmentsPerSecond', title='Segments per second', default=100.0),
+                    ce.Float(key='MaxDeviation', title='Maximum deviation in physical units (0 to split by segments per second)', default=0.0),
                 ]),
                 ce.Compound('NoSplitter', title='Disabled', attrs=[]),
             ]),
@@ -503,8 +507,24 @@ def editor():
                 ce.Float(key='MaxPos', title='Maximum position [mm] (~40000 for extruders)', default=200),
                 ce.Float(key='MaxSpeed', title='Maximum speed [mm/s]', default=300),
                 ce.Float(key='MaxAccel', title='Maximum acceleration [mm/s^2]', default=1500),
+                ce.Float(key='MaxJerk', title='Maximum jerk (if jerk limiting is enabled) [mm/s^3]', default=100000),
                 ce.Float(key='DistanceFactor', title='Distance factor [1]', default=1),
                 ce.Float(key='CorneringDistance', title='Cornering distance (greater values allow greater change of speed at corners) [step]', default=40),
+                ce.OneOf(key='input_shaper', title='Input shaping', choices=[
+                    ce.Compound('NoInputShaper', title='Disabled', attrs=[]),
+                    ce.Compound('InputShaper', title='Enabled', attrs=[
+                        ce.Float(key='Type', title='Shaper type (0=off, 1=ZV, 2=MZV, 3=EI)', default=2),
+                        ce.Float(key='Frequency', title='Resonance frequency [Hz]', default=40),
+                        ce.Float(key='Damping', title='Damping ratio [1]', default=0.1),
+                    ]),
+                ]),
+                ce.OneOf(key='pressure_advance', title='Pressure advance (for extruders)', choices=[
+                    ce.Compound('NoPressureAdvance', title='Disabled', attrs=[]),
+                    ce.Compound('PressureAdvance', title='Enabled', attrs=[
+                        ce.Float(key='K', title='Advance factor (0=off) [s]', default=0.05),
+                        ce.Float(key='SmoothTime', title='Smoothing time [s]', default=0.04),
+                    ]),
+                ]),
                 ce.Boolean(key='EnableCartesianSpeedLimit', title='Is cartesian (Yes for X/Y/Z, No for extruders)', default=True),
                 ce.Boolean(key='IsExtruder', title='Is an extruder (e.g. subject to M82/M83)', default=False),
                 stepper_homing_params(key='homing'),
@@ -517,6 +537,13 @@ def editor():
                         ce.Float(key='StepLowTime', title='Minimum step low time [us]', default=1.0),
                     ]),
                 ]),
+                ce.OneOf(key='burst', title='Burst mode (several steps per interrupt at high step rates, requires step signal timing delays)', choices=[
+                    ce.Compound('NoBurst', title='Disabled', attrs=[]),
+                    ce.Compound('Burst', title='Enabled', attrs=[
+                        ce.Integer(key='MaxSteps', title='Maximum steps per interrupt', default=4),
+                        ce.Float(key='Threshold', title='Step interval below which steps are done in the same interrupt [us]', default=10.0),
+                    ]),
+                ]),
             ])),
             ce.OneOf(key='transform', title='Coordinate transformation', choices=[
                 ce.Compound('NoTransform', title='None (cartesian)', attrs=[]),
@@ -605,7 +632,8 @@ def editor():
                         ce.Float(key='R0', title='Thermistor resistance @25C [ohm]', default=100000),
                         ce.Float(key='Beta', title='Thermistor beta value [K]', default=3960),
                         ce.Float(key='MinTemp', title='Reliable measurements are above [C]', default=10),
-                        ce.Float(key='MaxTemp', title='Reliable measurements are below [C]', default=300)
+                        ce.Float(key='MaxTemp', title='Reliable measurements are below [C]', default=300),
+                        ce.Integer(key='UniformTableSize', title='Size of compile-time conversion table (0=disabled, makes parameters constant)', default=0)
                     ]),
                     ce.Compound('PtRtdFormula', title='Platinum resistance thermometer (PRT)', attrs=[
                         ce.Float(key='ResistorR', title='Series-resistor resistance [ohm]', default=4700),
@@ -616,7 +644,9 @@ def editor():
                         ce.Float(key='MaxTemp', title='Reliable measurements are below [C]', default=600)
                     ]),
                     ce.Compound('Max31855Formula', title='MAX31855 conversion', attrs=[]),
-                    ce.Compound('E3dPt100', title='E3D PT100 Amplifier', attrs=[]),
+                    ce.Compound('E3dPt100', title='E3D PT100 Amplifier', attrs=[
+                        ce.Integer(key='UniformTableSize', title='Size of compile-time conversion table (0=disabled)', default=0)
+                    ]),
                 ]),
                 ce.Compound('control', key='control', title='PID control parameters', attrs=[
                     ce.Float(key='ControlInterval', title='Invoke the PID control algorithm every [s]', default=0.2),
@@ -678,6 +708,18 @@ def editor():
                     ])
                 ])
             ]),
+            ce.OneOf(key='arcs', title='Arc moves (G2/G3)', choices=[
+                ce.Compound('NoArcs', title='Disabled', attrs=[]),
+                ce.Compound('Arcs', title='Enabled', attrs=[
+                    ce.Float(key='ChordTolerance', title='Maximum chord deviation from the arc [mm]', default=0.01),
+                ]),
+            ]),
+            ce.OneOf(key='junction_deviation', title='Junction deviation cornering', choices=[
+                ce.Compound('NoJunctionDeviation', title='Disabled (use cornering distance)', attrs=[]),
+                ce.Compound('JunctionDeviation', title='Enabled (cartesian and CoreXY only)', attrs=[
+                    ce.Float(key='Deviation', title='Junction deviation (0 uses cornering distance) [mm]', default=0.05),
+                ]),
+            ]),
             ce.Array(key='lasers', title='Lasers', copy_name_key='Name', copy_name_suffix='?', elem=ce.Compound('laser', title='Laser', title_key='Name', collapsable=True, ident='id_configuration_laser', attrs=[
                 ce.String(key='Name', title='Name (single letter)', default='L'),
                 ce.Reference(key='laser_port', title='Laser port', ref_array={'base': 'id_configuration.board_data', 'descend': ['laser_ports']}, ref_id_key='Name', ref_name_key='Name'),
@@ -701,6 +743,25 @@ def editor():
                     ])),
                 ]),
             ]),
+            ce.Array(key='planner_groups', title='Independent planner groups', elem=ce.Compound('planner_group', title='Planner group', collapsable=True, attrs=[
+                ce.Integer(key='CommandNumber', title='M-code for moves of this group (M<n> <axis><pos>... F<speed>, without axes waits for completion, M<n> S1 <axis><pos>... sets the position)', default=960),
+                ce.Integer(key='StepperSegmentBufferSize', title='Stepper segment buffer size', default=16),
+                ce.Integer(key='LookaheadBufferSize', title='Lookahead buffer size', default=8),
+                ce.Integer(key='LookaheadCommitCount', title='Lookahead commit count', default=2),
+                ce.Array(key='axes', title='Axes', copy_name_key='Name', copy_name_suffix='?', elem=ce.Compound('planner_group_axis', title='Axis', title_key='Name', collapsable=True, attrs=[
+                    ce.String(key='Name', title='Name (single letter, not F or S)', default='U'),
+                    ce.Reference(key='stepper_port', title='Stepper port', ref_array=configuration_context.board_ref(['stepper_ports']), ref_id_key='Name', ref_name_key='Name'),
+                    ce.Boolean(key='InvertDir', title='Invert direction', default=False),
+                    ce.Float(key='StepsPerUnit', title='Steps per unit [1/mm]', default=80),
+                    ce.Float(key='MinPos', title='Minimum position [mm]', default=0),
+                    ce.Float(key='MaxPos', title='Maximum position [mm]', default=200),
+                    ce.Float(key='MaxSpeed', title='Maximum speed [mm/s]', default=100),
+                    ce.Float(key='MaxAccel', title='Maximum acceleration [mm/s^2]', default=500),
+                    ce.Float(key='DistanceFactor', title='Distance factor [1]', default=1),
+                    ce.Float(key='CorneringDistance', title='Cornering distance [step]', default=40),
+                    ce.Boolean(key='PreloadCommands', title='Command loading mode', default=False, false_title='At first step', true_title='At last step of previous command'),
+                ])),
+            ])),
         ])),
         ce.Array(key='boards', title='Boards', processing_order=-2, copy_name_key='name', elem=ce.Compound('board', title='Board', title_key='name', collapsable=True, ident='id_board', attrs=[
             ce.String(key='name', title='Name (modifying will break references from configurations and lose data)'),
@@ -730,6 +791,12 @@ def editor():
             ]),
             pin_choice(key='LedPin', title='LED pin'),
             interrupt_timer_choice(key='EventChannelTimer', title='Event channel timer'),
+            ce.OneOf(key='timer_mux', title='Timer multiplexer (for boards with few timer units)', choices=[
+                ce.Compound('NoTimerMux', title='Disabled', attrs=[]),
+                ce.Compound('TimerMux', title='Enabled', attrs=[
+                    interrupt_timer_choice(key='Timer', title='Hardware timer'),
+                ]),
+            ]),
             ce.Compound('RuntimeConfig', key='runtime_config', title='Runtime configuration', collapsable=True, attrs=[
                 ce.OneOf(key='config_manager', title='Runtime configuration', choices=[
                     ce.Compound('ConstantConfigManager', title='Disabled', attrs=[]),
@@ -808,6 +875,8 @@ def editor():
                         ]),
                         ce.Integer(key='BufferBaseSize', title='Buffer size'),
                         ce.Integer(key='MaxCommandSize', title='Maximum command size'),
+                        ce.Integer(key='DecompressWindowBits', title='Window size bits for compressed files (0=disabled, RAM use is 2^bits)', default=0),
+                        ce.Integer(key='ResumeIndexSize', title='Layer index size for resuming at a layer (0=disabled)', default=0),
                         ce.OneOf(key='GcodeParser', title='G-code parser', choices=[
                             ce.Compound('TextGcodeParser', title='Text G-code parser', attrs=[
                                 ce.Integer(key='MaxParts', title='Maximum number of command parts')
@@ -892,7 +961,7 @@ def editor():
                                 ce.Float(key='QueueTimeout', title='Timeout for queued clients [s]', default=10),
                                 ce.Float(key='InactivityTimeout', title='Network inactivity timeout [s]', default=10),
                                 ce.Boolean(key='EnableDebug', title='Enable debug messages', default=False),
-                                ce.Integer(key='JsonBufferSize', title='Size of JSON response buffer', default=400),
+                                ce.Integer(key='JsonBufferSize', title='Size of JSON response buffer', default=512),
                                 ce.Integer(key='NumGcodeSlots', title='Maximum simultaneous g-code sessions', default=1),
                                 ce.Integer(key='MaxGcodeParts', title='Max parts in g-code command', default=16),
                                 ce.Integer(key='MaxGcodeCommandSize', title='Maximum g-code command size', default=128),
@@ -911,7 +980,10 @@ def editor():
                 ce.Integer(key='EventChannelBufferSize', title='Event channel buffer size'),
                 ce.Integer(key='LookaheadBufferSize', title='Lookahead buffer size'),
                 ce.Integer(key='LookaheadCommitCount', title='Lookahead commit count'),
+                ce.Integer(key='MinLookaheadCommitCount', title='Minimum lookahead commit count (adaptive if nonzero and lower)', default=0),
+                ce.Boolean(key='JerkLimitEnabled', title='Jerk-limited (S-curve) acceleration', default=False),
                 ce.String(key='FpType', enum=['float', 'double']),
+                ce.String(key='PlannerFpType', title='Number type for lookahead planning (FixedFpType for MCUs without FPU)', enum=['FpType', 'FixedFpType'], default='FpType'),
                 ce.String(key='AxisDriverPrecisionParams', title='Stepping precision parameters', enum=['AxisDriverAvrPrecisionParams', 'AxisDriverDuePrecisionParams']),
                 ce.Float(key='EventChannelTimerClearance', title='Event channel timer clearance'),
                 ce.Boolean(key='OptimizeForSize', title='Optimize compilation for program size', default=False),
@@ -920,7 +992,9 @@ def editor():
             ce.Compound('development', key='development', title='Development features', collapsable=True, attrs=[
                 ce.Boolean(key='AssertionsEnabled', title='Enable assertions', default=False),
                 ce.Boolean(key='EventLoopBenchmarkEnabled', title='Enable event-loop execution timing', default=False),
+                ce.Boolean(key='PlannerMetricsEnabled', title='Enable planner metrics (M923, status JSON)', default=False),
                 ce.Boolean(key='DetectOverloadEnabled', title='Enable interrupt overload detection', default=False),
+                ce.Boolean(key='StepTraceEnabled', title='Enable step trace recording (M950, rr_steptrace)', default=False),
                 ce.Boolean(key='WatchdogDebugMode', title='Setup watchdog for debugging (depends on hardware)', default=False),
                 ce.Boolean(key='BuildWithClang', title='Build with the Clang compiler', default=False),
                 ce.Boolean(key='VerboseBuild', title='Verbose build output', default=False),
@@ -952,6 +1026,7 @@ def editor():
                 ce.Boolean(key='EnableLevel', title='Enable level', default=False, false_title='Enabled at low', true_title='Enabled at high'),
                 ce.OneOf(key='StepperTimer', title='Stepper timer', choices=[
                     interrupt_timer_choice(title='Defined'),
+                    mux_timer_choice(),
                     ce.Compound('NoTimer', title='Not defined (for slave steppers only)', attrs=[]),
                 ]),
                 ce.OneOf(key='microstep', title='Micro-stepping', choices=[
@@ -1001,7 +1076,10 @@ def editor():
             ce.Array(key='laser_ports', title='Laser ports', copy_name_key='Name', elem=ce.Compound('laser_port', title='Laser port', title_key='Name', collapsable=True, ident='id_laser_port', attrs=[
                 ce.String(key='Name', title='Name', default='Laser'),
                 pwm_output_choice(board_context, key='pwm_output', title='PWM output (must be hard-PWM)'),
-                interrupt_timer_choice(key='LaserTimer', title='Output adjustment timer'),
+                ce.OneOf(key='LaserTimer', title='Output adjustment timer', choices=[
+                    interrupt_timer_choice(title='Defined'),
+                    mux_timer_choice(),
+                ]),
             ])),
         ])),
         ce.Reference(key='selected_config', title='Selected configuration (to compile)', ref_array={'base': 'id_editor.configurations', 'descend': []}, ref_id_key='name', ref_name_key='name'),
@@ -18,6 +18,7 @@ class Program (littlevent.close.Obj):
             parser.add_argument('--port', required=True, help='Serial port device.')
             parser.add_argument('--baud', type=int, required=True, help='Baud rate.')
             parser.add_argument('--count', type=int, default=5000, help='Number of commands.')
+            parser.add_argument('--window', type=int, default=0, help='Use the windowed protocol (M110 W1) with this many commands in flight.')
             args = parser.parse_args()
             print(args.port)
             print(args.baud)
@@ -32,9 +33,16 @@ class Program (littlevent.close.Obj):
             self.writing = False
             self.start_time = time.time()
             self.frame = ''
+            self.window = args.window
+            self.window_started = False
+            self.next_line = 1
+            self.resend_count = 0
             
             self._read()
-            self._write()
+            if self.window > 0:
+                self._write_msg('M110 L0 W1\n')
+            else:
+                self._write()
             
         except littlevent.error.Error as e:
             self.close()
@@ -60,6 +68,10 @@ class Program (littlevent.close.Obj):
             data = data[(newline_pos + 1):]
             if len(response) > 0 and response[-1] == '\r':
                 response = response[:-1]
+            if self.window > 0:
+                if not self._windowed_response(response):
+                    return
+                continue
             if not response.startswith('ok'):
                 print('Unknown line received: >{}<'.format(response))
             else:
@@ -71,19 +83,53 @@ class Program (littlevent.close.Obj):
                     return self._finished()
                 self._write()
         
+    def _windowed_response (self, response):
+        if response.startswith('RecvBuffer:'):
+            return True
+        if response.startswith('Resend: '):
+            self.next_line = int(response[8:])
+            self.resend_count += 1
+        elif response == 'ok':
+            self.window_started = True
+        elif response.startswith('ok N'):
+            self.done_count = max(self.done_count, int(response[4:]))
+            if self.done_count >= self.want_count:
+                self._finished()
+                return False
+        else:
+            print('Unknown line received: >{}<'.format(response))
+        if not self.writing:
+            self._write_window()
+        return True
+    
+    def _write_window (self):
+        if not self.window_started:
+            return
+        msg = ''
+        while self.next_line <= min(self.want_count, self.done_count + self.window):
+            line = 'N{} G1'.format(self.next_line)
+            msg += '{}*{}\n'.format(line, reduce(lambda x, ch: x ^ ord(ch), line, 0))
+            self.next_line += 1
+        if len(msg) > 0:
+            self._write_msg(msg)
+    
     def _write_handler (self, err):
         assert self.writing
         if err is not None:
             print('ERROR: write error: {}'.format(err))
             return self._quit()
         self.writing = False
+        if self.window > 0:
+            self._write_window()
     
     def _read (self):
         self.serial.read_io().read_start(512)
     
     def _write (self):
+        self._write_msg('G1\n')
+    
+    def _write_msg (self, msg):
         assert not self.writing
-        msg = 'G1\n'
         self.serial.write_io().write_start(msg)
         self.writing = True
     
@@ -95,6 +141,8 @@ class Program (littlevent.close.Obj):
         total_time = time.time() - self.start_time
         print('Done {} requests in {} seconds.'.format(self.done_count, total_time))
         print('Average request time is {} seconds.'.format(total_time / self.done_count))
+        if self.window > 0:
+            print('Resend requests: {}'.format(self.resend_count))
         self.loop.quit(0)
     
 p = Program()
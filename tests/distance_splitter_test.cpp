@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the error-bounded splitting of DistanceSplitter (MaxDeviation > 0)
+ * on a delta. The move goes from the edge of the print area, where the
+ * transform is strongly curved, to the center, where it is almost linear.
+ * The pieces must respect MaxDeviation, and they must get longer again
+ * toward the center, so the second half of the move takes fewer pieces.
+ * 
+ * Build from the repository root:
+ *   g++ -std=c++14 -O2 -I. tests/distance_splitter_test.cpp -o distance_splitter_test
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include <aprinter/system/InterruptLockCommon.h>
+
+#define APRINTER_INTERRUPT_LOCK_MODE APRINTER_INTERRUPT_LOCK_MODE_SIMPLE
+
+// Single threaded, there is nothing to lock.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/MemberType.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/transform/DeltaTransform.h>
+#include <aprinter/printer/transform/DistanceSplitter.h>
+
+using namespace APrinter;
+
+using FpType = double;
+
+struct Context;
+struct Program;
+
+using MyDebugObjectGroup = DebugObjectGroup<Context, Program>;
+
+struct TestClock {
+    static constexpr double time_unit = 1.0 / 1000000.0;
+};
+
+struct Context {
+    using DebugGroup = MyDebugObjectGroup;
+    using Clock = TestClock;
+    
+    void check () const;
+};
+
+// Options are constant expressions, the config manager returns them as-is.
+template <typename TheExpr>
+struct TestOption {
+    static constexpr TheExpr i ();
+};
+
+struct TestConfigManager {
+    template <typename Option>
+    static Option e (Option);
+};
+
+struct TestDelayedConfigExprs;
+
+APRINTER_MAKE_INSTANCE(TheConfigCache, (ConfigCacheArg<Context, Program, TestDelayedConfigExprs>))
+using Config = ConfigFramework<TestConfigManager, TheConfigCache>;
+
+using DiagonalRod = APRINTER_FP_CONST_EXPR(217.0);
+using SmoothRodOffset = APRINTER_FP_CONST_EXPR(145.0);
+using EffectorOffset = APRINTER_FP_CONST_EXPR(20.0);
+using CarriageOffset = APRINTER_FP_CONST_EXPR(25.0);
+using LimitRadius = APRINTER_FP_CONST_EXPR(150.0);
+
+static constexpr double MinSplitLength = 0.5;
+static constexpr double MaxSplitLength = 4.0;
+static constexpr double MaxDeviation = 0.002;
+
+using MinSplitLengthValue = APRINTER_FP_CONST_EXPR(MinSplitLength);
+using MaxSplitLengthValue = APRINTER_FP_CONST_EXPR(MaxSplitLength);
+using SegmentsPerSecondValue = APRINTER_FP_CONST_EXPR(100.0);
+using MaxDeviationValue = APRINTER_FP_CONST_EXPR(MaxDeviation);
+
+using TheTransformService = DeltaTransformService<
+    TestOption<DiagonalRod>, TestOption<SmoothRodOffset>, TestOption<EffectorOffset>,
+    TestOption<CarriageOffset>, TestOption<LimitRadius>
+>;
+APRINTER_MAKE_INSTANCE(TheTransform, (TheTransformService::Transform<Context, Program, Config, FpType>))
+
+using TheSplitterService = DistanceSplitterService<
+    TestOption<MinSplitLengthValue>, TestOption<MaxSplitLengthValue>,
+    TestOption<SegmentsPerSecondValue>, TestOption<MaxDeviationValue>
+>;
+APRINTER_MAKE_INSTANCE(TheSplitterClass, (TheSplitterService::Splitter<Context, Program, Config, FpType>))
+using TheSplitter = TheSplitterClass::Splitter;
+
+APRINTER_DEFINE_MEMBER_TYPE(MemberType_ConfigExprs, ConfigExprs)
+
+struct TestDelayedConfigExprs {
+    using List = ObjCollect<MakeTypeList<TheTransform, TheSplitterClass>, MemberType_ConfigExprs>;
+};
+
+struct Program : public ObjBase<void, void, MakeTypeList<
+    MyDebugObjectGroup,
+    TheConfigCache,
+    TheTransform,
+    TheSplitterClass
+>> {
+    static Program * self (Context c);
+};
+
+Program program;
+
+Program * Program::self (Context c) { return &program; }
+void Context::check () const {}
+
+struct TestSrc {
+    FpType const *v;
+    
+    template <int Index>
+    FpType get () { return v[Index]; }
+};
+
+struct TestDst {
+    FpType *v;
+    
+    template <int Index>
+    void set (FpType x) { v[Index] = x; }
+};
+
+static FpType const StartPos[3] = {0.0, -110.0, 0.0};
+static FpType const EndPos[3] = {0.0, 0.0, 0.0};
+
+static void move_to_phys (Context c, FpType frac, FpType *phys)
+{
+    FpType virt[3];
+    for (int i = 0; i < 3; i++) {
+        virt[i] = StartPos[i] + frac * (EndPos[i] - StartPos[i]);
+    }
+    bool ok = TheTransform::virtToPhys(c, TestSrc{virt}, TestDst{phys});
+    AMBRO_ASSERT_FORCE(ok)
+}
+
+static FpType move_deviation (Context c, FpType frac0, FpType frac1)
+{
+    FpType phys0[3];
+    FpType phys1[3];
+    FpType physm[3];
+    move_to_phys(c, frac0, phys0);
+    move_to_phys(c, frac1, phys1);
+    move_to_phys(c, 0.5 * (frac0 + frac1), physm);
+    
+    FpType deviation_squared = 0.0;
+    for (int i = 0; i < 3; i++) {
+        FpType d = physm[i] - 0.5 * (phys0[i] + phys1[i]);
+        deviation_squared += d * d;
+    }
+    return sqrt(deviation_squared);
+}
+
+int main ()
+{
+    Context c;
+    
+    MyDebugObjectGroup::init(c);
+    TheConfigCache::init(c);
+    
+    FpType distance = 0.0;
+    for (int i = 0; i < 3; i++) {
+        distance += (EndPos[i] - StartPos[i]) * (EndPos[i] - StartPos[i]);
+    }
+    distance = sqrt(distance);
+    
+    TheSplitter splitter;
+    splitter.start(c, distance, 1.0, 1.0);
+    
+    auto deviation = [&](FpType frac0, FpType frac1) { return move_deviation(c, frac0, frac1); };
+    
+    int first_half_pieces = 0;
+    int second_half_pieces = 0;
+    FpType max_deviation_seen = 0.0;
+    FpType last_length = 0.0;
+    FpType frac = 0.0;
+    bool more;
+    
+    do {
+        FpType rel_max_v_rec;
+        FpType next_frac = frac;
+        more = splitter.pull(c, &rel_max_v_rec, &next_frac, deviation);
+        if (!more) {
+            next_frac = 1.0;
+        }
+        
+        FpType length = (next_frac - frac) * distance;
+        AMBRO_ASSERT_FORCE(length > 0.0)
+        AMBRO_ASSERT_FORCE(length <= MaxSplitLength * 1.0001)
+        AMBRO_ASSERT_FORCE(fabs(rel_max_v_rec - (next_frac - frac)) < 1e-9)
+        
+        FpType dev = move_deviation(c, frac, next_frac);
+        if (length > MinSplitLength * 1.0001) {
+            AMBRO_ASSERT_FORCE(dev <= MaxDeviation)
+        }
+        if (dev > max_deviation_seen) {
+            max_deviation_seen = dev;
+        }
+        
+        if (frac < 0.5) {
+            first_half_pieces++;
+        } else {
+            second_half_pieces++;
+        }
+        if (more) {
+            last_length = length;
+        }
+        frac = next_frac;
+    } while (more);
+    
+    printf("distance=%f pieces=%d+%d max_deviation=%f last_length=%f\n",
+           distance, first_half_pieces, second_half_pieces, max_deviation_seen, last_length);
+    
+    // The curved start needs short pieces, the straighter end longer ones.
+    AMBRO_ASSERT_FORCE(2 * first_half_pieces > 3 * second_half_pieces)
+    AMBRO_ASSERT_FORCE(last_length > 1.5 * MinSplitLength)
+    
+    TheConfigCache::deinit(c);
+    
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Throughput benchmark of GcodeParser.
+ * 
+ * A synthetic G-code stream resembling sliced prints (moves with several
+ * axes, comment lines, and for the serial parser line numbers and
+ * checksums) is parsed repeatedly. The parsing rate of the fastest pass
+ * is reported, being less affected by other load than the average.
+ * The result digest depends only on what was parsed, so it must be
+ * the same with and without the fast scanning path.
+ * 
+ * Build from the repository root, with and without the fast path:
+ *   g++ -std=c++14 -O2 -I. tests/gcode_parser_bench.cpp -o gcode_parser_bench
+ *   g++ -std=c++14 -O2 -I. -DGCODEPARSER_NO_FAST_SCAN tests/gcode_parser_bench.cpp -o gcode_parser_bench_slow
+ * 
+ * Usage: gcode_parser_bench [megabytes]
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#include <aprinter/system/InterruptLockCommon.h>
+
+#define APRINTER_INTERRUPT_LOCK_MODE APRINTER_INTERRUPT_LOCK_MODE_SIMPLE
+
+// Single threaded, there is nothing to lock.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/printer/utils/GcodeParser.h>
+
+using namespace APrinter;
+
+struct Context {};
+
+struct Params {
+    static int const MaxParts = 16;
+};
+
+template <typename ParserType>
+using Parser = GcodeParser<Context, size_t, float, ParserType, Params>;
+
+static std::string make_line (bool serial, uint32_t index)
+{
+    char line[128];
+    uint32_t x = (index * 7919) % 200000;
+    uint32_t y = (index * 104729) % 200000;
+    
+    if (!serial && index % 16 == 0) {
+        snprintf(line, sizeof(line), ";TYPE:WALL-OUTER ; layer %" PRIu32 " of the print\n", index / 1000);
+    } else {
+        snprintf(line, sizeof(line), "G1 X%" PRIu32 ".%03" PRIu32 " Y%" PRIu32 ".%03" PRIu32 " E%" PRIu32 ".%05" PRIu32 " F%d",
+                 x / 1000, x % 1000, y / 1000, y % 1000, index / 100, (index * 37) % 100000, (index % 3 == 0) ? 1800 : 4800);
+    }
+    
+    if (!serial) {
+        if (line[0] != ';') {
+            strcat(line, "\n");
+        }
+        return line;
+    }
+    
+    char numbered[160];
+    snprintf(numbered, sizeof(numbered), "N%" PRIu32 " %s", index, line);
+    uint8_t checksum = 0;
+    for (char const *p = numbered; *p; p++) {
+        checksum ^= (uint8_t)*p;
+    }
+    snprintf(numbered + strlen(numbered), sizeof(numbered) - strlen(numbered), "*%d\n", (int)checksum);
+    return numbered;
+}
+
+template <typename ParserType>
+static void run (char const *name, bool serial, size_t total_bytes)
+{
+    std::string stream;
+    for (uint32_t index = 0; stream.size() < (1 << 20); index++) {
+        stream += make_line(serial, index);
+    }
+    
+    char *buffer = (char *)malloc(stream.size());
+    Parser<ParserType> parser;
+    Context c;
+    parser.init(c);
+    
+    uint64_t digest = 0;
+    uint64_t commands = 0;
+    uint64_t parsed_bytes = 0;
+    double best_seconds = 0.0;
+    
+    while (parsed_bytes < total_bytes) {
+        memcpy(buffer, stream.data(), stream.size());
+        
+        timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        
+        size_t pos = 0;
+        commands = 0;
+        while (pos < stream.size()) {
+            parser.startCommand(c, buffer + pos, 0);
+            if (!parser.extendCommand(c, stream.size() - pos)) {
+                fprintf(stderr, "Unterminated command\n");
+                exit(1);
+            }
+            
+            int num_parts = parser.getNumParts(c);
+            digest = digest * 31 + (uint64_t)(num_parts + 16);
+            if (num_parts >= 0) {
+                digest = digest * 31 + parser.getCmdNumber(c);
+                for (int i = 0; i < num_parts; i++) {
+                    auto part = parser.getPart(c, i);
+                    digest = digest * 31 + (uint8_t)parser.getPartCode(c, part);
+                    digest = digest * 31 + strlen(parser.getPartStringValue(c, part));
+                }
+            }
+            
+            pos += parser.getLength(c);
+            commands++;
+        }
+        
+        timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (parsed_bytes == 0 || seconds < best_seconds) {
+            best_seconds = seconds;
+        }
+        parsed_bytes += stream.size();
+    }
+    
+    parser.deinit(c);
+    free(buffer);
+    
+    printf("%s: %.1f MB/s, %.2f Mcmd/s, digest %016" PRIx64 "\n", name,
+           stream.size() / best_seconds / 1e6, commands / best_seconds / 1e6, digest);
+}
+
+int main (int argc, char *argv[])
+{
+    size_t megabytes = (argc > 1) ? atoi(argv[1]) : 200;
+    
+#ifdef GCODEPARSER_NO_FAST_SCAN
+    printf("Fast scan: disabled\n");
+#else
+    printf("Fast scan: %d byte blocks\n", (int)GcodeParserScan::BlockSize);
+#endif
+    
+    run<GcodeParserTypeFile>("file", false, megabytes << 20);
+    run<GcodeParserTypeSerial>("serial", true, megabytes << 20);
+    
+    return 0;
+}
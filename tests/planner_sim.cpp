@@ -0,0 +1,1018 @@
+/*
+ * Copyright (c) 2016 Ambroz Bizjak
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Offline motion planner simulator.
+ * 
+ * G-code moves are fed through the real MotionPlanner, LinearPlanner and
+ * AxisDriver code, with the hardware timers replaced by a virtual clock.
+ * Whenever there is no pending event, the clock jumps straight to the next
+ * timer, so a job runs as fast as the planner can produce step commands.
+ * This gives the print time of a job, as well as the CPU cost of planning
+ * it, which can be used to compare lookahead settings.
+ * 
+ * Build from the repository root:
+ *   g++ -std=c++14 -O2 -ftemplate-depth=1024 -I. tests/planner_sim.cpp -o planner_sim
+ * 
+ * Usage: planner_sim [-s] [-p] <file.gcode>
+ *   -s  print every step as "<time> <axis> <dir>"
+ *   -p  print the profile of every move after the summary
+ * 
+ * The machine is configured at compile time, the PLANNER_SIM_* defines
+ * below can be overridden with -D. Define PLANNER_SIM_COREXY to pass
+ * the first two axes through the CoreXY transform. Define
+ * PLANNER_SIM_JUNCTION_DEVIATION (in mm) to use the junction deviation
+ * cornering model instead of the cornering distance. Define
+ * PLANNER_SIM_MAX_JERK (in units/s^3) to enable jerk limiting with that
+ * limit on all axes. Define PLANNER_SIM_INPUT_SHAPER (in Hz) to enable an
+ * MZV input shaper at that frequency on the cartesian axes. Define
+ * PLANNER_SIM_FIXED_PLANNING to run the lookahead planning in fixed point
+ * (FixedFpType), as would be done on processors without an FPU.
+ * Only G0/G1, G90/G91, G92, M82/M83 and M106/M107 are interpreted,
+ * everything else is ignored. Fan commands go through a planner channel
+ * like in the firmware, their count is reported along with the largest
+ * offset of their execution from the last step of the preceding move.
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include <aprinter/system/InterruptLockCommon.h>
+
+#define APRINTER_INTERRUPT_LOCK_MODE APRINTER_INTERRUPT_LOCK_MODE_SIMPLE
+
+// Stub F_CPU of 1Hz so that MaxStepsPerCycle means max steps per second.
+#define F_CPU (1.0)
+
+// Timer handlers are called from the main loop, there is nothing to lock.
+inline static void cli (void) {}
+inline static void sei (void) {}
+
+#include <aprinter/meta/TypeListUtils.h>
+#include <aprinter/meta/MemberType.h>
+#include <aprinter/meta/ServiceUtils.h>
+#include <aprinter/meta/WrapFunction.h>
+#include <aprinter/meta/TupleGet.h>
+#include <aprinter/meta/Expr.h>
+#include <aprinter/base/Object.h>
+#include <aprinter/base/DebugObject.h>
+#include <aprinter/base/Assert.h>
+#include <aprinter/system/InterruptLock.h>
+#include <aprinter/math/FixedFpType.h>
+#include <aprinter/printer/Configuration.h>
+#include <aprinter/printer/actuators/AxisDriver.h>
+#include <aprinter/printer/planning/MotionPlanner.h>
+#include <aprinter/printer/transform/IdentityTransform.h>
+#include <aprinter/printer/transform/CoreXyTransform.h>
+
+using namespace APrinter;
+
+#ifndef PLANNER_SIM_STEPPER_SEGMENT_BUFFER_SIZE
+#define PLANNER_SIM_STEPPER_SEGMENT_BUFFER_SIZE 30
+#endif
+
+#ifndef PLANNER_SIM_LOOKAHEAD_BUFFER_SIZE
+#define PLANNER_SIM_LOOKAHEAD_BUFFER_SIZE 28
+#endif
+
+#ifndef PLANNER_SIM_LOOKAHEAD_COMMIT_COUNT
+#define PLANNER_SIM_LOOKAHEAD_COMMIT_COUNT 10
+#endif
+
+#ifndef PLANNER_SIM_MIN_LOOKAHEAD_COMMIT_COUNT
+#define PLANNER_SIM_MIN_LOOKAHEAD_COMMIT_COUNT PLANNER_SIM_LOOKAHEAD_COMMIT_COUNT
+#endif
+
+#ifndef PLANNER_SIM_CHANNEL_BUFFER_SIZE
+#define PLANNER_SIM_CHANNEL_BUFFER_SIZE (PLANNER_SIM_LOOKAHEAD_COMMIT_COUNT + 2)
+#endif
+
+#ifndef PLANNER_SIM_MAX_STEPS_PER_SECOND
+#define PLANNER_SIM_MAX_STEPS_PER_SECOND 300000.0
+#endif
+
+#ifndef PLANNER_SIM_CORNERING_DISTANCE
+#define PLANNER_SIM_CORNERING_DISTANCE 40.0
+#endif
+
+// Axis table: name, steps per unit, max speed [unit/s], max acceleration [unit/s^2].
+#ifndef PLANNER_SIM_AXES
+#define PLANNER_SIM_AXES \
+    {'X', 80.0, 300.0, 1500.0}, \
+    {'Y', 80.0, 300.0, 1500.0}, \
+    {'Z', 4000.0, 3.0, 30.0}, \
+    {'E', 100.0, 45.0, 250.0}
+#endif
+
+using FpType = float;
+#ifdef PLANNER_SIM_FIXED_PLANNING
+using PlannerFpType = FixedFpType<31, 20>;
+#else
+using PlannerFpType = FpType;
+#endif
+
+struct SimAxisDef {
+    char name;
+    double steps_per_unit;
+    double max_speed;
+    double max_accel;
+};
+
+static constexpr SimAxisDef SimAxisDefs[] = {PLANNER_SIM_AXES};
+static int const NumAxes = sizeof(SimAxisDefs) / sizeof(SimAxisDefs[0]);
+static int const NumTransformAxes = 2;
+
+static_assert(NumAxes >= NumTransformAxes, "");
+
+static constexpr bool is_cartesian_axis (char name)
+{
+    return name == 'X' || name == 'Y' || name == 'Z';
+}
+
+static constexpr uint32_t cartesian_axes_mask ()
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < NumAxes; i++) {
+        if (is_cartesian_axis(SimAxisDefs[i].name)) {
+            mask |= (uint32_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+struct Context;
+struct Program;
+struct SimClock;
+struct SimFastEvents;
+template <typename> struct SimEventLoop;
+
+using MyDebugObjectGroup = DebugObjectGroup<Context, Program>;
+
+struct Context {
+    using DebugGroup = MyDebugObjectGroup;
+    using Clock = SimClock;
+    using EventLoop = SimEventLoop<SimFastEvents>;
+    
+    void check () const;
+};
+
+/*
+ * Virtual time. The full time is kept in 64 bits for reporting,
+ * the code under test only sees the low 32 bits as usual.
+ */
+
+static uint64_t sim_time;
+
+struct SimClock {
+    using TimeType = uint32_t;
+    
+    static constexpr double time_freq = 1048576.0;
+    static constexpr double time_unit = 1.0 / time_freq;
+    
+    template <typename ThisContext>
+    static TimeType getTime (ThisContext c)
+    {
+        return sim_time;
+    }
+};
+
+template <typename FastEventsHolder>
+struct SimEventLoop {
+    using FastHandlerType = void (*) (Context);
+    
+    template <typename Id>
+    struct FastEventSpec {};
+    
+    template <typename EventSpec>
+    static void initFastEvent (Context c, FastHandlerType handler)
+    {
+        FastEventState *ev = get_event<EventSpec>();
+        ev->handler = handler;
+        ev->pending = false;
+    }
+    
+    template <typename EventSpec>
+    static void resetFastEvent (Context c)
+    {
+        get_event<EventSpec>()->pending = false;
+    }
+    
+    template <typename EventSpec, typename ThisContext>
+    static void triggerFastEvent (ThisContext c)
+    {
+        get_event<EventSpec>()->pending = true;
+    }
+    
+    static bool dispatchFastEvents (Context c)
+    {
+        bool dispatched = false;
+        for (int i = 0; i < NumFastEvents(); i++) {
+            FastEventState *ev = &events()[i];
+            if (ev->pending) {
+                ev->pending = false;
+                ev->handler(c);
+                dispatched = true;
+            }
+        }
+        return dispatched;
+    }
+    
+private:
+    struct FastEventState {
+        FastHandlerType handler;
+        bool pending;
+    };
+    
+    static constexpr int NumFastEvents ()
+    {
+        return TypeListLength<typename FastEventsHolder::List>::Value;
+    }
+    
+    static FastEventState * events ()
+    {
+        static FastEventState states[NumFastEvents()];
+        return states;
+    }
+    
+    template <typename EventSpec>
+    static FastEventState * get_event ()
+    {
+        return &events()[TypeListIndex<typename FastEventsHolder::List, EventSpec>::Value];
+    }
+};
+
+/*
+ * Timers. The main loop calls the handler of the earliest active timer
+ * after advancing the virtual clock to its time.
+ */
+
+struct SimTimerState {
+    bool active;
+    uint32_t time;
+    void (*handler) (AtomicContext<Context>);
+};
+
+// One timer for each axis, followed by the one of the fan channel.
+static int const NumSimTimers = NumAxes + 1;
+static int const SimChannelTimerIndex = NumAxes;
+
+static SimTimerState sim_timers[NumSimTimers];
+
+template <typename Arg>
+class SimInterruptTimer {
+    APRINTER_USE_TYPE1(Arg, Handler)
+    APRINTER_USE_TYPE1(Arg, Params)
+    
+    APRINTER_USE_VAL(Params, Index)
+    
+    static_assert(Index >= 0 && Index < NumSimTimers, "");
+    
+public:
+    using TimeType = SimClock::TimeType;
+    using HandlerContext = AtomicContext<Context>;
+    
+    static void init (Context c)
+    {
+        sim_timers[Index].active = false;
+        sim_timers[Index].handler = SimInterruptTimer::timer_handler;
+    }
+    
+    static void deinit (Context c)
+    {
+        sim_timers[Index].active = false;
+    }
+    
+    template <typename ThisContext>
+    static void setFirst (ThisContext c, TimeType time)
+    {
+        AMBRO_ASSERT(!sim_timers[Index].active)
+        
+        sim_timers[Index].time = time;
+        sim_timers[Index].active = true;
+    }
+    
+    static void setNext (HandlerContext c, TimeType time)
+    {
+        AMBRO_ASSERT(sim_timers[Index].active)
+        
+        sim_timers[Index].time = time;
+    }
+    
+    template <typename ThisContext>
+    static void unset (ThisContext c)
+    {
+        sim_timers[Index].active = false;
+    }
+    
+    template <typename ThisContext>
+    static TimeType getLastSetTime (ThisContext c)
+    {
+        return sim_timers[Index].time;
+    }
+    
+private:
+    static void timer_handler (HandlerContext c)
+    {
+        if (!Handler::call(c)) {
+            sim_timers[Index].active = false;
+        }
+    }
+    
+public:
+    struct Object {};
+};
+
+APRINTER_ALIAS_STRUCT_EXT(SimTimerService, (
+    APRINTER_AS_VALUE(int, Index)
+), (
+    APRINTER_ALIAS_STRUCT_EXT(InterruptTimer, (
+        APRINTER_AS_TYPE(Context),
+        APRINTER_AS_TYPE(ParentObject),
+        APRINTER_AS_TYPE(Handler)
+    ), (
+        using Params = SimTimerService;
+        APRINTER_DEF_INSTANCE(InterruptTimer, SimInterruptTimer)
+    ))
+))
+
+/*
+ * Steppers, which record the steps generated by the axis drivers.
+ */
+
+struct SimAxisState {
+    bool dir;
+    uint64_t steps;
+    int64_t pos;
+    uint64_t last_step_time;
+    size_t move_index;
+};
+
+static SimAxisState sim_axes[NumAxes];
+static int64_t sim_planned_steps[NumAxes];
+static bool sim_trace_steps;
+
+static void sim_step (int axis_index);
+
+template <int AxisIndex>
+struct SimStepper {
+    template <typename ThisContext>
+    static void setDir (ThisContext c, bool dir)
+    {
+        sim_axes[AxisIndex].dir = dir;
+    }
+    
+    template <typename ThisContext>
+    static void stepOn (ThisContext c)
+    {
+        sim_step(AxisIndex);
+    }
+    
+    template <typename ThisContext>
+    static void stepOff (ThisContext c)
+    {
+    }
+};
+
+/*
+ * The planner and its axes.
+ */
+
+struct SimDelayedConfigExprs;
+
+// All configuration is constant, there are no runtime options.
+struct SimNoConfigManager {
+    template <typename Option>
+    static Option e (Option);
+};
+
+APRINTER_MAKE_INSTANCE(TheConfigCache, (ConfigCacheArg<Context, Program, SimDelayedConfigExprs>))
+using Config = ConfigFramework<SimNoConfigManager, TheConfigCache>;
+
+#ifdef PLANNER_SIM_COREXY
+using TheTransformService = CoreXyTransformService;
+#else
+using TheTransformService = IdentityTransformService<NumTransformAxes>;
+#endif
+APRINTER_MAKE_INSTANCE(TheTransform, (TheTransformService::Transform<Context, Program, Config, FpType>))
+
+template <int AxisIndex>
+struct SimAxis {
+    struct DelayedConsumersList;
+    
+    APRINTER_MAKE_INSTANCE(TheAxisDriver, (AxisDriverService<
+        SimTimerService<AxisIndex>, AxisDriverDuePrecisionParams, false, AxisDriverNoDelayParams, AxisDriverNoBurstParams
+    >::template Driver<Context, Program, SimStepper<AxisIndex>, DelayedConsumersList>))
+    
+    static constexpr double speed_conversion ()
+    {
+        return SimAxisDefs[AxisIndex].steps_per_unit / SimClock::time_freq;
+    }
+    
+    using DistanceFactor = APRINTER_FP_CONST_EXPR(1.0);
+    using CorneringDistance = APRINTER_FP_CONST_EXPR(PLANNER_SIM_CORNERING_DISTANCE);
+    using MaxSpeedRec = APRINTER_FP_CONST_EXPR(1.0 / (SimAxisDefs[AxisIndex].max_speed * speed_conversion()));
+    using MaxAccelRec = APRINTER_FP_CONST_EXPR(1.0 / (SimAxisDefs[AxisIndex].max_accel * speed_conversion() / SimClock::time_freq));
+#ifdef PLANNER_SIM_MAX_JERK
+    using MaxJerkRec = APRINTER_FP_CONST_EXPR(1.0 / (PLANNER_SIM_MAX_JERK * speed_conversion() / (SimClock::time_freq * SimClock::time_freq)));
+#else
+    using MaxJerkRec = APRINTER_FP_CONST_EXPR(0.0);
+#endif
+    using StepsPerUnit = APRINTER_FP_CONST_EXPR(SimAxisDefs[AxisIndex].steps_per_unit);
+    
+#ifdef PLANNER_SIM_INPUT_SHAPER
+    using ShaperType = APRINTER_FP_CONST_EXPR(2.0);
+    using ShaperFrequency = APRINTER_FP_CONST_EXPR(PLANNER_SIM_INPUT_SHAPER);
+    using ShaperDamping = APRINTER_FP_CONST_EXPR(0.1);
+    using InputShaper = If<is_cartesian_axis(SimAxisDefs[AxisIndex].name),
+        MotionPlannerInputShaper<ShaperType, ShaperFrequency, ShaperDamping>, MotionPlannerNoInputShaper>;
+#else
+    using InputShaper = MotionPlannerNoInputShaper;
+#endif
+    
+    static bool prestep_callback (typename TheAxisDriver::StepContext c)
+    {
+        return false;
+    }
+    struct PrestepCallback : public AMBRO_WFUNC_TD(&SimAxis::prestep_callback) {};
+    
+    struct PlannerAxisSpec : public MotionPlannerAxisSpec<
+        TheAxisDriver, 32, DistanceFactor, CorneringDistance, MaxSpeedRec, MaxAccelRec, MaxJerkRec, StepsPerUnit,
+        InputShaper, MotionPlannerNoPressureAdvance, PrestepCallback
+    > {};
+    
+    template <typename PlannerCmd>
+    static void write_command (PlannerCmd *cmd, int64_t const *target_steps)
+    {
+        auto *axis_cmd = TupleGetElem<AxisIndex>(cmd->axes.axes());
+        using StepFixedType = decltype(axis_cmd->x);
+        
+        int64_t delta = target_steps[AxisIndex] - sim_planned_steps[AxisIndex];
+        axis_cmd->dir = (delta >= 0);
+        axis_cmd->x = StepFixedType::importBits(delta >= 0 ? delta : -delta);
+    }
+};
+
+AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_TheAxisDriver, TheAxisDriver)
+AMBRO_DECLARE_GET_MEMBER_TYPE_FUNC(GetMemberType_PlannerAxisSpec, PlannerAxisSpec)
+APRINTER_DEFINE_MEMBER_TYPE(MemberType_ConfigExprs, ConfigExprs)
+
+using SimAxesList = IndexElemListCount<NumAxes, SimAxis>;
+
+struct SimChannelPayload {
+    float duty;
+};
+
+template <typename ThisContext>
+static void sim_channel_callback (ThisContext c, SimChannelPayload *payload);
+struct SimChannelCallback : public AMBRO_WFUNC_TD(&sim_channel_callback<AtomicContext<Context>>) {};
+
+using SimChannelSpec = MotionPlannerChannelSpec<SimChannelPayload, SimChannelCallback, PLANNER_SIM_CHANNEL_BUFFER_SIZE, SimTimerService<SimChannelTimerIndex>>;
+
+static void planner_pull_handler (Context c);
+static void planner_finished_handler (Context c);
+static void planner_aborted_handler (Context c);
+static void planner_underrun_callback (Context c);
+struct PlannerPullHandler : public AMBRO_WFUNC_TD(&planner_pull_handler) {};
+struct PlannerFinishedHandler : public AMBRO_WFUNC_TD(&planner_finished_handler) {};
+struct PlannerAbortedHandler : public AMBRO_WFUNC_TD(&planner_aborted_handler) {};
+struct PlannerUnderrunCallback : public AMBRO_WFUNC_TD(&planner_underrun_callback) {};
+
+using MaxStepsPerCycle = APRINTER_FP_CONST_EXPR(PLANNER_SIM_MAX_STEPS_PER_SECOND);
+
+#ifdef PLANNER_SIM_JUNCTION_DEVIATION
+using SimJunctionDeviationValue = APRINTER_FP_CONST_EXPR(PLANNER_SIM_JUNCTION_DEVIATION);
+using SimJunctionDeviation = MotionPlannerJunctionDeviation<SimJunctionDeviationValue, cartesian_axes_mask()>;
+#else
+using SimJunctionDeviation = MotionPlannerNoJunctionDeviation;
+#endif
+
+#ifdef PLANNER_SIM_MAX_JERK
+static bool const SimJerkLimitEnabled = true;
+#else
+static bool const SimJerkLimitEnabled = false;
+#endif
+
+APRINTER_MAKE_INSTANCE(ThePlanner, (MotionPlannerArg<
+    Context, Program, Config, MapTypeList<SimAxesList, GetMemberType_PlannerAxisSpec>,
+    PLANNER_SIM_STEPPER_SEGMENT_BUFFER_SIZE, PLANNER_SIM_LOOKAHEAD_BUFFER_SIZE, PLANNER_SIM_LOOKAHEAD_COMMIT_COUNT, PLANNER_SIM_MIN_LOOKAHEAD_COMMIT_COUNT,
+    FpType, PlannerFpType, MaxStepsPerCycle, PlannerPullHandler, PlannerFinishedHandler, PlannerAbortedHandler, PlannerUnderrunCallback,
+    MakeTypeList<SimChannelSpec>, EmptyTypeList, SimJerkLimitEnabled, SimJunctionDeviation
+>))
+
+template <int AxisIndex>
+struct SimAxis<AxisIndex>::DelayedConsumersList {
+    using List = MakeTypeList<typename ThePlanner::template TheAxisDriverConsumer<AxisIndex>>;
+};
+
+struct SimDelayedConfigExprs {
+    using List = ObjCollect<MakeTypeList<ThePlanner>, MemberType_ConfigExprs>;
+};
+
+struct SimFastEvents {
+    using List = ThePlanner::EventLoopFastEvents;
+};
+
+struct Program : public ObjBase<void, void, JoinTypeLists<
+    MakeTypeList<
+        MyDebugObjectGroup,
+        TheConfigCache,
+        TheTransform,
+        ThePlanner
+    >,
+    MapTypeList<SimAxesList, GetMemberType_TheAxisDriver>
+>> {
+    static Program * self (Context c);
+};
+
+union ProgramMemory {
+    ProgramMemory () {}
+    ~ProgramMemory () {}
+    
+    Program program;
+} program_memory;
+
+Program * Program::self (Context c) { return &program_memory.program; }
+void Context::check () const {}
+
+/*
+ * Moves and their profiles, reconstructed from the recorded steps.
+ */
+
+struct SimMove {
+    double distance;
+    uint64_t end_steps[NumAxes];
+    int main_axis;
+    bool started;
+    uint64_t start_time;
+    uint64_t end_time;
+    uint64_t min_step_interval;
+};
+
+static std::vector<SimMove> sim_moves;
+static bool sim_done;
+static uint64_t sim_underruns;
+
+// A fan command is due when the move before it has ended, which is
+// the last step of the moves submitted before it.
+struct SimChannelCommand {
+    size_t num_moves;
+    uint64_t time;
+};
+
+static std::vector<SimChannelCommand> sim_channel_commands;
+static size_t sim_channel_done;
+
+static void sim_step (int axis_index)
+{
+    SimAxisState *axis = &sim_axes[axis_index];
+    
+    axis->steps++;
+    axis->pos += axis->dir ? 1 : -1;
+    
+    if (sim_trace_steps) {
+        printf("%.6f %c %d\n", sim_time / SimClock::time_freq, SimAxisDefs[axis_index].name, (int)axis->dir);
+    }
+    
+    while (axis->steps > sim_moves[axis->move_index].end_steps[axis_index]) {
+        axis->move_index++;
+        AMBRO_ASSERT_FORCE(axis->move_index < sim_moves.size())
+    }
+    
+    SimMove *move = &sim_moves[axis->move_index];
+    if (!move->started) {
+        move->started = true;
+        move->start_time = sim_time;
+    }
+    move->end_time = sim_time;
+    
+    // Step intervals of the main axis give the speed. The first step of
+    // a move is skipped, as its interval partly belongs to the previous move.
+    if (axis_index == move->main_axis) {
+        uint64_t first_step = (axis->move_index == 0) ? 1 : sim_moves[axis->move_index - 1].end_steps[axis_index] + 1;
+        if (axis->steps > first_step) {
+            uint64_t interval = sim_time - axis->last_step_time;
+            if (move->min_step_interval == 0 || interval < move->min_step_interval) {
+                move->min_step_interval = interval;
+            }
+        }
+    }
+    axis->last_step_time = sim_time;
+}
+
+template <typename ThisContext>
+static void sim_channel_callback (ThisContext c, SimChannelPayload *payload)
+{
+    AMBRO_ASSERT_FORCE(sim_channel_done < sim_channel_commands.size())
+    sim_channel_commands[sim_channel_done++].time = sim_time;
+}
+
+/*
+ * G-code interpretation.
+ */
+
+struct SimVirtSrc {
+    double const *pos;
+    
+    template <int Index>
+    double get ()
+    {
+        return pos[Index];
+    }
+};
+
+struct SimPhysDst {
+    double *pos;
+    
+    template <int Index>
+    void set (double x)
+    {
+        pos[Index] = x;
+    }
+};
+
+static FILE *sim_gcode_file;
+static double sim_req_pos[NumAxes];
+static double sim_pos_offset[NumAxes];
+static uint64_t sim_planned_abs_steps[NumAxes];
+static double sim_max_speed;
+static bool sim_relative;
+static bool sim_relative_e;
+
+static int find_axis (char name)
+{
+    for (int i = 0; i < NumAxes; i++) {
+        if (SimAxisDefs[i].name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+enum {SIM_CMD_END, SIM_CMD_MOVE, SIM_CMD_FAN};
+
+static int read_command (double *new_pos, float *fan_duty)
+{
+    char line[512];
+    
+    while (fgets(line, sizeof(line), sim_gcode_file)) {
+        char *end = line + strcspn(line, ";*\r\n");
+        *end = '\0';
+        
+        char cmd_code = 0;
+        int cmd_number = -1;
+        bool have_axis[NumAxes] = {};
+        double axis_value[NumAxes];
+        double feedrate = -1.0;
+        double s_value = 255.0;
+        
+        char *p = line;
+        while (*p) {
+            char code = *p++;
+            if (code == ' ' || code == '\t') {
+                continue;
+            }
+            if (code >= 'a' && code <= 'z') {
+                code -= 'a' - 'A';
+            }
+            char *num_end;
+            double value = strtod(p, &num_end);
+            p = num_end;
+            
+            if (cmd_code == 0) {
+                if (code == 'G' || code == 'M') {
+                    cmd_code = code;
+                    cmd_number = value;
+                }
+                continue;
+            }
+            if (code == 'F') {
+                feedrate = value;
+                continue;
+            }
+            if (code == 'S') {
+                s_value = value;
+                continue;
+            }
+            int axis_index = find_axis(code);
+            if (axis_index >= 0) {
+                have_axis[axis_index] = true;
+                axis_value[axis_index] = value;
+            }
+        }
+        
+        if (cmd_code == 'M') {
+            if (cmd_number == 82 || cmd_number == 83) {
+                sim_relative_e = (cmd_number == 83);
+            }
+            if (cmd_number == 106 || cmd_number == 107) {
+                *fan_duty = (cmd_number == 106) ? fmin(1.0, fmax(0.0, s_value / 255.0)) : 0.0;
+                return SIM_CMD_FAN;
+            }
+            continue;
+        }
+        if (cmd_code != 'G') {
+            continue;
+        }
+        
+        switch (cmd_number) {
+            case 0:
+            case 1: {
+                if (feedrate >= 0.0) {
+                    sim_max_speed = feedrate / 60.0;
+                }
+                bool have_any = false;
+                for (int i = 0; i < NumAxes; i++) {
+                    new_pos[i] = sim_req_pos[i];
+                    if (have_axis[i]) {
+                        bool relative = is_cartesian_axis(SimAxisDefs[i].name) ? sim_relative : (sim_relative || sim_relative_e);
+                        new_pos[i] = relative ? (sim_req_pos[i] + axis_value[i]) : axis_value[i];
+                        have_any = true;
+                    }
+                }
+                if (have_any) {
+                    return SIM_CMD_MOVE;
+                }
+            } break;
+            
+            case 90:
+            case 91: {
+                sim_relative = (cmd_number == 91);
+            } break;
+            
+            case 92: {
+                for (int i = 0; i < NumAxes; i++) {
+                    if (have_axis[i]) {
+                        sim_pos_offset[i] += axis_value[i] - sim_req_pos[i];
+                        sim_req_pos[i] = axis_value[i];
+                    }
+                }
+            } break;
+        }
+    }
+    
+    return SIM_CMD_END;
+}
+
+static void planner_pull_handler (Context c)
+{
+    double new_pos[NumAxes];
+    float fan_duty;
+    int cmd_type;
+    
+    while ((cmd_type = read_command(new_pos, &fan_duty)) != SIM_CMD_END) {
+        if (cmd_type == SIM_CMD_FAN) {
+            auto *cmd = ThePlanner::getBuffer(c);
+            UnionGetElem<0>(&cmd->channel_payload)->duty = fan_duty;
+            sim_channel_commands.push_back(SimChannelCommand{sim_moves.size(), 0});
+            ThePlanner::channelCommandDone(c, 1);
+            return;
+        }
+        
+        double machine_pos[NumAxes];
+        for (int i = 0; i < NumAxes; i++) {
+            machine_pos[i] = new_pos[i] - sim_pos_offset[i];
+        }
+        
+        double phys_pos[NumAxes];
+        for (int i = 0; i < NumAxes; i++) {
+            phys_pos[i] = machine_pos[i];
+        }
+        TheTransform::virtToPhys(c, SimVirtSrc{machine_pos}, SimPhysDst{phys_pos});
+        
+        int64_t target_steps[NumAxes];
+        double distance_squared = 0.0;
+        bool seen_cartesian = false;
+        uint64_t max_steps = 0;
+        int main_axis = 0;
+        for (int i = 0; i < NumAxes; i++) {
+            target_steps[i] = llround(phys_pos[i] * SimAxisDefs[i].steps_per_unit);
+            uint64_t steps = llabs(target_steps[i] - sim_planned_steps[i]);
+            if (steps > max_steps) {
+                max_steps = steps;
+                main_axis = i;
+            }
+            if (is_cartesian_axis(SimAxisDefs[i].name)) {
+                double delta = new_pos[i] - sim_req_pos[i];
+                distance_squared += delta * delta;
+                seen_cartesian = seen_cartesian || (steps > 0);
+            }
+        }
+        
+        for (int i = 0; i < NumAxes; i++) {
+            sim_req_pos[i] = new_pos[i];
+        }
+        
+        if (max_steps == 0) {
+            continue;
+        }
+        
+        auto *cmd = ThePlanner::getBuffer(c);
+        ListFor<SimAxesList>([&] APRINTER_TL(axis, axis::write_command(cmd, target_steps)));
+        
+        SimMove move = {};
+        double time_freq_by_max_speed = (sim_max_speed > 0.0) ? (SimClock::time_freq / sim_max_speed) : 0.0;
+        if (seen_cartesian) {
+            move.distance = sqrt(distance_squared);
+            cmd->axes.rel_max_v_rec = move.distance * time_freq_by_max_speed;
+        } else {
+            cmd->axes.rel_max_v_rec = 0.0f;
+            for (int i = 0; i < NumAxes; i++) {
+                double dist = llabs(target_steps[i] - sim_planned_steps[i]) / SimAxisDefs[i].steps_per_unit;
+                move.distance = fmax(move.distance, dist);
+                cmd->axes.rel_max_v_rec = fmax(cmd->axes.rel_max_v_rec, dist * time_freq_by_max_speed);
+            }
+        }
+        
+        for (int i = 0; i < NumAxes; i++) {
+            sim_planned_abs_steps[i] += llabs(target_steps[i] - sim_planned_steps[i]);
+            sim_planned_steps[i] = target_steps[i];
+            move.end_steps[i] = sim_planned_abs_steps[i];
+        }
+        move.main_axis = main_axis;
+        sim_moves.push_back(move);
+        
+        ThePlanner::axesCommandDone(c);
+        return;
+    }
+    
+    ThePlanner::waitFinished(c);
+}
+
+static void planner_finished_handler (Context c)
+{
+    sim_done = true;
+}
+
+static void planner_aborted_handler (Context c)
+{
+    AMBRO_ASSERT_ABORT("planner aborted");
+}
+
+static void planner_underrun_callback (Context c)
+{
+    sim_underruns++;
+}
+
+/*
+ * Main loop.
+ */
+
+static double cpu_seconds ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool run_next_timer (Context c)
+{
+    int next = -1;
+    int32_t next_rel_time = 0;
+    for (int i = 0; i < NumSimTimers; i++) {
+        if (sim_timers[i].active) {
+            // Timers may be set slightly in the past, these fire right away.
+            int32_t rel_time = MaxValue((int32_t)0, (int32_t)(sim_timers[i].time - (uint32_t)sim_time));
+            if (next < 0 || rel_time < next_rel_time) {
+                next = i;
+                next_rel_time = rel_time;
+            }
+        }
+    }
+    if (next < 0) {
+        return false;
+    }
+    
+    sim_time += next_rel_time;
+    sim_timers[next].handler(MakeAtomicContext(c));
+    return true;
+}
+
+static void print_profiles ()
+{
+    printf("# move start_s duration_s distance avg_speed peak_speed\n");
+    for (size_t i = 0; i < sim_moves.size(); i++) {
+        SimMove const *move = &sim_moves[i];
+        double start = move->start_time / SimClock::time_freq;
+        double duration = (move->end_time - move->start_time) / SimClock::time_freq;
+        double avg_speed = (duration > 0.0) ? (move->distance / duration) : 0.0;
+        double peak_speed = 0.0;
+        if (move->min_step_interval > 0) {
+            uint64_t first_step = (i == 0) ? 0 : sim_moves[i - 1].end_steps[move->main_axis];
+            double steps = move->end_steps[move->main_axis] - first_step;
+            peak_speed = (move->distance / steps) * (SimClock::time_freq / move->min_step_interval);
+        }
+        printf("%zu %.6f %.6f %.4f %.3f %.3f\n", i, start, duration, move->distance, avg_speed, peak_speed);
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    bool print_moves = false;
+    char const *filename = nullptr;
+    
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s")) {
+            sim_trace_steps = true;
+        } else if (!strcmp(argv[i], "-p")) {
+            print_moves = true;
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (!filename) {
+        fprintf(stderr, "Usage: %s [-s] [-p] <file.gcode>\n", argv[0]);
+        return 1;
+    }
+    
+    sim_gcode_file = fopen(filename, "r");
+    if (!sim_gcode_file) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 1;
+    }
+    
+    Context c;
+    
+    new(&program_memory.program) Program();
+    
+    MyDebugObjectGroup::init(c);
+    TheConfigCache::init(c);
+    ListFor<SimAxesList>([&] APRINTER_TL(axis, axis::TheAxisDriver::init(c)));
+    ThePlanner::init(c, false);
+    
+    double cpu_start = cpu_seconds();
+    
+    while (!sim_done) {
+        if (Context::EventLoop::dispatchFastEvents(c)) {
+            continue;
+        }
+        if (!run_next_timer(c)) {
+            fprintf(stderr, "Simulation stalled\n");
+            return 1;
+        }
+    }
+    
+    double cpu_time = cpu_seconds() - cpu_start;
+    
+    ThePlanner::deinit(c);
+    ListForReverse<SimAxesList>([&] APRINTER_TL(axis, axis::TheAxisDriver::deinit(c)));
+    TheConfigCache::deinit(c);
+    fclose(sim_gcode_file);
+    
+    if (print_moves) {
+        print_profiles();
+    }
+    
+    uint64_t end_time = 0;
+    for (SimMove const &move : sim_moves) {
+        end_time = MaxValue(end_time, move.end_time);
+    }
+    
+    fprintf(stderr, "Lookahead: buffer %d commit %d (min %d)\n", PLANNER_SIM_LOOKAHEAD_BUFFER_SIZE, PLANNER_SIM_LOOKAHEAD_COMMIT_COUNT, PLANNER_SIM_MIN_LOOKAHEAD_COMMIT_COUNT);
+    fprintf(stderr, "Moves: %zu\n", sim_moves.size());
+    for (int i = 0; i < NumAxes; i++) {
+        fprintf(stderr, "Axis %c: %" PRIu64 " steps, end position %.4f\n", SimAxisDefs[i].name, sim_axes[i].steps, sim_axes[i].pos / SimAxisDefs[i].steps_per_unit);
+        AMBRO_ASSERT_FORCE(sim_axes[i].steps == sim_planned_abs_steps[i])
+    }
+    fprintf(stderr, "Print time: %.3f s\n", end_time / SimClock::time_freq);
+    
+    AMBRO_ASSERT_FORCE(sim_channel_done == sim_channel_commands.size())
+    double max_channel_offset = 0.0;
+    for (SimChannelCommand const &cmd : sim_channel_commands) {
+        if (cmd.num_moves > 0) {
+            double offset = ((double)cmd.time - (double)sim_moves[cmd.num_moves - 1].end_time) / SimClock::time_freq;
+            max_channel_offset = fmax(max_channel_offset, fabs(offset));
+        }
+    }
+    fprintf(stderr, "Fan commands: %zu (max %.6f s off the end of the preceding move)\n", sim_channel_commands.size(), max_channel_offset);
+    fprintf(stderr, "Underruns: %" PRIu64 "\n", sim_underruns);
+    fprintf(stderr, "CPU time: %.3f s (%.0f moves/s)\n", cpu_time, (cpu_time > 0.0) ? (sim_moves.size() / cpu_time) : 0.0);
+    
+    return 0;
+}